@@ -0,0 +1,68 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+using namespace std;
+
+// heap allocation counter of the benchmarks and tests: replaces the global operator new and delete,
+// so it must be included by exactly one source file of the program (the replacements are not inline)
+static atomic<long> g_nbAllocations(0);                 // all the threads of the process
+
+void* operator new(size_t size)
+{
+    g_nbAllocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// number of heap allocations of one run of f
+template <class function>
+long countAllocations(function f)
+{
+    long nbAllocations = g_nbAllocations;
+    f();
+    return g_nbAllocations - nbAllocations;
+}
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,338 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+// Benchmark harness: inference, learning and I/O of multilayerPerceptron on synthetic data sets
+// usage: bench [-samples N] [-repetitions N] [-warmup N] [-json file.json] [-network nbLayer1 nbLayer2 ...]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "multilayerPerceptron.h"
+#include "allocationCounter.h"            // learning and inference must not allocate once the buffers are sized
+#include "trainingSetCache.h"
+
+using namespace std;
+
+struct benchConfig
+{
+    int nbSample;                   // number of examples of the synthetic data sets
+    int nbRepetition;               // number of measured runs
+    int nbWarmup;                   // number of runs before measuring
+    string jsonFile;                // machine-readable results
+};
+
+struct benchResult
+{
+    string name;                    // topology name
+    string topology;                // ex: 4-100-100-4
+    string metric;                  // ex: forward_latency
+    string unit;                    // ex: us/sample
+    vector<double> tabValues;       // one value per run, sorted
+};
+
+static double percentile(const vector<double> &tabSorted, const double p)
+{
+    double position = p * (tabSorted.size() - 1);
+    int index = (int) position;
+    if (index + 1 >= tabSorted.size())
+        return tabSorted[tabSorted.size() - 1];
+    return tabSorted[index] + (position - index) * (tabSorted[index + 1] - tabSorted[index]);
+}
+
+// run f nbWarmup + nbRepetition times, return the duration in seconds of the measured runs
+template <class function>
+static vector<double> measure(const benchConfig &config, function f)
+{
+    for (int r=0; r < config.nbWarmup; r++)
+        f();
+
+    vector<double> tabDurations;
+    for (int r=0; r < config.nbRepetition; r++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        f();
+        tabDurations.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return tabDurations;
+}
+
+// value of each run: work / duration (rate) or duration / work (latency)
+static void addResult(vector<benchResult> &tabResults, const string name, const string topology, const string metric,
+                      const string unit, const vector<double> &tabDurations, const double work, const bool rate, const double scale = 1)
+{
+    benchResult result;
+    result.name = name;
+    result.topology = topology;
+    result.metric = metric;
+    result.unit = unit;
+    for (int i=0; i < tabDurations.size(); i++)
+        result.tabValues.push_back(rate ? scale * work / tabDurations[i] : scale * tabDurations[i] / work);
+    sort(result.tabValues.begin(), result.tabValues.end());
+    tabResults.push_back(result);
+
+    printf("%-14s %-16s %-22s median %12.4g  p10 %12.4g  p90 %12.4g  p99 %12.4g  %s\n", name.c_str(), topology.c_str(), metric.c_str(),
+           percentile(result.tabValues, 0.5), percentile(result.tabValues, 0.1), percentile(result.tabValues, 0.9),
+           percentile(result.tabValues, 0.99), unit.c_str());
+    fflush(stdout);
+}
+
+// number of heap allocations of one run of f, after a first run that sizes the buffers
+template <class function>
+static void addAllocations(vector<benchResult> &tabResults, const string name, const string topology, const string metric, function f)
+{
+    f();
+    long nbAllocations = countAllocations(f);
+    vector<double> tabDurations(1, 1);
+    addResult(tabResults, name, topology, metric, "allocations", tabDurations, nbAllocations, true);
+}
+
+static long fileSize(const string fileUrl)
+{
+    struct stat info;
+    if (stat(fileUrl.c_str(), &info) != 0)
+        return 0;
+    return info.st_size;
+}
+
+// synthetic data set: random inputs in [0,1], random outputs in {0,1}
+static void writeSyntheticSet(const string fileUrl, const vector<int> &tabNbNeurons, const int nbSample, const bool withOutputs)
+{
+    int nbInput = tabNbNeurons[0];
+    int nbOutput = tabNbNeurons[tabNbNeurons.size() - 1];
+    ofstream file(fileUrl.c_str(), ios::out | ios::trunc);
+    file << "[mlp]" << endl << nbInput << " " << nbOutput << " " << nbSample << endl << endl << "[inputs]" << endl;
+    for (int i=0; i < nbSample; i++)
+    {
+        for (int j=0; j < nbInput; j++)
+            file << (double) rand() / RAND_MAX << " ";
+        file << endl;
+    }
+
+    if (!withOutputs)
+        return;
+    file << endl << "[outputs]" << endl;
+    for (int i=0; i < nbSample; i++)
+    {
+        for (int j=0; j < nbOutput; j++)
+            file << rand() % 2 << " ";
+        file << endl;
+    }
+}
+
+static void benchTopology(const benchConfig &config, const string name, const vector<int> &tabNbNeurons, vector<benchResult> &tabResults)
+{
+    string topology;
+    for (int i=0; i < tabNbNeurons.size(); i++)
+        topology += (i > 0 ? "-" : "") + to_string(tabNbNeurons[i]);
+
+    string trainingSetText = "bench_" + name + "_set.txt";
+    string trainingSetBinary = "bench_" + name + "_set.bin";
+    string computeSet = "bench_" + name + "_compute.txt";
+    string computeOut = "bench_" + name + "_compute_out.txt";
+    string state = "bench_" + name + "_state.bin";
+    writeSyntheticSet(trainingSetText, tabNbNeurons, config.nbSample, true);
+    writeSyntheticSet(computeSet, tabNbNeurons, config.nbSample, false);
+
+    multilayerPerceptron network(tabNbNeurons);
+    network.loadTrainingSetFile(trainingSetText);
+    network.saveTrainingSetFile(trainingSetBinary);
+    network.learning(1);
+
+    // inference: one run = all the examples, one by one
+    vector< vector<double> > tabInputs(config.nbSample, vector<double>(tabNbNeurons[0]));
+    for (int i=0; i < tabInputs.size(); i++)
+        for (int j=0; j < tabInputs[i].size(); j++)
+            tabInputs[i][j] = (double) rand() / RAND_MAX;
+
+    vector<double> tabOutput;
+    vector<double> tabDurations = measure(config, [&]() {
+        for (int i=0; i < tabInputs.size(); i++)
+            network.computeOutput(tabInputs[i], tabOutput);
+    });
+    addResult(tabResults, name, topology, "forward_latency", "us/sample", tabDurations, tabInputs.size(), false, 1e6);
+
+    vector< vector<double> > tabOutputs;
+    vector<double> matrixInputs;
+    vector<double> matrixOutputs;
+    tabDurations = measure(config, [&]() { network.computeBatch(tabInputs, tabOutputs); });
+    addResult(tabResults, name, topology, "batch_throughput", "samples/s", tabDurations, tabInputs.size(), true);
+
+    // learning: one run = one epoch
+    tabDurations = measure(config, [&]() { network.learning(1); });
+    addResult(tabResults, name, topology, "learning_epochs", "epochs/s", tabDurations, 1, true);
+    addResult(tabResults, name, topology, "learning_samples", "samples/s", tabDurations, config.nbSample, true);
+
+    // mixed precision: 16-bit weights, momentum and activations, float sums
+    const mlpPrecision tabPrecisions[2] = {PRECISION_BFLOAT16, PRECISION_FLOAT16};
+    for (int p=0; p < 2; p++)
+    {
+        network.setPrecision(tabPrecisions[p]);
+        tabDurations = measure(config, [&]() { network.learning(1); });
+        addResult(tabResults, name, topology, string("learning_samples_") + precisionName(tabPrecisions[p]), "samples/s",
+                  tabDurations, config.nbSample, true);
+    }
+    network.setPrecision(PRECISION_DOUBLE);
+
+    // gradient accumulation: micro-batches of 16 samples (budget of the topology), one update per 4 micro-batches
+    network.setAccumulation(mlpAccumulation::requiredBudget(tabNbNeurons, 16), 4);
+    tabDurations = measure(config, [&]() { network.learning(1); });
+    addResult(tabResults, name, topology, "learning_samples_accumulation", "samples/s", tabDurations, config.nbSample, true);
+    network.setAccumulation(0);
+
+    // steady state: no heap allocation per sample
+    matrixInputs.resize(tabInputs.size() * tabNbNeurons[0]);
+    for (int i=0; i < tabInputs.size(); i++)
+        copy(tabInputs[i].begin(), tabInputs[i].end(), matrixInputs.begin() + i * tabNbNeurons[0]);
+    matrixOutputs.resize(tabInputs.size() * tabNbNeurons[tabNbNeurons.size() - 1]);
+    addAllocations(tabResults, name, topology, "forward_allocations", [&]() {
+        for (int i=0; i < tabInputs.size(); i++)
+            network.computeOutput(tabInputs[i], tabOutput);
+    });
+    addAllocations(tabResults, name, topology, "batch_allocations", [&]() { network.computeBatch(tabInputs, tabOutputs); });
+    addAllocations(tabResults, name, topology, "matrix_allocations", [&]() {
+        network.computeBatch(matrixInputs.data(), matrixOutputs.data(), tabInputs.size());
+    });
+    addAllocations(tabResults, name, topology, "epoch_allocations", [&]() { network.learning(1); });
+
+    // I/O
+    tabDurations = measure(config, [&]() { network.computeFile(computeSet, computeOut); });
+    addResult(tabResults, name, topology, "computeFile_rows", "rows/s", tabDurations, config.nbSample, true);
+
+    // parsing speed: without the training set cache, then a cached file
+    trainingSetCache &cache = trainingSetCache::instance();
+    long memoryLimit = cache.getMemoryLimit();
+    cache.setMemoryLimit(0);
+    tabDurations = measure(config, [&]() { network.loadTrainingSetFile(trainingSetText); });
+    addResult(tabResults, name, topology, "load_text", "MB/s", tabDurations, fileSize(trainingSetText), true, 1e-6);
+
+    tabDurations = measure(config, [&]() { network.loadTrainingSetFile(trainingSetBinary); });
+    addResult(tabResults, name, topology, "load_binary", "MB/s", tabDurations, fileSize(trainingSetBinary), true, 1e-6);
+
+    cache.setMemoryLimit(memoryLimit);
+    network.loadTrainingSetFile(trainingSetText);
+    tabDurations = measure(config, [&]() { network.loadTrainingSetFile(trainingSetText); });
+    addResult(tabResults, name, topology, "load_cached", "MB/s", tabDurations, fileSize(trainingSetText), true, 1e-6);
+
+    tabDurations = measure(config, [&]() { network.saveState(state); });
+    addResult(tabResults, name, topology, "saveState", "ms", tabDurations, 1, false, 1e3);
+
+    tabDurations = measure(config, [&]() { network.loadState(state); });
+    addResult(tabResults, name, topology, "loadState", "ms", tabDurations, 1, false, 1e3);
+
+    remove(trainingSetText.c_str());
+    remove(trainingSetBinary.c_str());
+    remove(computeSet.c_str());
+    remove(computeOut.c_str());
+    remove(state.c_str());
+}
+
+static bool saveJson(const benchConfig &config, const vector<benchResult> &tabResults)
+{
+    ofstream file(config.jsonFile.c_str(), ios::out | ios::trunc);
+    if (!file.is_open())
+    {
+        cout << "error: can't open file " << config.jsonFile << endl;
+        return false;
+    }
+
+    file.precision(9);
+    file << "{" << endl;
+    file << "  \"config\": {\"samples\": " << config.nbSample << ", \"repetitions\": " << config.nbRepetition
+         << ", \"warmup\": " << config.nbWarmup << "}," << endl;
+    file << "  \"results\": [" << endl;
+    for (int i=0; i < tabResults.size(); i++)
+    {
+        const benchResult &result = tabResults[i];
+        file << "    {\"name\": \"" << result.name << "\", \"topology\": \"" << result.topology << "\", \"metric\": \"" << result.metric
+             << "\", \"unit\": \"" << result.unit << "\", \"median\": " << percentile(result.tabValues, 0.5)
+             << ", \"p10\": " << percentile(result.tabValues, 0.1) << ", \"p90\": " << percentile(result.tabValues, 0.9)
+             << ", \"p99\": " << percentile(result.tabValues, 0.99) << ", \"min\": " << result.tabValues[0]
+             << ", \"max\": " << result.tabValues[result.tabValues.size() - 1] << "}" << (i + 1 < tabResults.size() ? "," : "") << endl;
+    }
+    file << "  ]" << endl << "}" << endl;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    benchConfig config;
+    config.nbSample = 1000;
+    config.nbRepetition = 10;
+    config.nbWarmup = 2;
+    config.jsonFile = "bench.json";
+
+    // topologies of the examples
+    vector<string> tabNames = {"xor", "sin", "vehicle", "cross_circle"};
+    vector< vector<int> > tabTopologies = {{2, 5, 1}, {1, 100, 100, 1}, {4, 100, 100, 4}, {49, 100, 100, 2}};
+
+    for (int i=1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-samples" && i + 1 < argc)
+            config.nbSample = max(1, atoi(argv[++i]));
+        else if (arg == "-repetitions" && i + 1 < argc)
+            config.nbRepetition = max(1, atoi(argv[++i]));
+        else if (arg == "-warmup" && i + 1 < argc)
+            config.nbWarmup = max(0, atoi(argv[++i]));
+        else if (arg == "-json" && i + 1 < argc)
+            config.jsonFile = argv[++i];
+        else if (arg == "-network")
+        {
+            // custom topology: all the following integers
+            vector<int> tabNbNeurons;
+            while (i + 1 < argc && atoi(argv[i + 1]) > 0)
+                tabNbNeurons.push_back(atoi(argv[++i]));
+            if (tabNbNeurons.size() < 2)
+            {
+                cout << "a network must contain at least 2 layers (ex: -network 1 10 1)" << endl;
+                return 1;
+            }
+            tabNames.push_back("custom" + to_string(tabNames.size() - 3));
+            tabTopologies.push_back(tabNbNeurons);
+        }
+        else
+        {
+            cout << "usage: bench [-samples N] [-repetitions N] [-warmup N] [-json file.json] [-network nbLayer1 nbLayer2 ...]" << endl;
+            return 1;
+        }
+    }
+
+    srand(1);
+    vector<benchResult> tabResults;
+    for (int i=0; i < tabTopologies.size(); i++)
+        benchTopology(config, tabNames[i], tabTopologies[i], tabResults);
+
+    if (!saveJson(config, tabResults))
+        return 1;
+    cout << "results saved in " << config.jsonFile << endl;
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+// Benchmark: fixedMlp (compile-time topology) versus multilayerPerceptron on the examples
+// usage: benchFixedMlp [examples directory]
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <stdlib.h>
+#include "multilayerPerceptron.h"
+#include "allocationCounter.h"            // fixedMlp must not allocate
+#include "fixedMlp.h"
+
+using namespace std;
+
+static bool readTrainingSet(const string fileUrl, vector< vector<double> > &tabInputs, vector< vector<double> > &tabOutputs)
+{
+    ifstream file(fileUrl.c_str());
+    string word;
+    int nbInput = 0;
+    int nbOutput = 0;
+    int nbSample = 0;
+    file >> word >> nbInput >> nbOutput >> nbSample >> word;
+    if (!file.is_open() || word != "[inputs]")
+        return false;
+
+    tabInputs.assign(nbSample, vector<double>(nbInput));
+    tabOutputs.assign(nbSample, vector<double>(nbOutput));
+    for (int i=0; i < nbSample; i++)
+        for (int j=0; j < nbInput; j++)
+            file >> tabInputs[i][j];
+    file >> word;
+    for (int i=0; i < nbSample; i++)
+        for (int j=0; j < nbOutput; j++)
+            file >> tabOutputs[i][j];
+    return true;
+}
+
+template <int... nbNeurons>
+static void bench(const string name, const string fileUrl, const int nbEpoch)
+{
+    typedef fixedMlp<nbNeurons...> fixedNetwork;
+    vector< vector<double> > tabInputs;
+    vector< vector<double> > tabOutputs;
+    if (!readTrainingSet(fileUrl, tabInputs, tabOutputs))
+    {
+        cout << name << ": can't read " << fileUrl << endl;
+        return;
+    }
+
+    vector<int> tabNbNeurons = {nbNeurons...};
+    multilayerPerceptron dynamic(tabNbNeurons);
+    fixedNetwork *fixed = new fixedNetwork();
+
+    // training: same number of epochs on the same examples
+    dynamic.loadTrainingSet(tabInputs, tabOutputs);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    dynamic.learning(nbEpoch);
+    double dynamicLearning = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+    vector< array<double, fixedNetwork::nbInputs> > tabFixedInputs(tabInputs.size());
+    vector< array<double, fixedNetwork::nbOutputs> > tabFixedOutputs(tabInputs.size());
+    for (int i=0; i < tabInputs.size(); i++)
+    {
+        copy(tabInputs[i].begin(), tabInputs[i].end(), tabFixedInputs[i].begin());
+        copy(tabOutputs[i].begin(), tabOutputs[i].end(), tabFixedOutputs[i].begin());
+    }
+
+    long nbAllocations = g_nbAllocations;
+    start = chrono::steady_clock::now();
+    fixed->setRandomWeights();
+    for (int epoch=0; epoch < nbEpoch; epoch++)
+        for (int i=0; i < tabFixedInputs.size(); i++)
+            fixed->train(tabFixedInputs[i], tabFixedOutputs[i]);
+    double fixedLearning = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    long fixedLearningAllocations = g_nbAllocations - nbAllocations;
+
+    // inference: same weights (saveState / loadState), outputs must be identical
+    dynamic.saveState("benchFixedMlp.bin");
+    fixed->loadState("benchFixedMlp.bin");
+    remove("benchFixedMlp.bin");
+
+    const int nbRepetition = max(1, 100000 / (int) tabInputs.size());
+    vector<double> tabDynamicOutput;
+    start = chrono::steady_clock::now();
+    for (int r=0; r < nbRepetition; r++)
+        for (int i=0; i < tabInputs.size(); i++)
+            dynamic.computeOutput(tabInputs[i], tabDynamicOutput);
+    double dynamicCompute = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+    array<double, fixedNetwork::nbOutputs> tabFixedOutput;
+    nbAllocations = g_nbAllocations;
+    start = chrono::steady_clock::now();
+    for (int r=0; r < nbRepetition; r++)
+        for (int i=0; i < tabFixedInputs.size(); i++)
+            fixed->predict(tabFixedInputs[i], tabFixedOutput);
+    double fixedCompute = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    long fixedComputeAllocations = g_nbAllocations - nbAllocations;
+
+    int nbMismatch = 0;
+    for (int i=0; i < tabInputs.size(); i++)
+    {
+        dynamic.computeOutput(tabInputs[i], tabDynamicOutput);
+        fixed->predict(tabFixedInputs[i], tabFixedOutput);
+        for (int k=0; k < tabFixedOutput.size(); k++)
+            if (tabFixedOutput[k] != tabDynamicOutput[k])
+                nbMismatch++;
+    }
+
+    double nbLearningSample = (double) nbEpoch * tabInputs.size();
+    double nbComputeSample = (double) nbRepetition * tabInputs.size();
+    cout << name << endl;
+    cout << "\t" << "learning: multilayerPerceptron = " << dynamicLearning / nbLearningSample << " us, fixedMlp = "
+         << fixedLearning / nbLearningSample << " us per sample (speedup x" << dynamicLearning / fixedLearning << ")" << endl;
+    cout << "\t" << "compute:  multilayerPerceptron = " << dynamicCompute / nbComputeSample << " us, fixedMlp = "
+         << fixedCompute / nbComputeSample << " us per sample (speedup x" << dynamicCompute / fixedCompute << ")" << endl;
+    cout << "\t" << "fixedMlp heap allocations: learning = " << fixedLearningAllocations << ", compute = " << fixedComputeAllocations
+         << ", output mismatches = " << nbMismatch << endl;
+    delete fixed;
+}
+
+int main(int argc, char *argv[])
+{
+    string directory = "examples";
+    if (argc > 1)
+        directory = argv[1];
+
+    bench<2, 5, 1>("xor 2 5 1", directory + "/xor.txt", 5000);
+    bench<1, 100, 100, 1>("sin 1 100 100 1", directory + "/sin.txt", 100);
+    bench<4, 100, 100, 4>("vehicle 4 100 100 4", directory + "/vehicle.txt", 100);
+    bench<49, 100, 100, 2>("cross_circle 49 100 100 2", directory + "/cross_circle.txt", 50);
+    return 0;
+}
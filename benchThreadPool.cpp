@@ -0,0 +1,189 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+// Benchmark: task overhead and scaling of the thread pool from 1 to N workers
+// usage: benchThreadPool [-threads N] [-samples N] [-repetitions N] [-network nbLayer1 nbLayer2 ...]
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "threadPool.h"
+#include "multilayerPerceptron.h"
+
+using namespace std;
+
+struct benchConfig
+{
+    int nbThreads;                                      // largest number of workers measured
+    int nbSample;                                       // computeBatch samples
+    int nbRepetition;
+    vector<int> tabTopology;
+};
+
+// median duration in seconds of nbRepetition runs (after one warm-up run)
+template <class function>
+static double measure(const benchConfig &config, const function &run)
+{
+    run();
+    vector<double> tabDurations;
+    for (int r=0; r < config.nbRepetition; r++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        run();
+        tabDurations.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    sort(tabDurations.begin(), tabDurations.end());
+    return tabDurations[tabDurations.size() / 2];
+}
+
+// cost of one task: empty parallelFor chunks, and a submitted task from the calling thread back to it
+static void benchOverhead(const benchConfig &config, const int nbThreads)
+{
+    threadPool &pool = threadPool::instance();
+    const int nbTask = 100000;
+    double forTime = measure(config, [&]() { pool.parallelFor(0, nbTask, 1, [](long, long) {}); });
+
+    const int nbSubmit = 1000;
+    double submitTime = measure(config, [&]() {
+        for (int i=0; i < nbSubmit; i++)
+        {
+            atomic<bool> done(false);
+            pool.submit([&done]() { done = true; });
+            while (!done)
+                this_thread::yield();
+        }
+    });
+
+    char line[256];
+    snprintf(line, sizeof line, "%8d %16.1f %18.2f", nbThreads, 1e9 * forTime / nbTask, 1e6 * submitTime / nbSubmit);
+    cout << line << endl;
+}
+
+// compute-bound work: a reduction of independent terms and computeBatch of a network
+static void benchScaling(const benchConfig &config, multilayerPerceptron &network, const vector<double> &tabInputs,
+                         vector<double> &tabOutputs, const int nbThreads, double &reduceReference, double &batchReference)
+{
+    threadPool &pool = threadPool::instance();
+    const long nbTerm = 20000000;
+    double sum = 0;
+    double reduceTime = measure(config, [&]() {
+        sum = pool.parallelReduce(0, nbTerm, 65536, 0.0,
+            [](long first, long last) {
+                double partial = 0;
+                for (long i=first; i < last; i++)
+                    partial += sqrt((double) i);
+                return partial;
+            },
+            [](double a, double b) { return a + b; });
+    });
+    double batchTime = measure(config, [&]() {
+        network.computeBatch(tabInputs.data(), tabOutputs.data(), config.nbSample, nbThreads);
+    });
+
+    if (nbThreads == 1)
+    {
+        reduceReference = reduceTime;
+        batchReference = batchTime;
+    }
+    char line[256];
+    snprintf(line, sizeof line, "%8d %14.1f %9.2fx %18.0f %9.2fx %10.0f%%", nbThreads, 1e3 * reduceTime, reduceReference / reduceTime,
+             config.nbSample / batchTime, batchReference / batchTime, 100 * batchReference / batchTime / nbThreads);
+    cout << line << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    benchConfig config;
+    config.nbThreads = max(1, (int) thread::hardware_concurrency());
+    config.nbSample = 20000;
+    config.nbRepetition = 5;
+    config.tabTopology = {256, 512, 512, 10};
+
+    for (int i=1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-threads" && i + 1 < argc)
+            config.nbThreads = max(1, atoi(argv[++i]));
+        else if (arg == "-samples" && i + 1 < argc)
+            config.nbSample = max(1, atoi(argv[++i]));
+        else if (arg == "-repetitions" && i + 1 < argc)
+            config.nbRepetition = max(1, atoi(argv[++i]));
+        else if (arg == "-network")
+        {
+            vector<int> tabNbNeurons;
+            while (i + 1 < argc && atoi(argv[i + 1]) > 0)
+                tabNbNeurons.push_back(atoi(argv[++i]));
+            if (tabNbNeurons.size() < 2)
+            {
+                cout << "a network must contain at least 2 layers (ex: -network 1 10 1)" << endl;
+                return 1;
+            }
+            config.tabTopology = tabNbNeurons;
+        }
+        else
+        {
+            cout << "usage: benchThreadPool [-threads N] [-samples N] [-repetitions N] [-network nbLayer1 nbLayer2 ...]" << endl;
+            return 1;
+        }
+    }
+
+    srand(1);
+    multilayerPerceptron network(config.tabTopology);
+    vector<double> tabInputs((size_t) config.nbSample * config.tabTopology[0]);
+    vector<double> tabOutputs((size_t) config.nbSample * config.tabTopology.back());
+    for (size_t i=0; i < tabInputs.size(); i++)
+        tabInputs[i] = (double) rand() / RAND_MAX;
+
+    cout << "task overhead" << endl;
+    cout << " threads   parallelFor (ns)   submit+wait (us)" << endl;
+    for (int t=1; t <= config.nbThreads; t++)
+    {
+        threadPool::instance().setThreads(t);
+        benchOverhead(config, t);
+    }
+
+    cout << endl << "scaling (" << config.nbSample << " samples, network";
+    for (int i=0; i < config.tabTopology.size(); i++)
+        cout << " " << config.tabTopology[i];
+    cout << ")" << endl;
+    cout << " threads    reduce (ms)   speedup  batch (samples/s)   speedup  efficiency" << endl;
+    double reduceReference = 0;
+    double batchReference = 0;
+    for (int t=1; t <= config.nbThreads; t++)
+    {
+        threadPool::instance().setThreads(t);
+        benchScaling(config, network, tabInputs, tabOutputs, t, reduceReference, batchReference);
+    }
+
+    threadPoolStats stats = threadPool::instance().getStats();
+    cout << endl << "last run: " << stats.nbTask << " tasks, " << stats.nbSteal << " steals" << endl;
+    return 0;
+}
@@ -0,0 +1,272 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "cascadeModel.h"
+#include "threadPool.h"
+#include <chrono>
+#include <limits>
+#include <math.h>
+#include <algorithm>
+
+cascadeModel::cascadeModel()
+{
+    m_fastPerceptron = NULL;
+    m_fastMlp = NULL;
+    m_expensive = NULL;
+    m_nbInput = 0;
+    m_nbOutput = 0;
+    m_threshold = 0;
+    resetStats();
+}
+
+bool cascadeModel::setStages(const multiClassPerceptron *fastPerceptron, const multilayerPerceptron *fastMlp, const multilayerPerceptron *expensive)
+{
+    m_fastPerceptron = NULL;
+    m_fastMlp = NULL;
+    m_expensive = NULL;
+    if (!expensive || (fastPerceptron == NULL) == (fastMlp == NULL))
+    {
+        cout << "Error: a cascade needs one fast stage and an expensive network" << endl;
+        return false;
+    }
+
+    vector<int> tabNbNeurons = expensive->getTopology();
+    int nbInput = tabNbNeurons[0];
+    int nbOutput = tabNbNeurons[tabNbNeurons.size() - 1];
+    if (fastPerceptron && (fastPerceptron->getNbInput() != nbInput || fastPerceptron->getNbOutput() != nbOutput))
+    {
+        cout << "Error: the perceptron must have the inputs and outputs of the network (" << nbInput << " " << nbOutput << ")" << endl;
+        return false;
+    }
+    if (fastMlp)
+    {
+        vector<int> tabFast = fastMlp->getTopology();
+        if (tabFast[0] != nbInput || tabFast[tabFast.size() - 1] != nbOutput)
+        {
+            cout << "Error: the fast network must have the inputs and outputs of the network (" << nbInput << " " << nbOutput << ")" << endl;
+            return false;
+        }
+    }
+
+    m_fastPerceptron = fastPerceptron;
+    m_fastMlp = fastMlp;
+    m_expensive = expensive;
+    m_nbInput = nbInput;
+    m_nbOutput = nbOutput;
+    return true;
+}
+
+void cascadeModel::setThreshold(const double threshold)
+{
+    m_threshold = threshold;
+}
+
+double cascadeModel::getThreshold() const
+{
+    return m_threshold;
+}
+
+const cascadeStats &cascadeModel::getStats() const
+{
+    return m_stats;
+}
+
+void cascadeModel::resetStats()
+{
+    m_stats = {0, 0, 0, 0};
+}
+
+double cascadeModel::margin(const double *scores, const double center) const
+{
+    if (m_nbOutput == 1)
+        return fabs(scores[0] - center);
+
+    double first = -numeric_limits<double>::infinity();
+    double second = first;
+    for (int o=0; o < m_nbOutput; o++)
+    {
+        if (scores[o] > first)
+        {
+            second = first;
+            first = scores[o];
+        }
+        else if (scores[o] > second)
+            second = scores[o];
+    }
+    return first - second;
+}
+
+void cascadeModel::computeFast(const double *tabInputs, double *tabOutputs, const int nbSample)
+{
+    m_tabMargins.resize(nbSample);
+    if (m_fastMlp)
+    {
+        m_fastMlp->computeBatch(tabInputs, tabOutputs, nbSample, threadPool::instance().size());
+        for (int s=0; s < nbSample; s++)
+            m_tabMargins[s] = margin(&tabOutputs[(size_t) s * m_nbOutput], 0.5);
+        return;
+    }
+
+    // perceptron: the margin is measured on the sums, the outputs are those of perceptronCompute
+    m_tabScores.resize((size_t) nbSample * m_nbOutput);
+    m_fastPerceptron->computeScores(tabInputs, m_tabScores.data(), nbSample);
+    bool multiClass = (m_fastPerceptron->getMode() == PERCEPTRON_MULTI_CLASS);
+    for (int s=0; s < nbSample; s++)
+    {
+        const double *scores = &m_tabScores[(size_t) s * m_nbOutput];
+        double *outputs = &tabOutputs[(size_t) s * m_nbOutput];
+        m_tabMargins[s] = margin(scores, 0);
+        int best = max_element(scores, scores + m_nbOutput) - scores;
+        for (int o=0; o < m_nbOutput; o++)
+            outputs[o] = multiClass ? (o == best) : (scores[o] > 0);
+    }
+}
+
+bool cascadeModel::computeBatch(const double *tabInputs, double *tabOutputs, const int nbSample)
+{
+    if (!m_expensive || nbSample < 0)
+        return false;
+
+    // the fast stage computes the whole batch, the low-margin samples are gathered into one batch of the expensive network
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    computeFast(tabInputs, tabOutputs, nbSample);
+    m_tabRouted.clear();
+    for (int s=0; s < nbSample; s++)
+        if (m_tabMargins[s] < m_threshold)
+            m_tabRouted.push_back(s);
+
+    int nbRouted = m_tabRouted.size();
+    m_tabRoutedInputs.resize((size_t) nbRouted * m_nbInput);
+    m_tabRoutedOutputs.resize((size_t) nbRouted * m_nbOutput);
+    for (int r=0; r < nbRouted; r++)
+        copy_n(&tabInputs[(size_t) m_tabRouted[r] * m_nbInput], m_nbInput, &m_tabRoutedInputs[(size_t) r * m_nbInput]);
+    chrono::steady_clock::time_point routed = chrono::steady_clock::now();
+
+    bool ret = true;
+    if (nbRouted > 0)
+    {
+        ret = m_expensive->computeBatch(m_tabRoutedInputs.data(), m_tabRoutedOutputs.data(), nbRouted, threadPool::instance().size());
+        for (int r=0; r < nbRouted; r++)
+            copy_n(&m_tabRoutedOutputs[(size_t) r * m_nbOutput], m_nbOutput, &tabOutputs[(size_t) m_tabRouted[r] * m_nbOutput]);
+    }
+
+    m_stats.nbSample += nbSample;
+    m_stats.nbRouted += nbRouted;
+    m_stats.fastTime += chrono::duration<double>(routed - start).count();
+    m_stats.expensiveTime += chrono::duration<double>(chrono::steady_clock::now() - routed).count();
+    return ret;
+}
+
+bool cascadeModel::isCorrect(const double *outputs, const double *targets) const
+{
+    if (m_nbOutput == 1)
+        return (outputs[0] > 0.5) == (targets[0] > 0.5);
+    return max_element(outputs, outputs + m_nbOutput) - outputs == max_element(targets, targets + m_nbOutput) - targets;
+}
+
+bool cascadeModel::calibrate(const string validationFileUrl, const double targetAccuracy)
+{
+    if (!m_expensive)
+        return false;
+
+    // validation set in the training set format of the network
+    multilayerPerceptron validation(m_expensive->getTopology());
+    if (!validation.loadTrainingSetFile(validationFileUrl))
+        return false;
+    shared_ptr< const vector<traningSetMlp> > trainingSet = validation.getTrainingSet();
+    int nbSample = trainingSet->size();
+    if (nbSample == 0)
+    {
+        cout << "Error: empty validation set " << validationFileUrl << endl;
+        return false;
+    }
+
+    vector<double> tabInputs((size_t) nbSample * m_nbInput, 0);
+    vector<double> tabTargets((size_t) nbSample * m_nbOutput);
+    for (int s=0; s < nbSample; s++)
+    {
+        const traningSetMlp &example = (*trainingSet)[s];
+        double *inputs = &tabInputs[(size_t) s * m_nbInput];
+        if (example.tabExamples.empty())
+            for (int k=0; k < example.tabNonZeroIndexes.size(); k++)
+                inputs[example.tabNonZeroIndexes[k]] = example.tabNonZeroValues[k];
+        else
+            copy(example.tabExamples.begin(), example.tabExamples.end(), inputs);
+        copy(example.tabOutputTargets.begin(), example.tabOutputTargets.end(), &tabTargets[(size_t) s * m_nbOutput]);
+    }
+
+    // both stages on every sample, then the samples by decreasing margin: the first ones are kept by the fast stage
+    vector<double> tabFast((size_t) nbSample * m_nbOutput);
+    vector<double> tabExpensive((size_t) nbSample * m_nbOutput);
+    computeFast(tabInputs.data(), tabFast.data(), nbSample);
+    m_expensive->computeBatch(tabInputs.data(), tabExpensive.data(), nbSample, threadPool::instance().size());
+
+    vector<int> tabOrder(nbSample);
+    int nbExpensiveCorrect = 0;
+    int nbFastCorrect = 0;
+    for (int s=0; s < nbSample; s++)
+    {
+        tabOrder[s] = s;
+        nbExpensiveCorrect += isCorrect(&tabExpensive[(size_t) s * m_nbOutput], &tabTargets[(size_t) s * m_nbOutput]);
+        nbFastCorrect += isCorrect(&tabFast[(size_t) s * m_nbOutput], &tabTargets[(size_t) s * m_nbOutput]);
+    }
+    sort(tabOrder.begin(), tabOrder.end(), [this](const int a, const int b) { return m_tabMargins[a] > m_tabMargins[b]; });
+
+    // threshold infinity: everything routed; after the last sample of each margin value: the samples up to it are kept
+    double bestThreshold = numeric_limits<double>::infinity();
+    int bestNbFast = 0;
+    int bestNbCorrect = nbExpensiveCorrect;
+    bool reached = (nbExpensiveCorrect >= targetAccuracy * nbSample);
+    int nbCorrect = nbExpensiveCorrect;
+    for (int i=0; i < nbSample; i++)
+    {
+        int s = tabOrder[i];
+        nbCorrect += isCorrect(&tabFast[(size_t) s * m_nbOutput], &tabTargets[(size_t) s * m_nbOutput])
+                   - isCorrect(&tabExpensive[(size_t) s * m_nbOutput], &tabTargets[(size_t) s * m_nbOutput]);
+        if (i + 1 < nbSample && m_tabMargins[tabOrder[i + 1]] == m_tabMargins[s])
+            continue;
+        if (nbCorrect >= targetAccuracy * nbSample)
+        {
+            reached = true;
+            bestThreshold = m_tabMargins[s];
+            bestNbFast = i + 1;
+            bestNbCorrect = nbCorrect;
+        }
+    }
+
+    cout << "validation: " << nbSample << " samples, accuracy " << (double) nbFastCorrect / nbSample << " (fast stage), "
+         << (double) nbExpensiveCorrect / nbSample << " (expensive network)" << endl;
+    if (!reached)
+    {
+        cout << "Error: the cascade can't reach an accuracy of " << targetAccuracy << " on " << validationFileUrl << endl;
+        return false;
+    }
+
+    m_threshold = bestThreshold;
+    cout << "threshold " << m_threshold << ": accuracy " << (double) bestNbCorrect / nbSample << ", "
+         << 100.0 * (nbSample - bestNbFast) / nbSample << "% routed to the expensive network" << endl;
+    return true;
+}
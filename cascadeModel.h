@@ -0,0 +1,76 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef CASCADEMODEL_H
+#define CASCADEMODEL_H
+
+#include "multilayerPerceptron.h"
+#include "perceptron.h"
+using namespace std;
+
+struct cascadeStats
+{
+    long nbSample;                                      // samples computed
+    long nbRouted;                                      // samples computed again by the expensive network
+    double fastTime;                                    // seconds in the fast stage and the routing
+    double expensiveTime;                               // seconds in the expensive network
+};
+
+// a fast stage (perceptron or small network) in front of an expensive network with the same inputs and outputs.
+// Margin of the fast outputs: one output, distance to the decision threshold (0 for a perceptron, 0.5 for a network);
+// several outputs, difference between the two highest. A sample whose margin is below the threshold is computed
+// again by the expensive network. The stages are not owned (setStages before each use).
+class cascadeModel
+{
+public:
+    cascadeModel();
+    bool setStages(const multiClassPerceptron *fastPerceptron, const multilayerPerceptron *fastMlp, const multilayerPerceptron *expensive);
+    void setThreshold(const double threshold);
+    double getThreshold() const;
+    bool computeBatch(const double *tabInputs, double *tabOutputs, const int nbSample);   // row-major
+    bool calibrate(const string validationFileUrl, const double targetAccuracy);        // highest fast fraction reaching the accuracy
+    const cascadeStats &getStats() const;
+    void resetStats();
+
+private:
+    const multiClassPerceptron *m_fastPerceptron;
+    const multilayerPerceptron *m_fastMlp;
+    const multilayerPerceptron *m_expensive;
+    int m_nbInput;
+    int m_nbOutput;
+    double m_threshold;
+    cascadeStats m_stats;
+    vector<double> m_tabScores;                         // batch buffers, reused by each call
+    vector<double> m_tabMargins;
+    vector<int> m_tabRouted;                            // indexes of the samples routed to the expensive network
+    vector<double> m_tabRoutedInputs;
+    vector<double> m_tabRoutedOutputs;
+    void computeFast(const double *tabInputs, double *tabOutputs, const int nbSample);    // outputs and m_tabMargins
+    double margin(const double *scores, const double center) const;
+    bool isCorrect(const double *outputs, const double *targets) const;  // one output: same side of 0.5, several: same highest
+};
+
+#endif // CASCADEMODEL_H
@@ -0,0 +1,326 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef FIXEDMLP_H
+#define FIXEDMLP_H
+
+#include <array>
+#include <utility>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <stdlib.h>
+using namespace std;
+
+// multilayer perceptron with a topology known at compile time, ex: fixedMlp<2, 5, 1> xor;
+// same computation and learning as multilayerPerceptron, weights are stored in std::array (no heap allocation):
+// the loops have constant bounds, the compiler unrolls and vectorizes them for each layer.
+// Large networks (ex: fixedMlp<4, 100, 100, 4>) should be static or allocated with new, not on the stack.
+template <int... nbNeurons>
+class fixedMlp
+{
+public:
+    static constexpr int nbLayers = sizeof...(nbNeurons);
+    static constexpr array<int, nbLayers> tabNbNeurons = {nbNeurons...};
+    static constexpr int nbInputs = tabNbNeurons[0];
+    static constexpr int nbOutputs = tabNbNeurons[nbLayers-1];
+    static_assert(nbLayers >= 2, "the neural network must contain at least 2 layers");
+
+    fixedMlp(const double eta = 0.5, const double alpha = 0.9) : m_alpha(alpha), m_eta(eta)
+    {
+        m_weights.fill(0);
+        m_deltaWeights.fill(0);
+        m_outputs.fill(0);
+        m_errors.fill(0);
+    }
+
+    void setEta(const double eta) { m_eta = eta; }
+    void setAlpha(const double alpha) { m_alpha = alpha; }
+
+    void setRandomWeights()                             // random weights in [-0.5; 0.5] as multilayerPerceptron::learning
+    {
+        for (int i=0; i < nbWeights; i++)
+        {
+            m_deltaWeights[i] = 0;
+            m_weights[i] = ((double) rand() / RAND_MAX) - 0.5;
+        }
+    }
+
+    void predict(const array<double, nbInputs> &tabInput, array<double, nbOutputs> &tabOutput)
+    {
+        for (int k=0; k < nbInputs; k++)
+            m_outputs[k] = tabInput[k];
+
+        computeLayers(make_index_sequence<nbLayers - 1>());
+
+        for (int k=0; k < nbOutputs; k++)
+            tabOutput[k] = m_outputs[neuronOffset(nbLayers-1) + k];
+    }
+
+    double train(const array<double, nbInputs> &tabInput, const array<double, nbOutputs> &tabOutputTarget)
+    {
+        // compute output
+        for (int k=0; k < nbInputs; k++)
+            m_outputs[k] = tabInput[k];
+        computeLayers(make_index_sequence<nbLayers - 1>());
+
+        double RmsError = 0;
+        constexpr int last = neuronOffset(nbLayers-1);
+        for (int k=0; k < nbOutputs; k++)
+        {
+            double output = m_outputs[last + k];
+            double target = tabOutputTarget[k];
+            m_errors[last + k] = (target - output) * output * (1.0 - output);
+            RmsError += pow((target - output), 2);
+        }
+        RmsError = sqrt(RmsError / (double) nbOutputs);
+
+        // error backpropagation then weights
+        backpropagateLayers(make_index_sequence<nbLayers - 2>());
+        updateLayers(make_index_sequence<nbLayers - 1>());
+        return RmsError;
+    }
+
+    bool loadState(const string fileUrl)                // load neural network state from multilayerPerceptron::saveState
+    {
+        ifstream file;
+        file.open(fileUrl.c_str(), ios::in | ios::binary);
+        if (!file.is_open())
+            return false;
+
+        int nbLayer = 0;
+        file.read((char *) &nbLayer, sizeof nbLayer);
+        bool sparse = nbLayer < 0;
+        if (sparse)
+            nbLayer = -nbLayer;
+
+        if (nbLayer != nbLayers)
+            return false;
+        for (int i=0; i < nbLayers; i++)
+        {
+            int nbNeuron = 0;
+            file.read((char *) &nbNeuron, sizeof nbNeuron);
+            if (nbNeuron != tabNbNeurons[i])
+                return false;
+        }
+
+        m_weights.fill(0);
+        m_deltaWeights.fill(0);
+        for (int i=1; i < nbLayers; i++)
+        {
+            int pruned = 0;
+            if (sparse)
+                file.read((char *) &pruned, sizeof pruned);
+
+            double *weight = &m_weights[weightOffset(i)];
+            if (pruned)
+            {
+                // csr layer: rowStart, column and value arrays
+                int nbWeight = 0;
+                file.read((char *) &nbWeight, sizeof nbWeight);
+                vector<int> rowStart(tabNbNeurons[i] + 1);
+                vector<int> column(nbWeight);
+                file.read((char *) &rowStart[0], sizeof(int) * rowStart.size());
+                if (nbWeight > 0)
+                    file.read((char *) &column[0], sizeof(int) * nbWeight);
+                for (int j=0; j < tabNbNeurons[i]; j++)
+                {
+                    for (int p=rowStart[j]; p < rowStart[j+1]; p++)
+                        file.read((char *) &weight[j * tabNbNeurons[i-1] + column[p]], sizeof(double));
+                }
+            }
+            else
+                file.read((char *) weight, sizeof(double) * tabNbNeurons[i] * tabNbNeurons[i-1]);
+        }
+
+        bool ret = !file.fail();
+        file.close();
+        return ret;
+    }
+
+    bool loadStateText(const string fileUrl)            // load neural network state from multilayerPerceptron::saveStateText
+    {
+        ifstream file;
+        file.open(fileUrl.c_str());
+        if (!file.is_open())
+            return false;
+
+        string word;
+        file >> word;
+        if (word !=  "[mlp_layers]")
+            return false;
+
+        int nbLayer = 0;
+        file >> nbLayer;
+        if (nbLayer != nbLayers)
+            return false;
+        for (int i=0; i < nbLayers; i++)
+        {
+            int nbNeuron = 0;
+            file >> nbNeuron;
+            if (nbNeuron != tabNbNeurons[i])
+                return false;
+        }
+
+        m_weights.fill(0);
+        m_deltaWeights.fill(0);
+        file >> word;
+        bool sparse = (word == "[mlp_sparse_weights]");
+        if (!sparse && word != "[mlp_weights]")
+            return false;
+
+        for (int i=1; i < nbLayers; i++)
+        {
+            double *weight = &m_weights[weightOffset(i)];
+            for (int j=0; j < tabNbNeurons[i]; j++)
+            {
+                if (!sparse)
+                {
+                    for (int k=0; k < tabNbNeurons[i-1]; k++)
+                        file >> weight[j * tabNbNeurons[i-1] + k];
+                    continue;
+                }
+
+                // sparse: number of weights followed by index:weight pairs
+                int nbWeight = 0;
+                file >> nbWeight;
+                for (int p=0; p < nbWeight; p++)
+                {
+                    int k = 0;
+                    char separator;
+                    double value = 0;
+                    file >> k >> separator >> value;
+                    if (k >= 0 && k < tabNbNeurons[i-1])
+                        weight[j * tabNbNeurons[i-1] + k] = value;
+                }
+            }
+        }
+
+        bool ret = !file.fail();
+        file.close();
+        return ret;
+    }
+
+private:
+    static constexpr int neuronOffset(const int i)      // index of the first neuron of layer i
+    {
+        int offset = 0;
+        for (int l=0; l < i; l++)
+            offset += tabNbNeurons[l];
+        return offset;
+    }
+
+    static constexpr int weightOffset(const int i)      // index of the first weight of layer i (weights of neuron j are contiguous)
+    {
+        int offset = 0;
+        for (int l=1; l < i; l++)
+            offset += tabNbNeurons[l] * tabNbNeurons[l-1];
+        return offset;
+    }
+
+    static constexpr int nbNeuronsTotal = neuronOffset(nbLayers);
+    static constexpr int nbWeights = weightOffset(nbLayers);
+
+    template <size_t... i>
+    void computeLayers(index_sequence<i...>) { (computeLayer<i + 1>(), ...); }
+
+    template <size_t... i>
+    void backpropagateLayers(index_sequence<i...>) { (backpropagateLayer<nbLayers - 2 - i>(), ...); }
+
+    template <size_t... i>
+    void updateLayers(index_sequence<i...>) { (updateLayer<i + 1>(), ...); }
+
+    template <int i>
+    void computeLayer()
+    {
+        constexpr int nbNeuron = tabNbNeurons[i];
+        constexpr int nbPrevious = tabNbNeurons[i-1];
+        const double *input = &m_outputs[neuronOffset(i-1)];
+        const double *weight = &m_weights[weightOffset(i)];
+        double *output = &m_outputs[neuronOffset(i)];
+
+        for (int j=0; j < nbNeuron; j++)
+        {
+            double sum = 0;
+            for (int k=0; k < nbPrevious; k++)
+                sum += input[k] * weight[j * nbPrevious + k];
+
+            // sigmoid function
+            output[j] = 1.0 / (1.0 + exp(-sum));
+        }
+    }
+
+    template <int i>
+    void backpropagateLayer()                           // error of hidden layer i from layer i+1
+    {
+        constexpr int nbNeuron = tabNbNeurons[i];
+        constexpr int nbNext = tabNbNeurons[i+1];
+        const double *output = &m_outputs[neuronOffset(i)];
+        const double *weight = &m_weights[weightOffset(i+1)];
+        const double *nextError = &m_errors[neuronOffset(i+1)];
+        double *error = &m_errors[neuronOffset(i)];
+
+        for (int j=0; j < nbNeuron; j++)
+        {
+            double sum = 0;
+            for (int k=0; k < nbNext; k++)
+                sum += weight[k * nbNeuron + j] * nextError[k];
+            error[j] = sum * output[j] * (1.0 - output[j]);
+        }
+    }
+
+    template <int i>
+    void updateLayer()
+    {
+        constexpr int nbNeuron = tabNbNeurons[i];
+        constexpr int nbPrevious = tabNbNeurons[i-1];
+        const double *input = &m_outputs[neuronOffset(i-1)];
+        const double *error = &m_errors[neuronOffset(i)];
+        double *weight = &m_weights[weightOffset(i)];
+        double *deltaWeight = &m_deltaWeights[weightOffset(i)];
+
+        for (int j=0; j < nbNeuron; j++)
+        {
+            for (int k=0; k < nbPrevious; k++)
+            {
+                double previousDelta = deltaWeight[j * nbPrevious + k];
+                deltaWeight[j * nbPrevious + k] = m_eta * (input[k] * error[j]);
+                weight[j * nbPrevious + k] += deltaWeight[j * nbPrevious + k] + (m_alpha * previousDelta);
+            }
+        }
+    }
+
+    double m_alpha;                                     // momentum factor [0,1]
+    double m_eta;                                       // learning rate factor [0,1]
+    array<double, nbWeights> m_weights;                 // weights, layer by layer, neuron by neuron
+    array<double, nbWeights> m_deltaWeights;            // last weight updates (momentum)
+    array<double, nbNeuronsTotal> m_outputs;            // outputs of all neurons, layer by layer
+    array<double, nbNeuronsTotal> m_errors;             // errors of all neurons, layer by layer
+};
+
+#endif // FIXEDMLP_H
@@ -0,0 +1,462 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "inferenceServer.h"
+#include <string.h>
+#include <signal.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+static const long LISTEN_ID = -1;                       // epoll data of the listening socket
+static const long WAKE_ID = -2;                         // epoll data of the eventfd
+static volatile sig_atomic_t g_signalStop = 0;
+
+static void signalStop(int)
+{
+    g_signalStop = 1;
+}
+
+inferenceServer::inferenceServer(const multilayerPerceptron &network, const serverConfig &config) : m_network(network)
+{
+    m_config = config;
+    m_config.nbThreads = max(1, m_config.nbThreads);
+    m_config.maxBatch = max(1, m_config.maxBatch);
+    m_config.maxWait = max(0, m_config.maxWait);
+    vector<int> tabNbNeurons = network.getTopology();
+    m_nbInput = tabNbNeurons[0];
+    m_nbOutput = tabNbNeurons[tabNbNeurons.size()-1];
+    m_stop = false;
+    m_listenFd = -1;
+    m_epollFd = -1;
+    m_wakeFd = -1;
+    m_nbQueuedSample = 0;
+}
+
+inferenceServer::~inferenceServer()
+{
+    stop();
+}
+
+void inferenceServer::stop()
+{
+    m_stop = true;
+    m_queueReady.notify_all();
+}
+
+#ifdef __linux__
+
+bool inferenceServer::run()
+{
+    if (m_config.socketPath.size() >= sizeof(((struct sockaddr_un *) 0)->sun_path))
+    {
+        cout << "error: socket path too long: " << m_config.socketPath << endl;
+        return false;
+    }
+
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, m_config.socketPath.c_str());
+    unlink(m_config.socketPath.c_str());
+    if (m_listenFd < 0 || bind(m_listenFd, (struct sockaddr *) &address, sizeof address) != 0 || listen(m_listenFd, SOMAXCONN) != 0)
+    {
+        cout << "error: can't listen on " << m_config.socketPath << ": " << strerror(errno) << endl;
+        if (m_listenFd >= 0)
+            close(m_listenFd);
+        return false;
+    }
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof event);
+    event.events = EPOLLIN;
+    event.data.u64 = (uint64_t) LISTEN_ID;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &event);
+    event.data.u64 = (uint64_t) WAKE_ID;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event);
+
+    g_signalStop = 0;
+    signal(SIGINT, signalStop);
+    signal(SIGTERM, signalStop);
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<thread> tabWorkers;
+    for (int w=0; w < m_config.nbThreads; w++)
+        tabWorkers.push_back(thread(&inferenceServer::worker, this));
+
+    cout << "serving " << m_nbInput << " inputs -> " << m_nbOutput << " outputs on " << m_config.socketPath << " ("
+         << m_config.nbThreads << " threads, batch " << m_config.maxBatch << ", max wait " << m_config.maxWait << " us)" << endl;
+
+    // the epoll loop owns the connections: workers only see requests and responses
+    map<long, connection> tabConnections;
+    long nextId = 0;
+    struct epoll_event tabEvents[64];
+    while (!m_stop && !g_signalStop)
+    {
+        int nbEvent = epoll_wait(m_epollFd, tabEvents, 64, 100);
+        for (int e=0; e < nbEvent; e++)
+        {
+            long id = (long) tabEvents[e].data.u64;
+            if (id == LISTEN_ID)
+            {
+                acceptConnections(tabConnections, nextId);
+                continue;
+            }
+            if (id == WAKE_ID)
+            {
+                uint64_t value;
+                if (read(m_wakeFd, &value, sizeof value) < 0 && errno != EAGAIN)
+                    break;
+                sendResponses(tabConnections);
+                continue;
+            }
+
+            map<long, connection>::iterator it = tabConnections.find(id);
+            if (it == tabConnections.end())
+                continue;
+            bool open = true;
+            if (tabEvents[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                open = readConnection(it->second);
+            if (open && (tabEvents[e].events & EPOLLOUT))
+                open = writeConnection(it->second);
+            if (!open)
+                closeConnection(tabConnections, id);
+        }
+    }
+
+    stop();
+    for (int w=0; w < tabWorkers.size(); w++)
+        tabWorkers[w].join();
+    while (!tabConnections.empty())
+        closeConnection(tabConnections, tabConnections.begin()->first);
+    close(m_wakeFd);
+    close(m_epollFd);
+    close(m_listenFd);
+    unlink(m_config.socketPath.c_str());
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    cout << "server stopped" << endl;
+    return true;
+}
+
+void inferenceServer::acceptConnections(map<long, connection> &tabConnections, long &nextId)
+{
+    while (true)
+    {
+        int fd = accept4(m_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        connection &current = tabConnections[nextId];
+        current.fd = fd;
+        current.id = nextId++;
+        current.outputOffset = 0;
+        current.writing = false;
+        current.nbRequest = 0;
+        current.nbResponse = 0;
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof event);
+        event.events = EPOLLIN;
+        event.data.u64 = (uint64_t) current.id;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void inferenceServer::closeConnection(map<long, connection> &tabConnections, const long id)
+{
+    // requests still queued are computed, their responses are dropped by sendResponses
+    close(tabConnections[id].fd);
+    tabConnections.erase(id);
+}
+
+bool inferenceServer::readConnection(connection &current)
+{
+    char buffer[65536];
+    while (true)
+    {
+        ssize_t size = recv(current.fd, buffer, sizeof buffer, 0);
+        if (size > 0)
+        {
+            current.input.insert(current.input.end(), buffer, buffer + size);
+            continue;
+        }
+        if (size == 0)
+            return false;
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return false;
+        break;
+    }
+    return parseRequests(current);
+}
+
+bool inferenceServer::parseRequests(connection &current)
+{
+    size_t offset = 0;
+    bool queued = false;
+    while (current.input.size() - offset >= sizeof(frameHeader))
+    {
+        frameHeader header;
+        memcpy(&header, &current.input[offset], sizeof header);
+        if (header.format != FRAME_DOUBLE && header.format != FRAME_FLOAT)
+            return false;                               // unknown payload size: the stream can't be resynchronized
+
+        size_t valueSize = (header.format == FRAME_FLOAT) ? sizeof(float) : sizeof(double);
+        unsigned long long nbByte = (unsigned long long) header.nbSample * header.nbValue * valueSize;
+        if (nbByte > FRAME_MAX_BYTES)
+            return false;
+        if (current.input.size() - offset - sizeof header < nbByte)
+            break;                                      // wait for the rest of the frame
+
+        const char *payload = &current.input[offset + sizeof header];
+        offset += sizeof header + nbByte;
+        long sequence = current.nbRequest++;
+
+        frameHeader answer = header;
+        if (header.nbSample == 0)
+        {
+            // model information
+            answer.nbValue = m_nbInput;
+            answer.status = m_nbOutput;
+            addResponse(current, sequence, buildResponse(answer, NULL));
+            continue;
+        }
+        if (header.nbValue != m_nbInput)
+        {
+            answer.nbSample = 0;
+            answer.nbValue = m_nbInput;
+            answer.status = -1;
+            addResponse(current, sequence, buildResponse(answer, NULL));
+            continue;
+        }
+
+        request pending;
+        pending.connectionId = current.id;
+        pending.sequence = sequence;
+        pending.nbSample = header.nbSample;
+        pending.format = header.format;
+        pending.tabInputs.resize((size_t) header.nbSample * header.nbValue);
+        if (header.format == FRAME_FLOAT)
+        {
+            const float *tabValues = (const float *) payload;
+            for (size_t i=0; i < pending.tabInputs.size(); i++)
+            {
+                float value;
+                memcpy(&value, &tabValues[i], sizeof value);
+                pending.tabInputs[i] = value;
+            }
+        }
+        else
+            memcpy(&pending.tabInputs[0], payload, nbByte);
+        pending.arrival = chrono::steady_clock::now();
+
+        lock_guard<mutex> lock(m_queueLock);
+        m_nbQueuedSample += pending.nbSample;
+        m_queue.push_back(pending);
+        queued = true;
+    }
+
+    current.input.erase(current.input.begin(), current.input.begin() + offset);
+    if (queued)
+        m_queueReady.notify_all();
+    return writeConnection(current);
+}
+
+void inferenceServer::worker()
+{
+    vector<request> tabBatch;
+    vector<double> tabInputs;
+    vector<double> tabOutputs;
+    while (true)
+    {
+        unique_lock<mutex> lock(m_queueLock);
+        m_queueReady.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_stop)
+            return;
+
+        // micro-batch: wait for more samples until the batch is full or the oldest request waited maxWait
+        chrono::steady_clock::time_point deadline = m_queue.front().arrival + chrono::microseconds(m_config.maxWait);
+        while (!m_stop && !m_queue.empty() && m_nbQueuedSample < m_config.maxBatch && chrono::steady_clock::now() < deadline)
+            m_queueReady.wait_until(lock, deadline);
+        if (m_stop)
+            return;
+        if (m_queue.empty())
+            continue;                                   // taken by another worker
+
+        tabBatch.clear();
+        long nbSample = 0;
+        while (!m_queue.empty() && (tabBatch.empty() || nbSample + m_queue.front().nbSample <= m_config.maxBatch))
+        {
+            nbSample += m_queue.front().nbSample;
+            tabBatch.push_back(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_nbQueuedSample -= nbSample;
+        lock.unlock();
+
+        tabInputs.resize(nbSample * m_nbInput);
+        tabOutputs.resize(nbSample * m_nbOutput);
+        size_t position = 0;
+        for (int r=0; r < tabBatch.size(); r++)
+        {
+            copy(tabBatch[r].tabInputs.begin(), tabBatch[r].tabInputs.end(), tabInputs.begin() + position);
+            position += tabBatch[r].tabInputs.size();
+        }
+        m_network.computeBatch(tabInputs.data(), tabOutputs.data(), nbSample);
+
+        vector<response> tabDone(tabBatch.size());
+        position = 0;
+        for (int r=0; r < tabBatch.size(); r++)
+        {
+            frameHeader header;
+            header.nbSample = tabBatch[r].nbSample;
+            header.nbValue = m_nbOutput;
+            header.format = tabBatch[r].format;
+            header.status = 0;
+            tabDone[r].connectionId = tabBatch[r].connectionId;
+            tabDone[r].sequence = tabBatch[r].sequence;
+            tabDone[r].data = buildResponse(header, &tabOutputs[position]);
+            position += (size_t) header.nbSample * m_nbOutput;
+        }
+
+        {
+            lock_guard<mutex> responseLock(m_responseLock);
+            for (int r=0; r < tabDone.size(); r++)
+                m_tabResponses.push_back(tabDone[r]);
+        }
+        uint64_t one = 1;
+        if (write(m_wakeFd, &one, sizeof one) < 0)
+            return;
+    }
+}
+
+vector<char> inferenceServer::buildResponse(const frameHeader &header, const double *tabOutputs)
+{
+    size_t nbValue = (size_t) header.nbSample * header.nbValue;
+    size_t valueSize = (header.format == FRAME_FLOAT) ? sizeof(float) : sizeof(double);
+    vector<char> data(sizeof header + nbValue * valueSize);
+    memcpy(&data[0], &header, sizeof header);
+    if (header.format == FRAME_FLOAT)
+    {
+        for (size_t i=0; i < nbValue; i++)
+        {
+            float value = (float) tabOutputs[i];
+            memcpy(&data[sizeof header + i * sizeof value], &value, sizeof value);
+        }
+    }
+    else if (nbValue > 0)
+        memcpy(&data[sizeof header], tabOutputs, nbValue * sizeof(double));
+    return data;
+}
+
+void inferenceServer::sendResponses(map<long, connection> &tabConnections)
+{
+    vector<response> tabReady;
+    {
+        lock_guard<mutex> lock(m_responseLock);
+        tabReady.swap(m_tabResponses);
+    }
+
+    for (int r=0; r < tabReady.size(); r++)
+    {
+        map<long, connection>::iterator it = tabConnections.find(tabReady[r].connectionId);
+        if (it == tabConnections.end())
+            continue;                                   // connection closed meanwhile
+        addResponse(it->second, tabReady[r].sequence, tabReady[r].data);
+        if (!writeConnection(it->second))
+            closeConnection(tabConnections, tabReady[r].connectionId);
+    }
+}
+
+void inferenceServer::addResponse(connection &current, const long sequence, const vector<char> &data)
+{
+    current.tabPending[sequence] = data;
+    map< long, vector<char> >::iterator it;
+    while ((it = current.tabPending.find(current.nbResponse)) != current.tabPending.end())
+    {
+        current.output.insert(current.output.end(), it->second.begin(), it->second.end());
+        current.tabPending.erase(it);
+        current.nbResponse++;
+    }
+}
+
+bool inferenceServer::writeConnection(connection &current)
+{
+    while (current.outputOffset < current.output.size())
+    {
+        ssize_t size = send(current.fd, &current.output[current.outputOffset], current.output.size() - current.outputOffset, MSG_NOSIGNAL);
+        if (size > 0)
+        {
+            current.outputOffset += size;
+            continue;
+        }
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return false;
+    }
+
+    bool writing = current.outputOffset < current.output.size();
+    if (!writing)
+    {
+        current.output.clear();
+        current.outputOffset = 0;
+    }
+
+    // EPOLLOUT only while bytes are waiting
+    if (writing != current.writing)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof event);
+        event.events = writing ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.u64 = (uint64_t) current.id;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, current.fd, &event);
+        current.writing = writing;
+    }
+    return true;
+}
+
+#else
+
+bool inferenceServer::run()
+{
+    cout << "error: serve is only available on Linux" << endl;
+    return false;
+}
+
+#endif
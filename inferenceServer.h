@@ -0,0 +1,142 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef INFERENCESERVER_H
+#define INFERENCESERVER_H
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include "multilayerPerceptron.h"
+using namespace std;
+
+// framed binary protocol (host byte order): a header followed by nbSample x nbValue values.
+// request: nbValue = number of inputs, response: nbValue = number of outputs, same format as the request.
+// The responses of a connection are sent in the order of its requests (requests can be pipelined).
+// A request with nbSample = 0 returns the number of inputs (nbValue) and outputs (status) of the model.
+// An unknown format or a frame larger than FRAME_MAX_BYTES closes the connection.
+enum frameFormat
+{
+    FRAME_DOUBLE = 0,
+    FRAME_FLOAT = 1
+};
+
+struct frameHeader
+{
+    uint32_t nbSample;
+    uint32_t nbValue;
+    uint32_t format;                                    // frameFormat
+    int32_t status;                                     // response: 0 ok, -1 wrong number of inputs (nbValue: expected)
+};
+
+static const uint32_t FRAME_MAX_BYTES = 64 << 20;       // larger requests close the connection
+
+struct serverConfig
+{
+    string socketPath;
+    int nbThreads;                                      // inference workers
+    int maxBatch;                                       // samples computed together
+    int maxWait;                                        // microseconds a request waits for others to fill a batch
+};
+
+// Unix domain socket server: one epoll thread reads and writes all the connections, complete requests are
+// coalesced into micro-batches computed by a pool of workers (computeBatch is const: each worker has its own
+// activation arena). Linux only.
+class inferenceServer
+{
+public:
+    inferenceServer(const multilayerPerceptron &network, const serverConfig &config);
+    ~inferenceServer();
+    bool run();                                         // serve until stop() or SIGINT / SIGTERM
+    void stop();
+
+private:
+    struct request
+    {
+        long connectionId;
+        long sequence;                                  // rank of the request in its connection
+        uint32_t nbSample;
+        uint32_t format;
+        vector<double> tabInputs;                       // nbSample x nbInputs
+        chrono::steady_clock::time_point arrival;
+    };
+
+    struct response
+    {
+        long connectionId;
+        long sequence;
+        vector<char> data;                              // header and outputs
+    };
+
+    struct connection
+    {
+        int fd;
+        long id;
+        vector<char> input;                             // bytes received, not yet parsed
+        vector<char> output;                            // bytes to send
+        size_t outputOffset;
+        bool writing;                                   // waiting for EPOLLOUT
+        long nbRequest;                                 // sequence of the next request
+        long nbResponse;                                // sequence of the next response to send
+        map< long, vector<char> > tabPending;           // responses computed before the previous ones
+    };
+
+    const multilayerPerceptron &m_network;
+    serverConfig m_config;
+    int m_nbInput;
+    int m_nbOutput;
+    atomic<bool> m_stop;
+    int m_listenFd;
+    int m_epollFd;
+    int m_wakeFd;                                       // eventfd: responses are ready
+
+    mutex m_queueLock;                                  // guards m_queue and m_nbQueuedSample
+    condition_variable m_queueReady;
+    deque<request> m_queue;
+    long m_nbQueuedSample;
+
+    mutex m_responseLock;
+    vector<response> m_tabResponses;                    // computed, not yet given to the epoll thread
+
+    void worker();
+    void acceptConnections(map<long, connection> &tabConnections, long &nextId);
+    bool readConnection(connection &current);           // false: close the connection
+    bool parseRequests(connection &current);
+    void addResponse(connection &current, const long sequence, const vector<char> &data);  // in order of the requests
+    bool writeConnection(connection &current);          // false: close the connection
+    void sendResponses(map<long, connection> &tabConnections);
+    void closeConnection(map<long, connection> &tabConnections, const long id);
+    static vector<char> buildResponse(const frameHeader &header, const double *tabOutputs);
+};
+
+#endif // INFERENCESERVER_H
@@ -0,0 +1,225 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+// Load generator of the inference server (mimetik serve): latency and throughput
+// usage: loadgen -socket path [-connections N] [-requests N] [-samples N] [-float]
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "inferenceServer.h"
+
+using namespace std;
+
+struct loadConfig
+{
+    string socketPath;
+    int nbConnection;               // one thread per connection
+    int nbRequest;                  // requests per connection
+    int nbSample;                   // samples per request
+    uint32_t format;                // frameFormat
+};
+
+static int connectServer(const string socketPath)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &address, sizeof address) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool sendAll(const int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool receiveAll(const int fd, char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t received = recv(fd, data, size, 0);
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+// one request, wait for its response
+static bool exchange(const int fd, const frameHeader &header, const vector<char> &payload, frameHeader &answer, vector<char> &result)
+{
+    if (!sendAll(fd, (const char *) &header, sizeof header) || (!payload.empty() && !sendAll(fd, &payload[0], payload.size())))
+        return false;
+    if (!receiveAll(fd, (char *) &answer, sizeof answer))
+        return false;
+    size_t valueSize = (answer.format == FRAME_FLOAT) ? sizeof(float) : sizeof(double);
+    result.resize((size_t) answer.nbSample * answer.nbValue * valueSize);
+    return result.empty() || receiveAll(fd, &result[0], result.size());
+}
+
+static void runConnection(const loadConfig &config, const int nbInput, vector<double> &tabLatencies, long &nbError)
+{
+    int fd = connectServer(config.socketPath);
+    if (fd < 0)
+    {
+        nbError += config.nbRequest;
+        return;
+    }
+
+    frameHeader header;
+    header.nbSample = config.nbSample;
+    header.nbValue = nbInput;
+    header.format = config.format;
+    header.status = 0;
+    size_t valueSize = (config.format == FRAME_FLOAT) ? sizeof(float) : sizeof(double);
+    vector<char> payload((size_t) config.nbSample * nbInput * valueSize);
+    for (size_t i=0; i < (size_t) config.nbSample * nbInput; i++)
+    {
+        double value = (double) rand() / RAND_MAX;
+        float single = (float) value;
+        memcpy(&payload[i * valueSize], config.format == FRAME_FLOAT ? (const void *) &single : (const void *) &value, valueSize);
+    }
+
+    frameHeader answer;
+    vector<char> result;
+    for (int r=0; r < config.nbRequest; r++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (!exchange(fd, header, payload, answer, result) || answer.status != 0 || answer.nbSample != config.nbSample)
+        {
+            nbError++;
+            continue;
+        }
+        tabLatencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+    }
+    close(fd);
+}
+
+static double percentile(const vector<double> &tabSorted, const double p)
+{
+    if (tabSorted.empty())
+        return 0;
+    return tabSorted[min(tabSorted.size() - 1, (size_t) (p * tabSorted.size()))];
+}
+
+int main(int argc, char *argv[])
+{
+    loadConfig config;
+    config.nbConnection = 4;
+    config.nbRequest = 1000;
+    config.nbSample = 1;
+    config.format = FRAME_DOUBLE;
+
+    for (int i=1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-socket" && i + 1 < argc)
+            config.socketPath = argv[++i];
+        else if (arg == "-connections" && i + 1 < argc)
+            config.nbConnection = max(1, atoi(argv[++i]));
+        else if (arg == "-requests" && i + 1 < argc)
+            config.nbRequest = max(1, atoi(argv[++i]));
+        else if (arg == "-samples" && i + 1 < argc)
+            config.nbSample = max(1, atoi(argv[++i]));
+        else if (arg == "-float")
+            config.format = FRAME_FLOAT;
+        else
+            config.socketPath = "";
+    }
+    if (config.socketPath == "")
+    {
+        cout << "usage: loadgen -socket path [-connections N] [-requests N] [-samples N] [-float]" << endl;
+        return 1;
+    }
+
+    // model information: request without samples
+    int fd = connectServer(config.socketPath);
+    frameHeader header;
+    memset(&header, 0, sizeof header);
+    header.format = config.format;
+    frameHeader answer;
+    vector<char> result;
+    if (fd < 0 || !exchange(fd, header, vector<char>(), answer, result))
+    {
+        cout << "error: can't reach the server on " << config.socketPath << endl;
+        return 1;
+    }
+    close(fd);
+    int nbInput = answer.nbValue;
+    cout << "model: " << nbInput << " inputs, " << answer.status << " outputs" << endl;
+
+    vector< vector<double> > tabLatencies(config.nbConnection);
+    vector<long> tabErrors(config.nbConnection, 0);
+    vector<thread> tabThreads;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int c=0; c < config.nbConnection; c++)
+        tabThreads.push_back(thread(runConnection, cref(config), nbInput, ref(tabLatencies[c]), ref(tabErrors[c])));
+    for (int c=0; c < tabThreads.size(); c++)
+        tabThreads[c].join();
+    double duration = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> tabAll;
+    long nbError = 0;
+    for (int c=0; c < config.nbConnection; c++)
+    {
+        tabAll.insert(tabAll.end(), tabLatencies[c].begin(), tabLatencies[c].end());
+        nbError += tabErrors[c];
+    }
+    sort(tabAll.begin(), tabAll.end());
+
+    printf("%d connections x %d requests x %d samples (%s): %ld ok, %ld errors in %.3f s\n", config.nbConnection, config.nbRequest,
+           config.nbSample, config.format == FRAME_FLOAT ? "float" : "double", (long) tabAll.size(), nbError, duration);
+    printf("throughput: %.0f requests/s, %.0f samples/s\n", tabAll.size() / duration, (double) tabAll.size() * config.nbSample / duration);
+    printf("latency (us): p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", percentile(tabAll, 0.5), percentile(tabAll, 0.9),
+           percentile(tabAll, 0.99), tabAll.empty() ? 0 : tabAll[tabAll.size() - 1]);
+    return nbError == 0 ? 0 : 1;
+}
@@ -27,13 +27,118 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <stdlib.h>
 #include "mimetik.h"
 #include "multilayerPerceptron.h"
+#include "inferenceServer.h"
 
 using namespace std;
 
+// mimetik serve model.bin --socket path [--threads N] [--max-batch N] [--max-wait us]
+static int serve(int argc, char *argv[])
+{
+    serverConfig config;
+    config.nbThreads = max(1, (int) thread::hardware_concurrency());
+    config.maxBatch = 64;
+    config.maxWait = 200;
+
+    string model;
+    for (int i=2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc)
+            config.socketPath = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc)
+            config.nbThreads = atoi(argv[++i]);
+        else if (arg == "--max-batch" && i + 1 < argc)
+            config.maxBatch = atoi(argv[++i]);
+        else if (arg == "--max-wait" && i + 1 < argc)
+            config.maxWait = atoi(argv[++i]);
+        else if (model == "" && arg[0] != '-')
+            model = arg;
+        else
+            model = "";
+    }
+
+    if (model == "" || config.socketPath == "")
+    {
+        cout << "usage: mimetik serve model.bin --socket path [--threads N] [--max-batch N] [--max-wait us]" << endl;
+        return 1;
+    }
+
+    // the model is loaded once, the topology comes from the file
+    vector<int> tabNbNeurons(2, 1);
+    multilayerPerceptron network(tabNbNeurons);
+    if (!network.loadState(model))
+    {
+        cout << "error: can't load model " << model << endl;
+        return 1;
+    }
+
+    inferenceServer server(network, config);
+    return server.run() ? 0 : 1;
+}
+
+// mimetik --batch [--format csv|json|binary] [--model model.bin] [script.mimetik] [--stdin]
+// no banner and no message (except errors on stderr), compute results on stdout, input rows read from stdin
+static int batch(int argc, char *argv[])
+{
+    outputFormat format = OUTPUT_CSV;
+    string model;
+    string script;
+    bool rows = false;
+    for (int i=1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--batch" || arg == "--quiet")
+            continue;
+        else if (arg == "--format" && i + 1 < argc)
+        {
+            string name = argv[++i];
+            if (name != "csv" && name != "json" && name != "binary")
+            {
+                cerr << "unknown format: " << name << " (csv, json or binary)" << endl;
+                return 1;
+            }
+            format = (name == "json") ? OUTPUT_JSON : (name == "binary") ? OUTPUT_BINARY : OUTPUT_CSV;
+        }
+        else if (arg == "--model" && i + 1 < argc)
+            model = argv[++i];
+        else if (arg == "--stdin")
+            rows = true;
+        else if (script == "" && arg[0] != '-')
+            script = arg;
+        else
+        {
+            cerr << "usage: mimetik --batch [--format csv|json|binary] [--model model.bin] [script.mimetik] [--stdin]" << endl;
+            return 1;
+        }
+    }
+
+    // rows from stdin: without script or with --stdin
+    ios::sync_with_stdio(false);
+    mimetik mk;
+    mk.setQuiet(format);
+    if (model != "" && !mk.executeCommandLine("loadState default " + model))
+    {
+        cerr << "error: can't load model " << model << endl;
+        return 1;
+    }
+    if (script != "" && !mk.executeScript(script))
+        return 1;
+    if ((script == "" || rows) && !mk.computeStream(cin))
+        return 1;
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && string(argv[1]) == "serve")
+        return serve(argc, argv);
+    for (int i=1; i < argc; i++)
+        if (string(argv[i]) == "--batch" || string(argv[i]) == "--quiet")
+            return batch(argc, argv);
+
     cout << " __  __ _                _   _ _    "      << endl;
     cout << "|  \\/  (_)              | | (_) |   "     << endl;
     cout << "| \\  / |_ _ __ ___   ___| |_ _| | __"     << endl;
@@ -28,6 +28,45 @@
 #include <fstream>
 #include <string>
 #include <cstdlib>
+#include <cctype>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <stdio.h>
+#include <stdlib.h>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+
+static const int SCRIPT_BATCH_SIZE = 4096;             // max compute commands of a script (or stdin rows) computed in one batch
+static const size_t SCRIPT_BATCH_BYTES = 32 << 20;      // max bytes of inputs and outputs of one batch (wide rows: fewer rows)
+static const size_t RESULT_BUFFER_SIZE = 1 << 20;       // bytes of results written at once in quiet mode
+
+// rows computed in one batch: SCRIPT_BATCH_SIZE, fewer when the rows are too wide for SCRIPT_BATCH_BYTES
+static int batchRows(const int nbInput, const int nbOutput)
+{
+    size_t rowBytes = (size_t) (nbInput + nbOutput) * sizeof(double);
+    return (int) max((size_t) 1, min((size_t) SCRIPT_BATCH_SIZE, SCRIPT_BATCH_BYTES / rowBytes));
+}
+
+// the whole argument must be a number (atoi and atof read "abc" as 0)
+static bool parseInt(const string &text, int &value)
+{
+    char *end = NULL;
+    long number = strtol(text.c_str(), &end, 10);
+    if (end == text.c_str() || *end != '\0' || number < INT_MIN || number > INT_MAX)
+        return false;
+    value = (int) number;
+    return true;
+}
+
+static bool parseDouble(const string &text, double &value)
+{
+    char *end = NULL;
+    value = strtod(text.c_str(), &end);
+    return end != text.c_str() && *end == '\0';
+}
 
 mimetik::mimetik()
 {  
@@ -36,80 +75,159 @@ mimetik::mimetik()
     tabNbLayers[0] = 1;
     tabNbLayers[1] = 10;
     tabNbLayers[2] = 1;
-    m_mlp = new multilayerPerceptron(tabNbLayers);
+    m_profiling = false;
+    m_snapshotRate = 10;
+    m_quiet = false;
+    m_outputFormat = OUTPUT_CSV;
+    m_coutBuffer = NULL;
+    m_mlp = NULL;
+    m_model = NULL;
+    useModel(createModel("default", new multilayerPerceptron(tabNbLayers)));
 }
 
 mimetik::~mimetik()
 {
-    delete m_mlp;
+    flushResults();
+    if (m_coutBuffer)
+        cout.rdbuf(m_coutBuffer);
+
+    // exit or end of script: the jobs are cancelled
+    for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+        cancelJob(it->second);
+    for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+        if (it->second->job)
+            waitJob(it->second->job.get());
+    for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+    {
+        delete it->second->mlp;
+        delete it->second->perceptron;
+        delete it->second;
+    }
 }
 
-bool mimetik::executeCommandLine(string cmd)
+// command name -> handler, allowed while a learning job runs on the current model (commands on a snapshot or on the jobs)
+const map<string, commandEntry> &mimetik::commandTable()
 {
-    // split cmd
-    m_tabCmd.clear();
+    static const map<string, commandEntry> tabCommands = {
+        {"help", {&mimetik::doHelp, true}},
+        {"network", {&mimetik::doNetwork, false}},
+        {"loadTrainingSet", {&mimetik::doLoadTrainingSet, false}},
+        {"saveTrainingSet", {&mimetik::doSaveTrainingSet, false}},
+        {"setEta", {&mimetik::doSetEta, false}},
+        {"setAlpha", {&mimetik::doSetAlpha, false}},
+        {"learning", {&mimetik::doLearning, false}},
+        {"compute", {&mimetik::doCompute, true}},
+        {"computeFile", {&mimetik::doComputeFile, true}},
+        {"saveState", {&mimetik::doSaveState, false}},
+        {"saveStateText", {&mimetik::doSaveStateText, false}},
+        {"loadState", {&mimetik::doLoadState, false}},
+        {"loadStateText", {&mimetik::doLoadStateText, false}},
+        {"prune", {&mimetik::doPrune, false}},
+        {"distill", {&mimetik::doDistill, false}},
+        {"exportCpp", {&mimetik::doExportCpp, false}},
+        {"stats", {&mimetik::doStats, false}},
+        {"profile", {&mimetik::doProfile, false}},
+        {"jobs", {&mimetik::doJobs, true}},
+        {"wait", {&mimetik::doWait, true}},
+        {"progress", {&mimetik::doProgress, true}},
+        {"cancel", {&mimetik::doCancel, true}},
+        {"setSnapshotRate", {&mimetik::doSetSnapshotRate, true}},
+        {"use", {&mimetik::doUse, true}},
+        {"models", {&mimetik::doModels, true}},
+        {"drop", {&mimetik::doDrop, true}},
+        {"cache", {&mimetik::doCache, true}},
+        {"threads", {&mimetik::doThreads, true}},
+        {"perceptron", {&mimetik::doPerceptron, true}},
+        {"perceptronLearning", {&mimetik::doPerceptronLearning, true}},
+        {"perceptronCompute", {&mimetik::doPerceptronCompute, true}},
+        {"perceptronComputeFile", {&mimetik::doPerceptronComputeFile, true}},
+        {"perceptronSave", {&mimetik::doPerceptronSave, true}},
+        {"perceptronLoad", {&mimetik::doPerceptronLoad, true}},
+        {"pipeline", {&mimetik::doPipeline, false}},
+        {"precision", {&mimetik::doPrecision, false}},
+        {"accumulation", {&mimetik::doAccumulation, false}},
+        {"partialFit", {&mimetik::doPartialFit, false}},
+        {"cascade", {&mimetik::doCascade, true}},
+        {"calibrate", {&mimetik::doCalibrate, true}},
+        {"execute", {&mimetik::doExecute, true}}
+    };
+    return tabCommands;
+}
+
+void mimetik::splitCommand(const string &cmd, vector<string> &tabArgs)
+{
+    tabArgs.clear();
     size_t pos = 0;
-    string delimiter = " ";
-    string token;
-    while ((pos = cmd.find(delimiter)) != string::npos)
+    while (pos < cmd.size())
     {
-        token = cmd.substr(0, pos);
-        if (token != "")
-            m_tabCmd.push_back(token);
-        cmd.erase(0, pos + delimiter.length());
+        size_t end = cmd.find(' ', pos);
+        if (end == string::npos)
+            end = cmd.size();
+        if (end > pos)
+            tabArgs.push_back(cmd.substr(pos, end - pos));
+        pos = end + 1;
     }
-    if (cmd != "")
-        m_tabCmd.push_back(cmd); // add last token
+}
 
+bool mimetik::executeCommandLine(string cmd)
+{
+    splitCommand(cmd, m_tabCmd);
     if (m_tabCmd.size() < 1)
         return false;
 
-    // command line interpreter
-    bool ret = false;
-    if (m_tabCmd[0] == "help")
-        doHelp();
-    else if (m_tabCmd[0] == "network")
-        ret = doNetwork();
-    else if (m_tabCmd[0] == "loadTrainingSet")
-        ret = doLoadTrainingSet();
-    else if (m_tabCmd[0] == "setEta")
-        ret = doSetEta();
-    else if (m_tabCmd[0] == "setAlpha")
-        ret = doSetAlpha();
-    else if (m_tabCmd[0] == "learning")
-        ret = doLearning();
-    else if (m_tabCmd[0] == "compute")
-        ret = doCompute();
-    else if (m_tabCmd[0] == "computeFile")
-        ret = doComputeFile();
-    else if (m_tabCmd[0] == "saveState")
-        ret = doSaveState();
-    else if (m_tabCmd[0] == "saveStateText")
-        ret = doSaveStateText();
-    else if (m_tabCmd[0] == "loadState")
-        ret = doLoadState();
-    else if (m_tabCmd[0] == "loadStateText")
-        ret = doLoadStateText();
-    else if (m_tabCmd[0] == "execute")
-        ret = doExecute();
-    else
+    map<string, commandEntry>::const_iterator it = commandTable().find(m_tabCmd[0]);
+    return runCommand(it == commandTable().end() ? NULL : &it->second);
+}
+
+bool mimetik::runCommand(const commandEntry *command)
+{
+    // a background learning job owns the network of its model: meanwhile, only the commands allowed during a job run
+    // on this model (compute on a snapshot), the commands naming another model check that model
+    for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+        joinJob(it->second, false);
+
+    if (!command)
     {
-        cout << "unknown command: " << m_tabCmd[0] <<  endl;
+        (m_quiet ? cerr : cout) << "unknown command: " << m_tabCmd[0] <<  endl;
         return false;
     }
+
+    bool namedModel = (m_tabCmd[0] == "network" && m_tabCmd.size() > 1 && !isdigit(m_tabCmd[1][0]))
+            || (m_tabCmd[0] == "loadState" && m_tabCmd.size() > 2);
+    bool ret = (namedModel || command->duringJob || !isBusy(m_model, m_tabCmd[0])) && (this->*(command->handler))();
+
+    // quiet: the messages of a command are only displayed (stderr) when it fails
+    if (m_quiet)
+    {
+        if (!ret)
+        {
+            flushResults();
+            cerr << m_messages.str();
+        }
+        m_messages.str("");
+    }
     return ret;
 }
 
 bool mimetik::doNetwork()
 {
-    if (m_tabCmd.size() < 3)
+    // network name nbLayer1 nbLayer2 ...: create or replace the model name and use it
+    int first = 1;
+    string name = m_model->name;
+    if (m_tabCmd.size() > 1 && !isdigit(m_tabCmd[1][0]))
+    {
+        name = m_tabCmd[1];
+        first = 2;
+    }
+
+    if (m_tabCmd.size() < first + 2)
     {
-        cout << "a network must contain at least 2 layers (ex: network 1 10 1)" << endl;
+        cout << "a network must contain at least 2 layers (ex: network 1 10 1, network name 1 10 1)" << endl;
         return false;
     }
 
     vector<int> tabNbLayers;
-    for (int i = 1; i < m_tabCmd.size(); i++)
+    for (int i = first; i < m_tabCmd.size(); i++)
     {
        int nblayer = atoi( m_tabCmd[i].c_str());
        if (nblayer < 1)
@@ -120,8 +238,17 @@ bool mimetik::doNetwork()
        tabNbLayers.push_back(nblayer);
     }
 
-    delete m_mlp;
-    m_mlp = new multilayerPerceptron(tabNbLayers);
+    modelSlot *model = findModel(name, false);
+    if (model && isBusy(model, "network"))
+        return false;
+
+    if (model)
+        setNetwork(model, new multilayerPerceptron(tabNbLayers));
+    else
+        model = createModel(name, new multilayerPerceptron(tabNbLayers));
+    useModel(model);
+    if (first == 2)
+        cout << "model " << name << ": ";
     cout << "new multilayer perceptron: ";
     for (int i = 0; i < tabNbLayers.size(); i++)
         cout << tabNbLayers[i] << " ";
@@ -138,9 +265,30 @@ bool mimetik::doLoadTrainingSet()
     }
 
     string fileName = m_tabCmd[1];
+    long nbHit = trainingSetCache::instance().getStats().nbHit;
     bool ret = m_mlp->loadTrainingSetFile(fileName);
     if (ret)
-        cout << "training set file: " << fileName << " loaded" << endl;
+    {
+        m_model->trainingSetFile = fileName;
+        bool cached = trainingSetCache::instance().getStats().nbHit > nbHit;
+        cout << "training set file: " << fileName << (cached ? " loaded (cached)" : " loaded") << endl;
+    }
+
+    return ret;
+}
+
+bool mimetik::doSaveTrainingSet()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: saveTrainingSet trainingset.bin" << endl;
+        return false;
+    }
+
+    string fileName = m_tabCmd[1];
+    bool ret = m_mlp->saveTrainingSetFile(fileName);
+    if (ret)
+        cout << "training set saved in binary file: " << fileName << endl;
 
     return ret;
 }
@@ -178,11 +326,26 @@ bool mimetik::doSetAlpha()
 bool mimetik::doLearning()
 {
     bool ret = false;
+
+    // "learning ... &": learn in background
+    bool background = false;
+    if (m_tabCmd.size() > 1 && m_tabCmd[m_tabCmd.size()-1] == "&")
+    {
+        background = true;
+        m_tabCmd.pop_back();
+    }
+    else if (m_tabCmd.size() > 1 && m_tabCmd[m_tabCmd.size()-1].back() == '&')
+    {
+        background = true;
+        m_tabCmd[m_tabCmd.size()-1].pop_back();
+    }
+
     if (m_tabCmd.size() < 2)
     {
-        cout << "usage: learning limit verbose(booleen) random(booleen)" << endl;
+        cout << "usage: learning limit verbose(booleen) random(booleen) [&]" << endl;
         cout << "example: learning 5000" << endl;
         cout << "example: learning 5000 true false" << endl;
+        cout << "example: learning 5000 &" << endl;
         return false;
     }
 
@@ -193,28 +356,46 @@ bool mimetik::doLearning()
         return false;
     }
 
-    cout << "start learning..." << endl;
-    if (m_tabCmd.size() ==  2)
-        ret = m_mlp->learning(limit);
-    else if (m_tabCmd.size() == 3)
-    {
-        bool verbose = true;
-        if (m_tabCmd[2] == "false")
-            verbose = false;
-        ret = m_mlp->learning(limit, verbose);
-    }
-    else if (m_tabCmd.size() > 3)
+    bool verbose = false;
+    if (m_tabCmd.size() > 2)
+        verbose = (m_tabCmd[2] != "false");
+    bool random = false;
+    if (m_tabCmd.size() > 3)
+        random = (m_tabCmd[3] == "true");
+
+    if (background)
     {
-        bool verbose = true;
-        if (m_tabCmd[2] == "false")
-            verbose = false;
+        shared_ptr<learningJob> job = make_shared<learningJob>();
+        job->mlp = m_mlp;
+        job->state = JOB_QUEUED;
+        job->result = false;
+        job->command = "learning";
+        for (int i = 1; i < m_tabCmd.size(); i++)
+            job->command += " " + m_tabCmd[i];
+        job->limit = limit;
+        job->firstEpoch = m_mlp->getStats().nbEpoch;
+        job->stats = m_mlp->getStats();
+        m_mlp->setLearningCallback(jobProgress, job.get());
+        m_mlp->setSnapshotRate(m_snapshotRate);
+        m_mlp->setProfiler(NULL);               // the counters measure the thread that opened them
+        m_model->job = job;
 
-        bool ramdom = false;
-        if (m_tabCmd[3] == "true")
-            verbose = true;
-        ret = m_mlp->learning(limit, verbose, ramdom);
+        // queued until a thread of the pool is free (cancelled before: the network is not used)
+        threadPool::instance().submit([job, limit, verbose, random]() {
+            int state = JOB_QUEUED;
+            if (job->state.compare_exchange_strong(state, JOB_RUNNING))
+                job->result = job->mlp->learning(limit, verbose, random);
+            lock_guard<mutex> lock(job->jobMutex);
+            job->state = JOB_DONE;
+            job->done.notify_all();
+        });
+        cout << "learning job started: [" << m_model->name << "] " << job->command << endl;
+        return true;
     }
 
+    cout << "start learning..." << endl;
+    ret = m_mlp->learning(limit, verbose, random);
+
     if (ret)
         cout << "learning ok" << endl;
     return ret;
@@ -229,24 +410,39 @@ bool mimetik::doCompute()
         return false;
     }
 
-    vector<double> tabInputs;
+    m_tabInputs.resize(m_tabCmd.size() - 1);
     for (int i = 1; i < m_tabCmd.size(); i++)
+       m_tabInputs[i-1] = atof( m_tabCmd[i].c_str());
+    if (!m_quiet)
     {
-       double input = atof( m_tabCmd[i].c_str());
-       tabInputs.push_back(input);
+        cout << "inputs: ";
+        for (int i = 0; i < m_tabInputs.size(); i++)
+            cout << m_tabInputs[i] << " ";
+        cout << endl;
     }
-    cout << "inputs: ";
-    for (int i = 0; i < tabInputs.size(); i++)
-        cout << tabInputs[i] << " ";
-    cout << endl;
 
-    vector<double> tabOutputs;
-    bool ret = m_mlp->computeOutput(tabInputs, tabOutputs);
-    if (ret)
+    shared_ptr<multilayerPerceptron> snapshot;
+    multilayerPerceptron *mlp = computeNetwork(snapshot);
+    if (!mlp)
+        return false;
+
+    bool ret = false;
+    if (m_model->cascadeFast == "")
+        ret = mlp->computeOutput(m_tabInputs, m_tabOutputs);
+    else if (m_tabInputs.size() != mlp->getTopology()[0])
+        cout << "Error: the number of inputs data does not match" << endl;
+    else
+    {
+        m_tabOutputs.resize(mlp->getTopology().back());
+        ret = computeRows(mlp, m_tabInputs.data(), m_tabOutputs.data(), 1);
+    }
+    if (ret && m_quiet)
+        writeResults(m_tabOutputs.data(), 1, m_tabOutputs.size());
+    else if (ret)
     {
         cout << "outputs: ";
-        for (int i = 0; i < tabOutputs.size(); i++)
-            cout << tabOutputs[i] << " ";
+        for (int i = 0; i < m_tabOutputs.size(); i++)
+            cout << m_tabOutputs[i] << " ";
         cout << endl;
     }
     return ret;
@@ -263,15 +459,20 @@ bool mimetik::doComputeFile()
         return false;
     }
 
+    shared_ptr<multilayerPerceptron> snapshot;
+    multilayerPerceptron *mlp = computeNetwork(snapshot);
+    if (!mlp)
+        return false;
+
     string fileIn =  m_tabCmd[1];
     if (m_tabCmd.size() ==  2)
     {
-        ret = m_mlp->computeFile(fileIn);
+        ret = mlp->computeFile(fileIn);
     }
     else if (m_tabCmd.size() > 2)
     {
         string fileOut =  m_tabCmd[2];
-        ret = m_mlp->computeFile(fileIn, fileOut);
+        ret = mlp->computeFile(fileIn, fileOut);
     }
 
     if (ret)
@@ -322,12 +523,36 @@ bool mimetik::doLoadState()
     if (m_tabCmd.size() < 2)
     {
         cout << "usage: loadState filename" << endl;
+        cout << "usage: loadState name filename (model name, created if needed)" << endl;
         return false;
     }
 
     string filename =  m_tabCmd[1];
     if (m_tabCmd.size() ==  2)
         ret = m_mlp->loadState(filename);
+    else if (m_tabCmd.size() == 3)
+    {
+        // the layers are read from the file: a new model starts with any topology
+        filename = m_tabCmd[2];
+        modelSlot *model = findModel(m_tabCmd[1], false);
+        if (model)
+        {
+            if (isBusy(model, "loadState"))
+                return false;
+            ret = model->mlp->loadState(filename);
+        }
+        else
+        {
+            multilayerPerceptron *mlp = new multilayerPerceptron(vector<int>(2, 1));
+            ret = mlp->loadState(filename);
+            if (ret)
+                createModel(m_tabCmd[1], mlp);
+            else
+                delete mlp;
+        }
+        if (ret)
+            cout << "model " << m_tabCmd[1] << ": ";
+    }
     if (ret)
         cout << "loadState ok" << endl;
 
@@ -352,6 +577,303 @@ bool mimetik::doLoadStateText()
     return ret;
 }
 
+bool mimetik::doPrune()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: prune sparsity fineTuneEpochs verbose(booleen)" << endl;
+        cout << "example: prune 0.9" << endl;
+        cout << "example: prune 0.9 100 true" << endl;
+        return false;
+    }
+
+    double sparsity = atof( m_tabCmd[1].c_str());
+    int fineTuneEpochs = 0;
+    if (m_tabCmd.size() > 2)
+        fineTuneEpochs = atoi( m_tabCmd[2].c_str());
+    bool verbose = false;
+    if (m_tabCmd.size() > 3 && m_tabCmd[3] == "true")
+        verbose = true;
+
+    long sizeBefore = m_mlp->getStateSize();
+    double latencyBefore = measureLatency(m_mlp);
+
+    if (!m_mlp->prune(sparsity, fineTuneEpochs, verbose))
+        return false;
+
+    long sizeAfter = m_mlp->getStateSize();
+    double latencyAfter = measureLatency(m_mlp);
+
+    cout << "prune ok: sparsity = " << sparsity << endl;
+    cout << "model size: " << sizeBefore << " bytes -> " << sizeAfter << " bytes" << endl;
+    cout << "latency: " << latencyBefore << " us -> " << latencyAfter << " us per sample" << endl;
+    return true;
+}
+
+bool mimetik::doDistill()
+{
+    if (m_tabCmd.size() < 4)
+    {
+        cout << "usage: distill teacherModel nbLayer1 nbLayer2 ... [limit nbEpoch] [generated nbInputs]" << endl;
+        cout << "example: distill save_vehicle 4 10 4" << endl;
+        cout << "example: distill save_vehicle 4 10 4 limit 5000 generated 1000" << endl;
+        return false;
+    }
+
+    if (m_model->trainingSetFile == "")
+    {
+        cout << "no training set loaded (loadTrainingSet trainingset.txt)" << endl;
+        return false;
+    }
+
+    // student layers, then the options: learning limit (default 1000 epochs) and generated mixup inputs (default none)
+    vector<int> tabNbLayers;
+    int limit = 1000;
+    int nbGenerated = 0;
+    int i = 2;
+    for (; i < m_tabCmd.size() && m_tabCmd[i] != "limit" && m_tabCmd[i] != "generated"; i++)
+    {
+       int nblayer = atoi( m_tabCmd[i].c_str());
+       if (nblayer < 1)
+       {
+           cout << "nblayer must be an integer > 1" << endl;
+           return false;
+       }
+       tabNbLayers.push_back(nblayer);
+    }
+    for (; i + 1 < m_tabCmd.size(); i += 2)
+    {
+        if (m_tabCmd[i] == "limit")
+            limit = atoi( m_tabCmd[i + 1].c_str());
+        else if (m_tabCmd[i] == "generated")
+            nbGenerated = atoi( m_tabCmd[i + 1].c_str());
+        else
+            break;
+    }
+    if (i != m_tabCmd.size() || tabNbLayers.size() < 2)
+    {
+        cout << "usage: distill teacherModel nbLayer1 nbLayer2 ... [limit nbEpoch] [generated nbInputs]" << endl;
+        return false;
+    }
+    if (limit < 1 || nbGenerated < 0)
+    {
+        cout << "limit must be an integer > 1 and generated an integer >= 0" << endl;
+        return false;
+    }
+
+    multilayerPerceptron teacher(tabNbLayers);
+    if (!teacher.loadState(m_tabCmd[1]))
+    {
+        cout << "can't load teacher model: " << m_tabCmd[1] << endl;
+        return false;
+    }
+    if (!teacher.loadTrainingSetFile(m_model->trainingSetFile))
+        return false;
+    double teacherError = teacher.computeError();
+
+    multilayerPerceptron* student = new multilayerPerceptron(tabNbLayers);
+    cout << "start distillation..." << endl;
+    if (!student->loadTrainingSetFile(m_model->trainingSetFile) || !student->distill(teacher, limit, nbGenerated))
+    {
+        delete student;
+        return false;
+    }
+    double studentError = student->computeError();
+
+    // inputs of the training set, row-major: fidelity and batched latency of both networks
+    shared_ptr< const vector<traningSetMlp> > trainingSet = student->getTrainingSet();
+    int nbSample = trainingSet->size();
+    int nbInput = tabNbLayers[0];
+    int nbOutput = tabNbLayers[tabNbLayers.size() - 1];
+    vector<double> tabInputs((size_t) nbSample * nbInput, 0);
+    for (int s = 0; s < nbSample; s++)
+    {
+        const traningSetMlp &sample = (*trainingSet)[s];
+        if (sample.tabExamples.empty())
+        {
+            for (int p = 0; p < sample.tabNonZeroIndexes.size(); p++)
+                tabInputs[(size_t) s * nbInput + sample.tabNonZeroIndexes[p]] = sample.tabNonZeroValues[p];
+        }
+        else
+            copy(sample.tabExamples.begin(), sample.tabExamples.end(), tabInputs.begin() + (size_t) s * nbInput);
+    }
+    vector<double> tabTeacherOutputs((size_t) nbSample * nbOutput);
+    vector<double> tabStudentOutputs((size_t) nbSample * nbOutput);
+    double teacherLatency = measureBatchLatency(&teacher, tabInputs, tabTeacherOutputs);
+    double studentLatency = measureBatchLatency(student, tabInputs, tabStudentOutputs);
+
+    // fidelity: RMS error of the student on the teacher outputs
+    double fidelityError = 0;
+    for (size_t k = 0; k < tabTeacherOutputs.size(); k++)
+        fidelityError += (tabStudentOutputs[k] - tabTeacherOutputs[k]) * (tabStudentOutputs[k] - tabTeacherOutputs[k]);
+    fidelityError = sqrt(fidelityError / max((size_t) 1, tabTeacherOutputs.size()));
+
+    setNetwork(m_model, student);
+
+    cout << "distill ok" << endl;
+    cout << "RMS error: teacher = " << teacherError << ", student = " << studentError << endl;
+    cout << "fidelity gap: " << studentError - teacherError << " (student RMS error on teacher outputs = " << fidelityError << ")" << endl;
+    cout << "latency (computeBatch): teacher = " << teacherLatency << " us, student = " << studentLatency << " us per sample (speedup x" << teacherLatency / studentLatency << ")" << endl;
+    return true;
+}
+
+bool mimetik::doExportCpp()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: exportCpp model.bin net.hpp" << endl;
+        cout << "example: exportCpp net.hpp (current neural network)" << endl;
+        cout << "example: exportCpp save_xor net.hpp" << endl;
+        return false;
+    }
+
+    bool ret = false;
+    string filename = m_tabCmd[m_tabCmd.size() - 1];
+    if (m_tabCmd.size() == 2)
+        ret = m_mlp->exportCpp(filename);
+    else
+    {
+        multilayerPerceptron model(m_mlp->getTopology());
+        if (!model.loadState(m_tabCmd[1]))
+        {
+            cout << "can't load model: " << m_tabCmd[1] << endl;
+            return false;
+        }
+        ret = model.exportCpp(filename);
+    }
+
+    if (ret)
+        cout << "exportCpp ok: " << filename << endl;
+    return ret;
+}
+
+bool mimetik::doStats()
+{
+    if (m_tabCmd.size() > 1)
+    {
+        if (m_tabCmd[1] == "on" || m_tabCmd[1] == "off")
+        {
+            m_mlp->setStats(m_tabCmd[1] == "on");
+            cout << "stats " << m_tabCmd[1] << endl;
+        }
+        else if (m_tabCmd[1] == "reset")
+        {
+            m_mlp->resetStats();
+            cout << "stats reset" << endl;
+        }
+        else if (m_tabCmd[1] == "rate" && m_tabCmd.size() > 2)
+        {
+            double rate = atof( m_tabCmd[2].c_str());
+            m_mlp->setReportRate(rate);
+            cout << "max reports per second = " << rate << endl;
+        }
+        else
+        {
+            cout << "usage: stats on|off|reset|rate maxReportsPerSecond" << endl;
+            cout << "example: stats (display the statistics)" << endl;
+            cout << "example: stats on" << endl;
+            cout << "example: stats rate 2" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    const learningStats &stats = m_mlp->getStats();
+    double phaseTime = stats.forwardTime + stats.outputErrorTime + stats.backpropagationTime + stats.updateTime + stats.shuffleTime;
+    cout << "epochs: " << stats.nbEpoch << ", samples: " << stats.nbSample << ", RMS error: " << stats.learningError << endl;
+    cout << "learning time: " << stats.learningTime << " s, samples/s: " << stats.samplesPerSecond << endl;
+    if (phaseTime > 0)
+    {
+        cout << "\t" << "forward:         " << stats.forwardTime << " s (" << 100 * stats.forwardTime / phaseTime << "%)" << endl;
+        cout << "\t" << "output error:    " << stats.outputErrorTime << " s (" << 100 * stats.outputErrorTime / phaseTime << "%)" << endl;
+        cout << "\t" << "backpropagation: " << stats.backpropagationTime << " s (" << 100 * stats.backpropagationTime / phaseTime << "%)" << endl;
+        cout << "\t" << "weight update:   " << stats.updateTime << " s (" << 100 * stats.updateTime / phaseTime << "%)" << endl;
+        cout << "\t" << "shuffle:         " << stats.shuffleTime << " s (" << 100 * stats.shuffleTime / phaseTime << "%)" << endl;
+    }
+    cout << "I/O time: " << stats.ioTime << " s" << endl;
+    cout << "memory: " << stats.bytesAllocated << " bytes allocated (network and training set), peak RSS " << stats.peakRss << " bytes" << endl;
+    return true;
+}
+
+bool mimetik::doProfile()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        m_profiler.printTable(cout);
+        return true;
+    }
+
+    if (m_tabCmd[1] == "on")
+    {
+        if (!m_profiler.open())
+            cout << "hardware counters unavailable (perf_event_open): only the time is measured" << endl;
+        m_profiling = true;
+        m_mlp->setProfiler(&m_profiler);
+        cout << "profile on" << endl;
+    }
+    else if (m_tabCmd[1] == "off")
+    {
+        m_profiling = false;
+        m_mlp->setProfiler(NULL);
+        m_profiler.close();
+        cout << "profile off" << endl;
+    }
+    else if (m_tabCmd[1] == "reset")
+    {
+        m_profiler.reset();
+        cout << "profile reset" << endl;
+    }
+    else if (m_tabCmd[1] == "json" && m_tabCmd.size() > 2)
+    {
+        if (!m_profiler.saveJson(m_tabCmd[2]))
+            return false;
+        cout << "profile saved in " << m_tabCmd[2] << endl;
+    }
+    else
+    {
+        cout << "usage: profile on|off|reset|json file.json" << endl;
+        cout << "example: profile (display the counters)" << endl;
+        cout << "example: profile on" << endl;
+        cout << "example: profile json profile.json" << endl;
+        return false;
+    }
+    return true;
+}
+
+double mimetik::measureLatency(multilayerPerceptron *mlp)
+{
+    const int nbSample = 1000;
+    vector<int> tabNbNeurons = mlp->getTopology();
+    vector<double> tabInputs(tabNbNeurons[0]);
+    vector<double> tabOutputs;
+    for (int i = 0; i < tabInputs.size(); i++)
+        tabInputs[i] = (double) rand() / RAND_MAX;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < nbSample; i++)
+        mlp->computeOutput(tabInputs, tabOutputs);
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+
+    return chrono::duration<double, micro>(stop - start).count() / nbSample;
+}
+
+double mimetik::measureBatchLatency(multilayerPerceptron *mlp, const vector<double> &tabInputs, vector<double> &tabOutputs)
+{
+    // batched inference on the calling thread, repeated on at least 1000 samples
+    int nbInput = mlp->getTopology()[0];
+    int nbSample = tabInputs.size() / nbInput;
+    if (nbSample < 1)
+        return 0;
+    int nbRepeat = max(1, 1000 / nbSample);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < nbRepeat; r++)
+        mlp->computeBatch(&tabInputs[0], &tabOutputs[0], nbSample);
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+
+    return chrono::duration<double, micro>(stop - start).count() / ((double) nbRepeat * nbSample);
+}
+
 bool mimetik::doExecute()
 {
     if (m_tabCmd.size() < 2)
@@ -374,50 +896,1095 @@ bool mimetik::executeScript(const string filename)
         return false;
     }
 
+    // compiled once: arguments split, command looked up and compute inputs parsed
+    vector<scriptCommand> tabPlan;
     string command;
     while (getline(file, command))
     {
-        bool test = executeCommandLine(command);
-        if (!test)
+        tabPlan.push_back(scriptCommand());
+        scriptCommand &compiled = tabPlan.back();
+        splitCommand(command, compiled.tabArgs);
+        compiled.command = NULL;
+        if (compiled.tabArgs.empty())
+            continue;
+
+        map<string, commandEntry>::const_iterator it = commandTable().find(compiled.tabArgs[0]);
+        if (it != commandTable().end())
+            compiled.command = &it->second;
+        if (compiled.tabArgs[0] == "compute")
         {
-            file.close();
-            return false;
+            compiled.tabValues.resize(compiled.tabArgs.size() - 1);
+            for (int i = 1; i < compiled.tabArgs.size(); i++)
+                compiled.tabValues[i-1] = atof( compiled.tabArgs[i].c_str());
         }
     }
-
     file.close();
+
+    // stops at the first command failing
+    int i = 0;
+    while (i < tabPlan.size())
+    {
+        int nbCompute = executeComputeRun(tabPlan, i);
+        if (nbCompute > 0)
+        {
+            i += nbCompute;
+            continue;
+        }
+
+        m_tabCmd = tabPlan[i].tabArgs;
+        if (m_tabCmd.empty() || !runCommand(tabPlan[i].command))
+        {
+            flushResults();
+            if (m_quiet)
+                cerr << "error: " << filename << ":" << i + 1 << ": command failed" << endl;
+            return false;
+        }
+        i++;
+    }
+    flushResults();
     return true;
 }
 
+int mimetik::executeComputeRun(const vector<scriptCommand> &tabPlan, const int first)
+{
+    // consecutive compute commands with the inputs of the network: one batch, one write of the outputs
+    if (tabPlan[first].tabValues.empty() || first + 1 >= tabPlan.size() || tabPlan[first + 1].tabValues.empty())
+        return 0;
+
+    for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+        joinJob(it->second, false);
+    shared_ptr<multilayerPerceptron> snapshot;
+    if (m_model->job)
+        snapshot = m_mlp->getSnapshot();
+    multilayerPerceptron *mlp = m_model->job ? snapshot.get() : m_mlp;
+    if (!mlp)
+        return 0;                                       // compute reports the missing snapshot
+
+    vector<int> tabNbNeurons = mlp->getTopology();
+    int nbInput = tabNbNeurons[0];
+    int nbOutput = tabNbNeurons[tabNbNeurons.size() - 1];
+    int nbSample = 0;
+    int maxSample = batchRows(nbInput, nbOutput);
+    while (first + nbSample < tabPlan.size() && nbSample < maxSample && tabPlan[first + nbSample].tabValues.size() == nbInput)
+        nbSample++;
+    if (nbSample < 2)
+        return 0;
+
+    m_tabInputs.resize(nbSample * nbInput);
+    m_tabOutputs.resize(nbSample * nbOutput);
+    for (int i = 0; i < nbSample; i++)
+        copy(tabPlan[first + i].tabValues.begin(), tabPlan[first + i].tabValues.end(), m_tabInputs.begin() + i * nbInput);
+    if (!computeRows(mlp, m_tabInputs.data(), m_tabOutputs.data(), nbSample))
+        return 0;
+
+    if (m_quiet)
+    {
+        writeResults(m_tabOutputs.data(), nbSample, nbOutput);
+        return nbSample;
+    }
+
+    // same text as compute (%g is the default format of cout), written at once
+    string out;
+    char value[32];
+    for (int i = 0; i < nbSample; i++)
+    {
+        out += "inputs: ";
+        for (int j = 0; j < nbInput; j++)
+            out.append(value, snprintf(value, sizeof value, "%g ", m_tabInputs[i * nbInput + j]));
+        out += "\noutputs: ";
+        for (int j = 0; j < nbOutput; j++)
+            out.append(value, snprintf(value, sizeof value, "%g ", m_tabOutputs[i * nbOutput + j]));
+        out += "\n";
+    }
+    cout << out << flush;
+    return nbSample;
+}
+
+void mimetik::setQuiet(const outputFormat format)
+{
+    // messages are kept until the command ends (displayed if it fails), results go to the buffered writer
+    m_quiet = true;
+    m_outputFormat = format;
+    if (!m_coutBuffer)
+        m_coutBuffer = cout.rdbuf(m_messages.rdbuf());
+}
+
+bool mimetik::computeStream(istream &input)
+{
+    shared_ptr<multilayerPerceptron> snapshot;
+    multilayerPerceptron *mlp = computeNetwork(snapshot);
+    if (!mlp)
+        return false;
+
+    // one row per line: inputs separated by spaces, tabs or commas, computed by blocks of rows
+    vector<int> tabNbNeurons = mlp->getTopology();
+    int nbInput = tabNbNeurons[0];
+    int nbOutput = tabNbNeurons[tabNbNeurons.size() - 1];
+    int maxSample = batchRows(nbInput, nbOutput);
+    m_tabInputs.resize((size_t) maxSample * nbInput);
+    m_tabOutputs.resize((size_t) maxSample * nbOutput);
+
+    string line;
+    long nbLine = 0;
+    int nbSample = 0;
+    bool ret = true;
+    while (ret && getline(input, line))
+    {
+        nbLine++;
+        const char *p = line.c_str();
+        int nbValue = 0;
+        while (true)
+        {
+            while (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r')
+                p++;
+            if (*p == 0)
+                break;
+            char *end;
+            double value = strtod(p, &end);
+            if (end == p || nbValue == nbInput)
+            {
+                nbValue = -1;
+                break;
+            }
+            m_tabInputs[nbSample * nbInput + nbValue++] = value;
+            p = end;
+        }
+        if (nbValue == 0)
+            continue;                                   // empty line
+        if (nbValue != nbInput)
+        {
+            cerr << "error: line " << nbLine << ": " << nbInput << " numbers expected" << endl;
+            ret = false;
+            break;
+        }
+
+        if (++nbSample == maxSample)
+        {
+            ret = computeRows(mlp, m_tabInputs.data(), m_tabOutputs.data(), nbSample);
+            writeResults(m_tabOutputs.data(), nbSample, nbOutput);
+            nbSample = 0;
+        }
+    }
+    if (ret && nbSample > 0)
+    {
+        ret = computeRows(mlp, m_tabInputs.data(), m_tabOutputs.data(), nbSample);
+        writeResults(m_tabOutputs.data(), nbSample, nbOutput);
+    }
+    flushResults();
+    return ret;
+}
+
+void mimetik::writeResults(const double *tabOutputs, const int nbSample, const int nbOutput)
+{
+    char value[32];
+    for (int i = 0; i < nbSample; i++)
+    {
+        const double *outputs = tabOutputs + i * nbOutput;
+        if (m_outputFormat == OUTPUT_BINARY)
+            m_results.append((const char *) outputs, nbOutput * sizeof(double));
+        else
+        {
+            // csv: a,b  json lines: [a,b]  (shortest text read back as the same double)
+            if (m_outputFormat == OUTPUT_JSON)
+                m_results += '[';
+            for (int j = 0; j < nbOutput; j++)
+            {
+                if (j > 0)
+                    m_results += ',';
+#ifdef __cpp_lib_to_chars
+                m_results.append(value, to_chars(value, value + sizeof value, outputs[j]).ptr);
+#else
+                m_results.append(value, snprintf(value, sizeof value, "%.17g", outputs[j]));
+#endif
+            }
+            if (m_outputFormat == OUTPUT_JSON)
+                m_results += ']';
+            m_results += '\n';
+        }
+    }
+    if (m_results.size() >= RESULT_BUFFER_SIZE)
+        flushResults();
+}
+
+void mimetik::flushResults()
+{
+    if (m_results.empty())
+        return;
+    fwrite(m_results.data(), 1, m_results.size(), stdout);
+    fflush(stdout);
+    m_results.clear();
+}
+
+bool mimetik::doJobs()
+{
+    bool found = false;
+    for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+    {
+        learningJob *job = it->second->job.get();
+        if (!job)
+            continue;
+
+        int state = job->state;
+        lock_guard<mutex> lock(job->jobMutex);
+        cout << "[" << it->first << "] " << (state == JOB_QUEUED ? "queued: " : state == JOB_RUNNING ? "running: " : "done: ") << job->command
+             << " & (epoch " << job->stats.nbEpoch - job->firstEpoch << "/" << job->limit << ")" << endl;
+        found = true;
+    }
+    if (!found)
+        cout << "no learning job" << endl;
+    return true;
+}
+
+bool mimetik::doWait()
+{
+    vector<modelSlot*> tabModels = jobModels();
+    bool ret = true;
+    for (int i = 0; i < tabModels.size(); i++)
+    {
+        shared_ptr<learningJob> job = tabModels[i]->job;
+        joinJob(tabModels[i], true);
+        ret = ret && job->result;
+    }
+    return ret;
+}
+
+bool mimetik::doProgress()
+{
+    vector<modelSlot*> tabModels = jobModels();
+    for (int i = 0; i < tabModels.size(); i++)
+    {
+        learningJob *job = tabModels[i]->job.get();
+        lock_guard<mutex> lock(job->jobMutex);
+        long nbEpoch = job->stats.nbEpoch - job->firstEpoch;
+        cout << "[" << tabModels[i]->name << "] epoch " << nbEpoch << "/" << job->limit << " (" << 100.0 * nbEpoch / job->limit << "%)";
+        if (nbEpoch > 0)
+            cout << ", RMS error = " << job->stats.learningError << ", samples/s = " << job->stats.samplesPerSecond;
+        cout << endl;
+    }
+    return true;
+}
+
+bool mimetik::doCancel()
+{
+    vector<modelSlot*> tabModels = jobModels();
+    for (int i = 0; i < tabModels.size(); i++)
+    {
+        cancelJob(tabModels[i]);
+        cout << "[" << tabModels[i]->name << "] learning cancelled" << endl;
+        if (tabModels[i]->job)
+            joinJob(tabModels[i], true);
+    }
+    return true;
+}
+
+bool mimetik::doSetSnapshotRate()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: setSnapshotRate nbEpoch" << endl;
+        cout << "example: setSnapshotRate 10" << endl;
+        return false;
+    }
+
+    m_snapshotRate = max(1, atoi( m_tabCmd[1].c_str()));
+    cout << "snapshot every " << m_snapshotRate << " epochs (next learning job)" << endl;
+    return true;
+}
+
+bool mimetik::doUse()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: use name" << endl;
+        return false;
+    }
+
+    modelSlot *model = findModel(m_tabCmd[1]);
+    if (!model)
+        return false;
+    useModel(model);
+    cout << "current model: " << model->name << endl;
+    return true;
+}
+
+bool mimetik::doModels()
+{
+    for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+    {
+        modelSlot *model = it->second;
+        vector<int> tabNbNeurons = model->mlp->getTopology();
+        cout << (model == m_model ? "* " : "  ") << model->name << ":";
+        for (int i = 0; i < tabNbNeurons.size(); i++)
+            cout << " " << tabNbNeurons[i];
+        if (model->trainingSetFile != "")
+            cout << ", training set " << model->trainingSetFile;
+        if (model->perceptron)
+            cout << ", perceptron " << model->perceptron->getNbInput() << " " << model->perceptron->getNbOutput();
+        if (model->cascadeFast != "")
+            cout << ", cascade " << model->cascadeFast << " (threshold " << model->cascade.getThreshold() << ")";
+        if (model->job)
+            cout << ", job: " << model->job->command << " &";
+        cout << endl;
+    }
+    return true;
+}
+
+bool mimetik::doDrop()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: drop name" << endl;
+        return false;
+    }
+
+    modelSlot *model = findModel(m_tabCmd[1]);
+    if (!model || isBusy(model, "drop"))
+        return false;
+    if (model == m_model)
+    {
+        cout << "drop: " << model->name << " is the current model (use another model first)" << endl;
+        return false;
+    }
+
+    m_tabModels.erase(model->name);
+    delete model->mlp;
+    delete model->perceptron;
+    delete model;
+    cout << "model " << m_tabCmd[1] << " dropped" << endl;
+    return true;
+}
+
+bool mimetik::doPerceptron()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: perceptron nbInput [nbOutput] [multiclass]" << endl;
+        cout << "example: perceptron 8" << endl;
+        cout << "example: perceptron 64 10 multiclass" << endl;
+        return false;
+    }
+
+    int nbInput = atoi(m_tabCmd[1].c_str());
+    int nbOutput = (m_tabCmd.size() > 2) ? atoi(m_tabCmd[2].c_str()) : 1;
+    if (nbInput < 1 || nbOutput < 1)
+    {
+        cout << "nbInput and nbOutput must be integers >= 1" << endl;
+        return false;
+    }
+
+    perceptronMode mode = (m_tabCmd.size() > 3 && m_tabCmd[3] == "multiclass") ? PERCEPTRON_MULTI_CLASS : PERCEPTRON_MULTI_OUTPUT;
+    delete m_model->perceptron;
+    m_model->perceptron = new multiClassPerceptron(nbInput, nbOutput, mode);
+    cout << "new perceptron: " << nbInput << " inputs, " << nbOutput << (mode == PERCEPTRON_MULTI_CLASS ? " classes" : " outputs") << endl;
+    return true;
+}
+
+multiClassPerceptron *mimetik::currentPerceptron()
+{
+    if (!m_model->perceptron)
+        cout << "model " << m_model->name << " has no perceptron (perceptron nbInput [nbOutput])" << endl;
+    return m_model->perceptron;
+}
+
+bool mimetik::doPerceptronLearning()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: perceptronLearning trainingset.txt [limit] [pocket(booleen)] [verbose(booleen)]" << endl;
+        cout << "example: perceptronLearning perceptron_7LED_odd_even.txt" << endl;
+        cout << "example: perceptronLearning trainingset.txt 100 true" << endl;
+        return false;
+    }
+
+    multiClassPerceptron *perceptron = currentPerceptron();
+    if (!perceptron || !perceptron->loadTrainingSetFile(m_tabCmd[1]))
+        return false;
+
+    int limit = (m_tabCmd.size() > 2) ? atoi(m_tabCmd[2].c_str()) : -1;
+    perceptron->setPocket(m_tabCmd.size() > 3 && m_tabCmd[3] == "true");
+    perceptron->learning(limit, m_tabCmd.size() > 4 && m_tabCmd[4] == "true");
+
+    const perceptronStats &stats = perceptron->getStats();
+    cout << "perceptron learning: " << stats.nbEpoch << " epochs, " << stats.nbError << " misclassified examples (epoch "
+         << stats.bestEpoch << "), " << 1e3 * stats.learningTime << " ms" << endl;
+    return true;
+}
+
+bool mimetik::doPerceptronCompute()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: perceptronCompute input1 input2 ..." << endl;
+        cout << "example: perceptronCompute 1 0 1" << endl;
+        return false;
+    }
+
+    multiClassPerceptron *perceptron = currentPerceptron();
+    if (!perceptron)
+        return false;
+    if (m_tabCmd.size() - 1 != perceptron->getNbInput())
+    {
+        cout << "Error: the number of inputs data does not match" << endl;
+        return false;
+    }
+
+    m_tabInputs.resize(m_tabCmd.size() - 1);
+    for (int i = 1; i < m_tabCmd.size(); i++)
+       m_tabInputs[i-1] = atof( m_tabCmd[i].c_str());
+
+    vector<int> tabOutputs(perceptron->getNbOutput());
+    perceptron->computeBatch(m_tabInputs.data(), tabOutputs.data(), 1);
+    if (m_quiet)
+    {
+        m_tabOutputs.assign(tabOutputs.begin(), tabOutputs.end());
+        writeResults(m_tabOutputs.data(), 1, m_tabOutputs.size());
+    }
+    else
+    {
+        cout << "outputs: ";
+        for (int i = 0; i < tabOutputs.size(); i++)
+            cout << tabOutputs[i] << " ";
+        cout << endl;
+    }
+    return true;
+}
+
+bool mimetik::doPerceptronComputeFile()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: perceptronComputeFile fileIn [fileOut]" << endl;
+        cout << "example: perceptronComputeFile fileIn.txt" << endl;
+        return false;
+    }
+
+    multiClassPerceptron *perceptron = currentPerceptron();
+    if (!perceptron)
+        return false;
+
+    bool ret = perceptron->computeFile(m_tabCmd[1], (m_tabCmd.size() > 2) ? m_tabCmd[2] : "");
+    if (ret)
+        cout << "perceptronComputeFile ok" << endl;
+    return ret;
+}
+
+bool mimetik::doPerceptronSave()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: perceptronSave weights.txt" << endl;
+        return false;
+    }
+
+    multiClassPerceptron *perceptron = currentPerceptron();
+    if (!perceptron)
+        return false;
+    if (!perceptron->saveStateText(m_tabCmd[1]))
+    {
+        cout << "Error: can't save perceptron weights in " << m_tabCmd[1] << endl;
+        return false;
+    }
+    cout << "perceptronSave ok" << endl;
+    return true;
+}
+
+bool mimetik::doPerceptronLoad()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        cout << "usage: perceptronLoad weights.txt" << endl;
+        return false;
+    }
+
+    multiClassPerceptron *perceptron = currentPerceptron();
+    if (!perceptron)
+        return false;
+    if (!perceptron->loadStateText(m_tabCmd[1]))
+    {
+        cout << "Error: can't load perceptron weights from " << m_tabCmd[1] << endl;
+        return false;
+    }
+    cout << "perceptronLoad ok" << endl;
+    return true;
+}
+
+bool mimetik::doPipeline()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        pipelineStats stats = m_mlp->getPipelineStats();
+        int nbStages = stats.tabStages.size();
+        if (nbStages < 2)
+        {
+            cout << "usage: pipeline nbStages [microBatchSize] [nbMicroBatch] / pipeline split nbLayer1 nbLayer2 ... / pipeline off" << endl;
+            cout << "example: pipeline 4 16 8" << endl;
+            return false;
+        }
+
+        cout << "pipeline: " << nbStages << " stages, micro-batches of " << stats.microBatchSize << " samples, " << stats.nbMicroBatch
+             << " per weight update, " << stats.nbRun << " runs, " << stats.wallTime << " s" << endl;
+        double busyTime = 0;
+        for (int s = 0; s < nbStages; s++)
+        {
+            const pipelineStage &stage = stats.tabStages[s];
+            cout << "stage " << s << ": layers " << stage.firstLayer << "-" << stage.lastLayer << ", " << stage.nbWeight << " weights";
+            if (stats.wallTime > 0)
+                cout << ", utilization " << 100 * stage.busyTime / stats.wallTime << "%";
+            cout << endl;
+            busyTime += stage.busyTime;
+        }
+
+        // measured: idle part of the stage time; GPipe: (nbStages - 1) / (nbMicroBatch + nbStages - 1) with equal stages
+        if (stats.wallTime > 0)
+            cout << "bubble overhead: " << 100 * (1 - busyTime / (nbStages * stats.wallTime)) << "% (GPipe schedule: "
+                 << 100.0 * (nbStages - 1) / (stats.nbMicroBatch + nbStages - 1) << "%)" << endl;
+        return true;
+    }
+
+    bool ret = false;
+    if (m_tabCmd[1] == "off")
+        ret = m_mlp->setPipeline(1);
+    else if (m_tabCmd[1] == "split")
+    {
+        // layers with weights of each stage, micro-batches unchanged
+        vector<int> tabLayers;
+        for (int i = 2; i < m_tabCmd.size(); i++)
+            tabLayers.push_back(atoi(m_tabCmd[i].c_str()));
+        pipelineStats stats = m_mlp->getPipelineStats();
+        int microBatchSize = (stats.microBatchSize > 0) ? stats.microBatchSize : 16;
+        int nbMicroBatch = (stats.nbMicroBatch > 0) ? stats.nbMicroBatch : 8;
+        ret = tabLayers.size() >= 2 && m_mlp->setPipeline(tabLayers.size(), microBatchSize, nbMicroBatch, tabLayers);
+        if (tabLayers.size() < 2)
+            cout << "pipeline split: at least 2 stages (ex: pipeline split 3 4)" << endl;
+    }
+    else
+    {
+        int nbStages = atoi(m_tabCmd[1].c_str());
+        int microBatchSize = (m_tabCmd.size() > 2) ? atoi(m_tabCmd[2].c_str()) : 16;
+        int nbMicroBatch = (m_tabCmd.size() > 3) ? atoi(m_tabCmd[3].c_str()) : 8;
+        ret = m_mlp->setPipeline(nbStages, microBatchSize, nbMicroBatch);
+    }
+
+    if (ret && m_mlp->getPipelineStages() < 2)
+        cout << "pipeline off" << endl;
+    else if (ret)
+    {
+        pipelineStats stats = m_mlp->getPipelineStats();
+        cout << "pipeline: ";
+        for (int s = 0; s < stats.tabStages.size(); s++)
+            cout << (s > 0 ? ", " : "") << "layers " << stats.tabStages[s].firstLayer << "-" << stats.tabStages[s].lastLayer;
+        cout << " (micro-batches of " << stats.microBatchSize << " samples, " << stats.nbMicroBatch << " per weight update)" << endl;
+    }
+    return ret;
+}
+
+bool mimetik::doPrecision()
+{
+    const mlpPrecision tabPrecisions[3] = {PRECISION_DOUBLE, PRECISION_BFLOAT16, PRECISION_FLOAT16};
+    int precision = -1;
+    for (int p = 0; p < 3 && m_tabCmd.size() > 1; p++)
+        if (m_tabCmd[1] == precisionName(tabPrecisions[p]))
+            precision = p;
+
+    if (m_tabCmd.size() > 1 && precision < 0)
+    {
+        cout << "usage: precision double|bfloat16|float16" << endl;
+        cout << "example: precision bfloat16" << endl;
+        return false;
+    }
+    if (precision >= 0 && !m_mlp->setPrecision(tabPrecisions[precision]))
+        return false;
+
+    // bytes of weights read by the forward and backpropagation sweeps of one sample
+    long nbWeight = 0;
+    vector<int> tabTopology = m_mlp->getTopology();
+    for (int i = 1; i < tabTopology.size(); i++)
+        nbWeight += (long) tabTopology[i] * tabTopology[i - 1];
+    mlpPrecision current = m_mlp->getPrecision();
+    cout << "precision: " << precisionName(current) << ", weights read per sample: "
+         << 2 * nbWeight * (current == PRECISION_DOUBLE ? sizeof(double) : sizeof(uint16_t)) << " bytes";
+    if (current == PRECISION_FLOAT16)
+        cout << (hasF16c() ? " (F16C)" : " (no F16C: software conversion)");
+    cout << endl;
+    return true;
+}
+
+bool mimetik::doAccumulation()
+{
+    if (m_tabCmd.size() > 1 && m_tabCmd[1] == "off")
+        m_mlp->setAccumulation(0);
+    else if (m_tabCmd.size() > 1)
+    {
+        // budget in megabytes: activations of one micro-batch and gradients
+        double megabytes = atof(m_tabCmd[1].c_str());
+        int nbMicroBatch = (m_tabCmd.size() > 2) ? atoi(m_tabCmd[2].c_str()) : 1;
+        if (megabytes <= 0)
+        {
+            cout << "usage: accumulation budgetMegabytes [nbMicroBatch] / accumulation off" << endl;
+            cout << "example: accumulation 64 8" << endl;
+            return false;
+        }
+        if (!m_mlp->setAccumulation((size_t) (megabytes * 1024 * 1024), nbMicroBatch))
+            return false;
+    }
+
+    size_t memoryBudget;
+    int microBatchSize, nbMicroBatch;
+    if (!m_mlp->getAccumulation(memoryBudget, microBatchSize, nbMicroBatch))
+    {
+        cout << "accumulation off (minimum budget for this network: " << mlpAccumulation::requiredBudget(m_mlp->getTopology()) << " bytes)" << endl;
+        return true;
+    }
+    cout << "accumulation: budget " << memoryBudget / (1024.0 * 1024.0) << " MB, micro-batches of " << microBatchSize << " samples, "
+         << nbMicroBatch << " per weight update (batches of " << (long) microBatchSize * nbMicroBatch << " samples)" << endl;
+    return true;
+}
+
+bool mimetik::doPartialFit()
+{
+    if (m_tabCmd.size() > 2 && m_tabCmd[1] == "replay")
+    {
+        int replaySize = 0;
+        double ratio = m_mlp->getReplayRatio();
+        if (!parseInt(m_tabCmd[2], replaySize) || replaySize < 0)
+        {
+            cout << "Error: the replay size must be an integer >= 0" << endl;
+            return false;
+        }
+        if (m_tabCmd.size() > 3 && (!parseDouble(m_tabCmd[3], ratio) || !(ratio >= 0)))
+        {
+            cout << "Error: the replay ratio must be a number >= 0" << endl;
+            return false;
+        }
+        m_mlp->setReplay(replaySize, ratio);
+    }
+    else if (m_tabCmd.size() > 1 && m_tabCmd[1] != "replay")
+    {
+        int nbPass = 1;
+        if (m_tabCmd.size() > 2 && (!parseInt(m_tabCmd[2], nbPass) || nbPass < 1))
+        {
+            cout << "Error: the number of passes must be an integer >= 1" << endl;
+            return false;
+        }
+
+        // new samples in the training set format of the network: the training set of the model is not replaced
+        multilayerPerceptron chunk(m_mlp->getTopology());
+        if (!chunk.loadTrainingSetFile(m_tabCmd[1], false))    // read once: not cached
+            return false;
+        shared_ptr< const vector<traningSetMlp> > tabSamples = chunk.getTrainingSet();
+        if (!m_mlp->partialFit(*tabSamples, nbPass))
+            return false;
+        cout << "partialFit: " << tabSamples->size() << " samples, " << nbPass << " pass(es), RMS error = " << m_mlp->getStats().learningError << endl;
+    }
+    else
+    {
+        cout << "usage: partialFit samples.txt [nbPass] / partialFit replay size [ratio]" << endl;
+        cout << "example: partialFit chunk.txt 2" << endl;
+        cout << "replay: " << m_mlp->getReplayCount() << " / " << m_mlp->getReplaySize() << " samples in the reservoir, "
+             << m_mlp->getReplayRatio() << " replayed per new sample" << endl;
+        return false;
+    }
+
+    cout << "replay: " << m_mlp->getReplayCount() << " / " << m_mlp->getReplaySize() << " samples in the reservoir, "
+         << m_mlp->getReplayRatio() << " replayed per new sample" << endl;
+    return true;
+}
+
+bool mimetik::doCascade()
+{
+    if (m_tabCmd.size() < 2)
+    {
+        if (m_model->cascadeFast == "")
+        {
+            cout << "usage: cascade perceptron|model [threshold] / cascade off / cascade reset" << endl;
+            cout << "example: cascade perceptron 2.5" << endl;
+            cout << "example: cascade small 0.3" << endl;
+            return false;
+        }
+
+        const cascadeStats &stats = m_model->cascade.getStats();
+        cout << "cascade: " << m_model->cascadeFast << " then " << m_model->name << ", threshold " << m_model->cascade.getThreshold() << endl;
+        cout << "samples: " << stats.nbSample << ", routed to " << m_model->name << ": " << stats.nbRouted;
+        if (stats.nbSample > 0)
+            cout << " (" << 100.0 * stats.nbRouted / stats.nbSample << "%), " << 1e6 * (stats.fastTime + stats.expensiveTime) / stats.nbSample
+                 << " us/sample (fast stage " << 1e6 * stats.fastTime / stats.nbSample << " us/sample)";
+        cout << endl;
+        return true;
+    }
+
+    if (m_tabCmd[1] == "off" || m_tabCmd[1] == "reset")
+    {
+        if (m_tabCmd[1] == "off")
+            m_model->cascadeFast = "";
+        m_model->cascade.resetStats();
+        cout << "cascade " << m_tabCmd[1] << endl;
+        return true;
+    }
+
+    if (m_tabCmd[1] == m_model->name || (m_tabCmd[1] != "perceptron" && !findModel(m_tabCmd[1])))
+    {
+        if (m_tabCmd[1] == m_model->name)
+            cout << "cascade: the fast stage must be another model or the perceptron of " << m_model->name << endl;
+        return false;
+    }
+
+    // the stages are checked now and before each use (the fast model can change)
+    string previous = m_model->cascadeFast;
+    m_model->cascadeFast = m_tabCmd[1];
+    shared_ptr<multilayerPerceptron> snapshot;
+    shared_ptr<multilayerPerceptron> fastSnapshot;
+    multilayerPerceptron *mlp = computeNetwork(snapshot);
+    if (!mlp || !setCascadeStages(mlp, fastSnapshot))
+    {
+        m_model->cascadeFast = previous;
+        return false;
+    }
+
+    if (m_tabCmd.size() > 2)
+        m_model->cascade.setThreshold(atof(m_tabCmd[2].c_str()));
+    m_model->cascade.resetStats();
+    cout << "cascade: " << m_model->cascadeFast << " then " << m_model->name << ", threshold " << m_model->cascade.getThreshold() << endl;
+    return true;
+}
+
+bool mimetik::doCalibrate()
+{
+    if (m_tabCmd.size() < 3)
+    {
+        cout << "usage: calibrate validation.txt accuracy" << endl;
+        cout << "example: calibrate validation.txt 0.99" << endl;
+        return false;
+    }
+
+    if (m_model->cascadeFast == "")
+    {
+        cout << "calibrate: no cascade on model " << m_model->name << " (cascade perceptron|model)" << endl;
+        return false;
+    }
+
+    shared_ptr<multilayerPerceptron> snapshot;
+    shared_ptr<multilayerPerceptron> fastSnapshot;
+    multilayerPerceptron *mlp = computeNetwork(snapshot);
+    if (!mlp || !setCascadeStages(mlp, fastSnapshot))
+        return false;
+    return m_model->cascade.calibrate(m_tabCmd[1], atof(m_tabCmd[2].c_str()));
+}
+
+bool mimetik::setCascadeStages(multilayerPerceptron *mlp, shared_ptr<multilayerPerceptron> &fastSnapshot)
+{
+    if (m_model->cascadeFast == "perceptron")
+        return currentPerceptron() && m_model->cascade.setStages(m_model->perceptron, NULL, mlp);
+
+    // the network of another model: its last snapshot during a learning job
+    modelSlot *fast = findModel(m_model->cascadeFast);
+    if (!fast)
+        return false;
+    multilayerPerceptron *fastMlp = fast->mlp;
+    if (fast->job)
+    {
+        fastSnapshot = fast->mlp->getSnapshot();
+        fastMlp = fastSnapshot.get();
+        if (!fastMlp)
+        {
+            cout << "no snapshot of the learning job of " << fast->name << " yet" << endl;
+            return false;
+        }
+    }
+    return m_model->cascade.setStages(NULL, fastMlp, mlp);
+}
+
+bool mimetik::computeRows(multilayerPerceptron *mlp, const double *tabInputs, double *tabOutputs, const int nbSample)
+{
+    if (m_model->cascadeFast == "")
+        return mlp->computeBatch(tabInputs, tabOutputs, nbSample, threadPool::instance().size());
+
+    shared_ptr<multilayerPerceptron> fastSnapshot;
+    return setCascadeStages(mlp, fastSnapshot) && m_model->cascade.computeBatch(tabInputs, tabOutputs, nbSample);
+}
+
+bool mimetik::doCache()
+{
+    trainingSetCache &cache = trainingSetCache::instance();
+    if (m_tabCmd.size() < 2)
+    {
+        trainingSetCacheStats stats = cache.getStats();
+        cout << "training sets: " << stats.nbEntry << ", memory: " << stats.bytes << "/" << cache.getMemoryLimit() << " bytes, sidecar "
+             << (cache.getSidecar() ? "on" : "off") << endl;
+        cout << "hits: " << stats.nbHit << ", misses: " << stats.nbMiss << ", evictions: " << stats.nbEviction << endl;
+        return true;
+    }
+
+    if (m_tabCmd[1] == "limit" && m_tabCmd.size() > 2)
+    {
+        double megabytes = atof( m_tabCmd[2].c_str());
+        cache.setMemoryLimit((long) (megabytes * (1 << 20)));
+        cout << "cache limit = " << megabytes << " MB" << endl;
+    }
+    else if (m_tabCmd[1] == "sidecar" && m_tabCmd.size() > 2 && (m_tabCmd[2] == "on" || m_tabCmd[2] == "off"))
+    {
+        cache.setSidecar(m_tabCmd[2] == "on");
+        cout << "sidecar " << m_tabCmd[2] << endl;
+    }
+    else if (m_tabCmd[1] == "clear")
+    {
+        cache.clear();
+        cout << "cache cleared" << endl;
+    }
+    else
+    {
+        cout << "usage: cache limit megabytes|sidecar on|off|clear" << endl;
+        cout << "example: cache (display the cached training sets)" << endl;
+        cout << "example: cache limit 256" << endl;
+        cout << "example: cache sidecar on" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool mimetik::doThreads()
+{
+    threadPool &pool = threadPool::instance();
+    if (m_tabCmd.size() < 2)
+    {
+        threadPoolStats stats = pool.getStats();
+        cout << "threads: " << pool.size() << (pool.isPinned() ? " (pinned)" : "") << ", spare threads: " << stats.nbSpare << endl;
+        cout << "tasks: " << stats.nbTask << ", steals: " << stats.nbSteal << ", parallelFor: " << stats.nbParallelFor
+             << ", concurrent groups: " << stats.nbConcurrent << endl;
+        return true;
+    }
+
+    int nbThreads = atoi(m_tabCmd[1].c_str());
+    bool pinned = (m_tabCmd.size() > 2 && m_tabCmd[2] == "pin");
+    if (nbThreads < 0 || (m_tabCmd[1] != "0" && nbThreads == 0) || (m_tabCmd.size() > 2 && !pinned))
+    {
+        cout << "usage: threads nbThreads [pin]" << endl;
+        cout << "example: threads (display the thread pool)" << endl;
+        cout << "example: threads 8 pin" << endl;
+        cout << "example: threads 0 (one per hardware thread)" << endl;
+        return false;
+    }
+
+    // the workers are replaced once their queues are empty: a running job would block the interpreter
+    for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+    {
+        if (it->second->job && it->second->job->state != JOB_DONE)
+        {
+            cout << "threads: wait for the learning job of [" << it->second->name << "] (jobs, wait, cancel)" << endl;
+            return false;
+        }
+    }
+
+    pool.setThreads(nbThreads, pinned);
+    pool.resetStats();
+    cout << "threads = " << pool.size() << (pinned ? " (pinned)" : "") << endl;
+    return true;
+}
+
+modelSlot *mimetik::findModel(const string &name, const bool verbose)
+{
+    map<string, modelSlot*>::iterator it = m_tabModels.find(name);
+    if (it == m_tabModels.end())
+    {
+        if (verbose)
+            cout << "unknown model: " << name << " (models: list the models)" << endl;
+        return NULL;
+    }
+    return it->second;
+}
+
+modelSlot *mimetik::createModel(const string &name, multilayerPerceptron *mlp)
+{
+    modelSlot *model = new modelSlot();
+    model->name = name;
+    model->mlp = mlp;
+    model->perceptron = NULL;
+    m_tabModels[name] = model;
+    return model;
+}
+
+void mimetik::setNetwork(modelSlot *model, multilayerPerceptron *mlp)
+{
+    delete model->mlp;
+    model->mlp = mlp;
+    if (model == m_model)
+    {
+        m_mlp = mlp;
+        if (m_profiling)
+            m_mlp->setProfiler(&m_profiler);
+    }
+}
+
+void mimetik::useModel(modelSlot *model)
+{
+    // the profiler follows the current model (except during its job)
+    if (m_mlp && !m_model->job)
+        m_mlp->setProfiler(NULL);
+    m_model = model;
+    m_mlp = model->mlp;
+    if (m_profiling && !m_model->job)
+        m_mlp->setProfiler(&m_profiler);
+}
+
+bool mimetik::isBusy(modelSlot *model, const string &command)
+{
+    if (!model->job)
+        return false;
+    cout << command << ": a learning job is running on model " << model->name << " (use wait or cancel)" << endl;
+    return true;
+}
+
+void mimetik::cancelJob(modelSlot *model)
+{
+    if (!model->job)
+        return;
+
+    // a queued job is dropped at once (its task only marks it done), a running job stops at the end of the epoch
+    int state = JOB_QUEUED;
+    if (model->job->state.compare_exchange_strong(state, JOB_CANCELLED))
+    {
+        model->mlp->setLearningCallback(NULL);
+        model->mlp->setSnapshotRate(0);
+        if (m_profiling && model == m_model)
+            model->mlp->setProfiler(&m_profiler);
+        model->job.reset();
+    }
+    else if (state == JOB_RUNNING)
+        model->mlp->cancelLearning();
+}
+
+vector<modelSlot*> mimetik::jobModels()
+{
+    // jobs / progress / wait / cancel [name]: the job of a model or all the jobs
+    vector<modelSlot*> tabModels;
+    if (m_tabCmd.size() > 1)
+    {
+        modelSlot *model = findModel(m_tabCmd[1]);
+        if (model && model->job)
+            tabModels.push_back(model);
+    }
+    else
+    {
+        for (map<string, modelSlot*>::iterator it = m_tabModels.begin(); it != m_tabModels.end(); ++it)
+            if (it->second->job)
+                tabModels.push_back(it->second);
+    }
+    if (tabModels.empty())
+        cout << "no learning job" << endl;
+    return tabModels;
+}
+
+multilayerPerceptron *mimetik::computeNetwork(shared_ptr<multilayerPerceptron> &snapshot)
+{
+    if (!m_model->job)
+        return m_mlp;
+
+    snapshot = m_mlp->getSnapshot();
+    if (!snapshot)
+        cout << "no snapshot of the learning job yet" << endl;
+    return snapshot.get();
+}
+
+void mimetik::joinJob(modelSlot *model, const bool block)
+{
+    if (!model->job || (model->job->state != JOB_DONE && !block))
+        return;
+
+    shared_ptr<learningJob> job = model->job;
+    waitJob(job.get());
+    model->job.reset();
+    model->mlp->setLearningCallback(NULL);
+    model->mlp->setSnapshotRate(0);
+    if (m_profiling && model == m_model)
+        model->mlp->setProfiler(&m_profiler);
+    cout << "[" << model->name << "] done: " << job->command << " (" << model->mlp->getStats().nbEpoch - job->firstEpoch
+         << " epochs, RMS error = " << model->mlp->getStats().learningError << ")" << endl;
+}
+
+void mimetik::waitJob(learningJob *job)
+{
+    unique_lock<mutex> lock(job->jobMutex);
+    job->done.wait(lock, [job] { return job->state == JOB_DONE; });
+}
+
+void mimetik::jobProgress(const learningStats &stats, void *userData)
+{
+    learningJob *job = (learningJob *) userData;
+    lock_guard<mutex> lock(job->jobMutex);
+    job->stats = stats;
+}
+
 bool mimetik::doHelp()
 {
     cout << "Mimetik by Lounis Bellabes (MIT License)" << endl;
     cout << "usage:" << endl;
-    cout << "\t" << "network nbLayer1 nbLayer2 ... - Create neural network layers" << endl;
+    cout << "\t" << "network [name] nbLayer1 nbLayer2 ... - Create neural network layers (name: new model, becomes the current one)" << endl;
+    cout << "\t" << "use name / models / drop name - Select the current model, list the models, delete a model" << endl;
     cout << "\t" << "loadTrainingSet trainingset.txt - Load training set from file" << endl;
+    cout << "\t" << "saveTrainingSet trainingset.bin - Save training set in binary file" << endl;
     cout << "\t" << "setEta eta - Set learning rate factor [0,1] (default = 0.5)" << endl;
     cout << "\t" << "setAlpha alpha - Set momentum factor [0,1] (default = 0.9)" << endl;
-    cout << "\t" << "learning limit verbose(booleen) randomOrder(booleen) - Start learning" << endl;
+    cout << "\t" << "learning limit verbose(booleen) randomOrder(booleen) [&] - Start learning (& : in background)" << endl;
+    cout << "\t" << "jobs / progress / wait / cancel [name] - Background learning status, progress, wait for the end or stop" << endl;
+    cout << "\t" << "setSnapshotRate nbEpoch - Epochs between two snapshots used by compute during a background learning (default = 10)" << endl;
     cout << "\t" << "compute input1 input2 ... - Compute outputs" << endl;
     cout << "\t" << "computeFile fileIn fileOut - Compute a file" << endl;
     cout << "\t" << "saveState filename - Save neural network state in binary file" << endl;
     cout << "\t" << "saveStateText filename.txt - Load neural network state in text file" << endl;
-    cout << "\t" << "loadState filename - Load neural network state from binary file" << endl;
+    cout << "\t" << "loadState [name] filename - Load neural network state from binary file (name: in the model name)" << endl;
     cout << "\t" << "loadStateText filename.txt - Load neural network state from text file" << endl;
+    cout << "\t" << "prune sparsity fineTuneEpochs verbose(booleen) - Prune the smallest weights" << endl;
+    cout << "\t" << "distill teacherModel nbLayer1 nbLayer2 ... [limit nbEpoch] [generated nbInputs] - Train a smaller network on the outputs of a teacher" << endl;
+    cout << "\t" << "exportCpp model.bin net.hpp - Generate a standalone c++ header computing the outputs" << endl;
+    cout << "\t" << "stats on|off|reset|rate maxReportsPerSecond - Display or configure learning statistics" << endl;
+    cout << "\t" << "cache limit megabytes|sidecar on|off|clear - Display or configure the training set cache" << endl;
+    cout << "\t" << "threads nbThreads [pin] - Workers of the thread pool shared by all the parallel commands (no argument: statistics)" << endl;
+    cout << "\t" << "profile on|off|reset|json file.json - Hardware counters of learning and computeFile" << endl;
+    cout << "\t" << "perceptron nbInput [nbOutput] [multiclass] - Create the linear model of the current model" << endl;
+    cout << "\t" << "perceptronLearning trainingset.txt [limit] [pocket(booleen)] [verbose(booleen)] - Load a [perceptron] file and learn" << endl;
+    cout << "\t" << "perceptronCompute input1 input2 ... / perceptronComputeFile fileIn [fileOut] - Compute with the perceptron" << endl;
+    cout << "\t" << "perceptronSave weights.txt / perceptronLoad weights.txt - Save or load the perceptron weights" << endl;
+    cout << "\t" << "pipeline nbStages [microBatchSize] [nbMicroBatch] / split nbLayer1 ... / off - Pipeline-parallel layers (no argument: utilization)" << endl;
+    cout << "\t" << "precision double|bfloat16|float16 - Storage of the weights, momentum and activations during learning" << endl;
+    cout << "\t" << "accumulation budgetMegabytes [nbMicroBatch] / off - Learn by batches: micro-batches sized from the budget, one update per nbMicroBatch" << endl;
+    cout << "\t" << "partialFit samples.txt [nbPass] / replay size [ratio] - Continue learning on new samples (current weights, replay of past samples)" << endl;
+    cout << "\t" << "cascade perceptron|model [threshold] / off / reset - Compute with a fast stage first (low margin: network of the current model)" << endl;
+    cout << "\t" << "calibrate validation.txt accuracy - Cascade threshold routing the fewest samples to the network for this accuracy" << endl;
     cout << "\t" << "execute script.mimetik - Execute mimetik script" << endl;
     cout << "\t" << "exit - Quit the software" << endl << endl;
     cout << "examples:" << endl;
     cout << "\t" << "network 2 10 5 1" << endl;
+    cout << "\t" << "network small 2 4 1" << endl;
+    cout << "\t" << "use default" << endl;
     cout << "\t" << "loadTrainingSet trainingset.txt" << endl;
+    cout << "\t" << "saveTrainingSet trainingset.bin" << endl;
     cout << "\t" << "setEta 0.5" << endl;
     cout << "\t" << "setAlpha 0.9" << endl;
     cout << "\t" << "learning 5000 true false" << endl;
+    cout << "\t" << "learning 5000 &" << endl;
+    cout << "\t" << "progress" << endl;
     cout << "\t" << "compute 0.5 0.1" << endl;
     cout << "\t" << "computeFile fileIn.txt" << endl;
     cout << "\t" << "saveState weights.bin" << endl;
     cout << "\t" << "saveStateText weights.txt" << endl;
     cout << "\t" << "loadState weights.bin" << endl;
+    cout << "\t" << "loadState teacher weights.bin" << endl;
     cout << "\t" << "loadStateText weights.txt" << endl;
+    cout << "\t" << "prune 0.9 100" << endl;
+    cout << "\t" << "distill weights.bin 4 10 4 limit 5000 generated 1000" << endl;
+    cout << "\t" << "exportCpp weights.bin net.hpp" << endl;
+    cout << "\t" << "stats on" << endl;
+    cout << "\t" << "cache sidecar on" << endl;
+    cout << "\t" << "threads 4 pin" << endl;
+    cout << "\t" << "profile on" << endl;
+    cout << "\t" << "perceptron 8" << endl;
+    cout << "\t" << "perceptronLearning perceptron_7LED_odd_even.txt" << endl;
+    cout << "\t" << "perceptronCompute 1 0 1 1 0 0 0 0" << endl;
+    cout << "\t" << "pipeline 4 16 8" << endl;
+    cout << "\t" << "precision bfloat16" << endl;
+    cout << "\t" << "accumulation 64 8" << endl;
+    cout << "\t" << "partialFit chunk.txt 2" << endl;
+    cout << "\t" << "cascade small" << endl;
+    cout << "\t" << "calibrate validation.txt 0.99" << endl;
     cout << "\t" << "execute script.mimetik" << endl;
     return true;
 }
@@ -28,6 +28,74 @@
 #define MIMETIK_H
 
 #include "multilayerPerceptron.h"
+#include "perceptron.h"
+#include "cascadeModel.h"
+#include "perfProfiler.h"
+#include "threadPool.h"
+#include "trainingSetCache.h"
+#include <map>
+#include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+enum jobState
+{
+    JOB_QUEUED,                                         // waiting for a thread of the pool
+    JOB_CANCELLED,                                      // cancelled while queued: will not start
+    JOB_RUNNING,
+    JOB_DONE                                            // finished, not yet reported
+};
+
+// background learning (learning ... &): shared by the model and the task queued in the pool
+struct learningJob
+{
+    multilayerPerceptron* mlp;
+    atomic<int> state;
+    bool result;
+    string command;
+    int limit;
+    long firstEpoch;                                    // epochs learned before the job (stats are cumulative)
+    mutex jobMutex;                                     // guards stats and the end of the job
+    condition_variable done;
+    learningStats stats;                                // last progress report of the job
+};
+
+// named neural network (network name ..., use name)
+struct modelSlot
+{
+    string name;
+    multilayerPerceptron* mlp;
+    multiClassPerceptron* perceptron;                   // NULL: no linear model (perceptron nbInput ...)
+    string cascadeFast;                                 // compute through a cascade: "perceptron" or the model of the fast network
+    cascadeModel cascade;
+    string trainingSetFile;                             // last training set file loaded
+    shared_ptr<learningJob> job;                        // NULL: no job, the network can be modified
+};
+
+class mimetik;
+
+// results of compute in quiet mode
+enum outputFormat
+{
+    OUTPUT_CSV,                                         // one line per sample: output1,output2,...
+    OUTPUT_JSON,                                        // one JSON array per line
+    OUTPUT_BINARY                                       // nbOutputs doubles per sample (host byte order)
+};
+
+struct commandEntry
+{
+    bool (mimetik::*handler)();
+    bool duringJob;                                     // allowed while a learning job runs on the current model
+};
+
+// line of a script compiled by executeScript
+struct scriptCommand
+{
+    vector<string> tabArgs;
+    const commandEntry *command;                        // NULL: unknown command
+    vector<double> tabValues;                           // compute: inputs
+};
 
 class mimetik
 {
@@ -36,11 +104,30 @@ public:
     ~mimetik();
     bool executeCommandLine(string cmd);
     bool executeScript(const string filename);
+    void setQuiet(const outputFormat format);           // no message unless a command fails (stderr), compute writes results
+    bool computeStream(istream &input);                 // compute each line of input (quiet: results in the output format)
 private:
-    multilayerPerceptron* m_mlp;        // neural network
-    vector<string> m_tabCmd;            // command arguments
+    map<string, modelSlot*> m_tabModels;                // named neural networks
+    modelSlot* m_model;                                 // current model (use name)
+    multilayerPerceptron* m_mlp;                        // neural network of the current model
+    vector<string> m_tabCmd;                            // command arguments
+    perfProfiler m_profiler;                            // hardware counters of learning and computeFile (current model)
+    bool m_profiling;
+    vector<double> m_tabInputs;                         // compute buffers, reused by each command
+    vector<double> m_tabOutputs;
+    int m_snapshotRate;                                 // epochs between two snapshots served to compute during a job
+    bool m_quiet;                                       // batch mode (mimetik --batch)
+    outputFormat m_outputFormat;
+    string m_results;                                   // quiet: compute results not yet written to stdout
+    ostringstream m_messages;                           // quiet: messages of the current command (cout)
+    streambuf *m_coutBuffer;                            // quiet: cout before redirection
+    static const map<string, commandEntry> &commandTable();
+    static void splitCommand(const string &cmd, vector<string> &tabArgs);
+    bool runCommand(const commandEntry *command);       // arguments in m_tabCmd
+    int executeComputeRun(const vector<scriptCommand> &tabPlan, const int first);  // number of compute commands run in one batch
     bool doNetwork();
     bool doLoadTrainingSet();
+    bool doSaveTrainingSet();
     bool doSetEta();                    // set learning rate factor [0,1]
     bool doSetAlpha();                  // set momentum factor [0,1]
     bool doLearning();
@@ -50,8 +137,53 @@ private:
     bool doSaveStateText();
     bool doLoadState();
     bool doLoadStateText();
+    bool doPrune();                     // prune the smallest weights and fine-tune
+    bool doDistill();                   // train a smaller network on the outputs of a teacher network
+    bool doExportCpp();                 // generate a standalone c++ inference header
+    bool doStats();                     // learning telemetry
+    bool doProfile();                   // hardware performance counters
+    bool doJobs();                      // background learning jobs status
+    bool doWait();                      // wait for the end of the background learning
+    bool doProgress();                  // epoch and error of the background learning
+    bool doCancel();                    // stop the background learning at the end of the epoch
+    bool doSetSnapshotRate();
+    bool doUse();                       // select the current model
+    bool doModels();                    // list the models
+    bool doDrop();                      // delete a model
+    bool doCache();                     // training set cache
+    bool doThreads();                   // thread pool
+    bool doPerceptron();                // linear model of the current model
+    bool doPerceptronLearning();
+    bool doPerceptronCompute();
+    bool doPerceptronComputeFile();
+    bool doPerceptronSave();
+    bool doPerceptronLoad();
+    bool doPipeline();                  // pipeline-parallel layers
+    bool doPrecision();                 // mixed-precision learning
+    bool doAccumulation();              // gradient accumulation within a memory budget
+    bool doPartialFit();                // streaming: learn new samples from the current weights
+    bool doCascade();                   // fast stage in front of the network of the current model
+    bool doCalibrate();                 // cascade threshold for a target accuracy
     bool doExecute();                   // execute a mimetik script
     bool doHelp();
+    double measureLatency(multilayerPerceptron *mlp);   // average time in microseconds to compute one sample
+    double measureBatchLatency(multilayerPerceptron *mlp, const vector<double> &tabInputs, vector<double> &tabOutputs);  // same with computeBatch
+    bool setCascadeStages(multilayerPerceptron *mlp, shared_ptr<multilayerPerceptron> &fastSnapshot);
+    bool computeRows(multilayerPerceptron *mlp, const double *tabInputs, double *tabOutputs, const int nbSample);  // through the cascade if any
+    multiClassPerceptron *currentPerceptron();          // perceptron of the current model (NULL: message)
+    modelSlot *findModel(const string &name, const bool verbose = true);
+    modelSlot *createModel(const string &name, multilayerPerceptron *mlp);
+    void setNetwork(modelSlot *model, multilayerPerceptron *mlp);   // replace the network of a model
+    void useModel(modelSlot *model);
+    bool isBusy(modelSlot *model, const string &command);           // a job owns the network of the model
+    void cancelJob(modelSlot *model);
+    vector<modelSlot*> jobModels();                     // target of jobs / progress / wait / cancel [name]
+    multilayerPerceptron *computeNetwork(shared_ptr<multilayerPerceptron> &snapshot);  // network or, during a job, its last snapshot
+    void joinJob(modelSlot *model, const bool block);   // collect the job once finished (block: wait for the end)
+    static void waitJob(learningJob *job);
+    void writeResults(const double *tabOutputs, const int nbSample, const int nbOutput);
+    void flushResults();
+    static void jobProgress(const learningStats &stats, void *userData);
 };
 
 #endif // MIMETIK_H
@@ -0,0 +1,164 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#include "mlpAccumulation.h"
+#include "multilayerPerceptron.h"
+#include <algorithm>
+
+static const size_t MAX_MICRO_BATCH_SIZE = 1 << 20;     // large budgets: micro-batch size still fits in an int
+
+mlpAccumulation::mlpAccumulation()
+{
+    m_memoryBudget = 0;
+    m_microBatchSize = 1;
+    m_nbMicroBatch = 1;
+}
+
+// bytes of one sample of a micro-batch: outputs of all the layers, errors of the layers with weights
+static size_t sampleBytes(const vector<int> &tabNbNeurons)
+{
+    size_t nbDouble = tabNbNeurons[0];
+    for (int i=1; i < tabNbNeurons.size(); i++)
+        nbDouble += 2 * (size_t) tabNbNeurons[i];
+    return nbDouble * sizeof(double);
+}
+
+static size_t gradientBytes(const vector<int> &tabNbNeurons)
+{
+    size_t nbWeight = 0;
+    for (int i=1; i < tabNbNeurons.size(); i++)
+        nbWeight += (size_t) tabNbNeurons[i] * tabNbNeurons[i-1];
+    return nbWeight * sizeof(double);
+}
+
+size_t mlpAccumulation::requiredBudget(const vector<int> &tabNbNeurons, const int microBatchSize)
+{
+    return gradientBytes(tabNbNeurons) + microBatchSize * sampleBytes(tabNbNeurons);
+}
+
+bool mlpAccumulation::configure(const vector<int> &tabNbNeurons, const size_t memoryBudget, const int nbMicroBatch)
+{
+    if (nbMicroBatch < 1)
+    {
+        cout << "Error: the number of micro-batches per update must be >= 1" << endl;
+        return false;
+    }
+    if (memoryBudget < requiredBudget(tabNbNeurons))
+    {
+        cout << "Error: a memory budget of " << memoryBudget << " bytes is below the minimum of " << requiredBudget(tabNbNeurons)
+             << " bytes for this network (gradients and one sample)" << endl;
+        return false;
+    }
+
+    m_memoryBudget = memoryBudget;
+    m_microBatchSize = (int) min(MAX_MICRO_BATCH_SIZE, (memoryBudget - gradientBytes(tabNbNeurons)) / sampleBytes(tabNbNeurons));
+    m_nbMicroBatch = nbMicroBatch;
+    m_tabOutputs.clear();
+    m_tabErrors.clear();
+    m_tabGradients.clear();
+    return true;
+}
+
+int mlpAccumulation::getMicroBatchSize() const
+{
+    return m_microBatchSize;
+}
+
+int mlpAccumulation::getNbMicroBatch() const
+{
+    return m_nbMicroBatch;
+}
+
+size_t mlpAccumulation::getMemoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+size_t mlpAccumulation::getBytes() const
+{
+    size_t bytes = 0;
+    for (int i=0; i < m_tabOutputs.size(); i++)
+        bytes += (m_tabOutputs[i].capacity() + m_tabErrors[i].capacity() + m_tabGradients[i].capacity()) * sizeof(double);
+    return bytes;
+}
+
+double mlpAccumulation::learnEpoch(multilayerPerceptron &mlp)
+{
+    vector<layer> &network = mlp.m_neuralNetwork;
+    const vector<traningSetMlp> &trainingSet = *mlp.m_trainingSet;
+    const vector<int> &tabOrder = mlp.m_tabOrder;
+    int nbLayer = network.size();
+    int nbSample = trainingSet.size();
+    int nbInput = network[0].tabNeurons.size();
+    int nbOutput = network[nbLayer-1].tabNeurons.size();
+
+    // one micro-batch at a time: its buffers are reused by the next one, kept from one epoch to the next
+    const int blockSize = min(m_microBatchSize, max(1, nbSample));
+    m_tabOutputs.resize(nbLayer);
+    m_tabErrors.resize(nbLayer);
+    m_tabGradients.resize(nbLayer);
+    for (int i=0; i < nbLayer; i++)
+    {
+        size_t size = network[i].tabNeurons.size() * (size_t) blockSize;
+        m_tabOutputs[i].resize(size);
+        m_tabErrors[i].resize(i == 0 ? 0 : size);
+        m_tabGradients[i].resize(i == 0 ? 0 : network[i].tabNeurons.size() * network[i-1].tabNeurons.size());
+    }
+
+    long batchSize = (long) blockSize * m_nbMicroBatch;
+    double error = 0;
+    for (long first=0; first < nbSample; first += batchSize)
+    {
+        int nbInBatch = (int) min(batchSize, nbSample - first);
+        for (int i=1; i < nbLayer; i++)
+            fill(m_tabGradients[i].begin(), m_tabGradients[i].end(), 0);
+
+        for (int m=first; m < first + nbInBatch; m += blockSize)
+        {
+            int count = min(blockSize, (int) (first + nbInBatch - m));
+            loadMicroBatch(trainingSet, &tabOrder[m], nbInput, m_tabOutputs[0].data(), count, blockSize);
+            for (int i=1; i < nbLayer; i++)
+                forwardLayer(network[i], network[i-1].tabNeurons.size(), m_tabOutputs[i-1].data(), m_tabOutputs[i].data(), count, blockSize);
+            error += outputErrors(trainingSet, &tabOrder[m], nbOutput, m_tabOutputs[nbLayer-1].data(), m_tabErrors[nbLayer-1].data(), count, blockSize);
+
+            for (int i=nbLayer-1; i >= 1; i--)
+            {
+                int nbPrevious = network[i-1].tabNeurons.size();
+                accumulateGradient(network[i].tabNeurons.size(), nbPrevious, m_tabOutputs[i-1].data(), m_tabErrors[i].data(),
+                                   m_tabGradients[i].data(), count, blockSize);
+                if (i > 1)
+                    backwardLayer(network[i], nbPrevious, m_tabOutputs[i-1].data(), m_tabErrors[i].data(), m_tabErrors[i-1].data(), count, blockSize);
+            }
+        }
+
+        // one step for the whole batch: mean gradient, momentum
+        for (int i=1; i < nbLayer; i++)
+            applyGradient(network[i], network[i-1].tabNeurons.size(), m_tabGradients[i].data(), mlp.m_eta / nbInBatch, mlp.m_alpha);
+    }
+
+    return error / max(1, nbSample);
+}
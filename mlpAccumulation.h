@@ -0,0 +1,62 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+#ifndef MLPACCUMULATION_H
+#define MLPACCUMULATION_H
+
+#include <vector>
+#include <stddef.h>
+using namespace std;
+
+class multilayerPerceptron;
+
+// gradient accumulation: the samples are learned by micro-batches whose activations and errors fit in a memory budget.
+// The gradients of nbMicroBatch micro-batches are accumulated, then one momentum step applies their mean: the effective
+// batch is microBatchSize x nbMicroBatch samples, the memory does not depend on it.
+// Budget = gradients (one double per weight) + microBatchSize x (outputs of all the layers + errors of the layers with weights).
+class mlpAccumulation
+{
+public:
+    mlpAccumulation();
+    bool configure(const vector<int> &tabNbNeurons, const size_t memoryBudget, const int nbMicroBatch);
+    int getMicroBatchSize() const;                      // derived from the budget
+    int getNbMicroBatch() const;                        // micro-batches per weight update
+    size_t getMemoryBudget() const;                     // bytes
+    size_t getBytes() const;                            // buffers allocated (micro-batches are not larger than the training set)
+    double learnEpoch(multilayerPerceptron &mlp);       // mean RMS error of the samples (order: m_tabOrder of the network)
+    static size_t requiredBudget(const vector<int> &tabNbNeurons, const int microBatchSize = 1);   // bytes for micro-batches of this size
+
+private:
+    size_t m_memoryBudget;
+    int m_microBatchSize;
+    int m_nbMicroBatch;
+    vector< vector<double> > m_tabOutputs;              // activations of one micro-batch, per layer
+    vector< vector<double> > m_tabErrors;
+    vector< vector<double> > m_tabGradients;            // per layer, nbNeurons x nbPrevious, accumulated over the micro-batches
+};
+
+#endif // MLPACCUMULATION_H
@@ -0,0 +1,123 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "mlpArena.h"
+#include <stdint.h>
+#include <string.h>
+
+static const size_t ALIGNMENT = 64 / sizeof(double);    // doubles per cache line
+
+mlpArena::mlpArena()
+{
+    m_base = 0;
+    m_used = 0;
+}
+
+mlpArena::mlpArena(const mlpArena &other)
+{
+    m_base = 0;
+    m_used = 0;
+    *this = other;
+}
+
+mlpArena &mlpArena::operator=(const mlpArena &other)
+{
+    if (this == &other)
+        return *this;
+
+    // the copy may be aligned differently: copy from the aligned start so that the block offsets are kept
+    reset();
+    reserve(other.capacity());
+    if (other.m_used > 0)
+        memcpy(data(), other.data(), sizeof(double) * other.m_used);
+    m_used = other.m_used;
+    return *this;
+}
+
+size_t mlpArena::alignedBase() const
+{
+    uintptr_t address = (uintptr_t) m_buffer.data();
+    size_t misalignment = (address / sizeof(double)) % ALIGNMENT;
+    return misalignment == 0 ? 0 : ALIGNMENT - misalignment;
+}
+
+void mlpArena::reserve(const size_t nbDouble)
+{
+    if (nbDouble <= capacity())
+        return;
+
+    // keep the used blocks, their addresses change
+    vector<double> buffer(nbDouble + ALIGNMENT, 0);
+    if (m_used > 0)
+    {
+        m_buffer.swap(buffer);
+        memcpy(&m_buffer[alignedBase()], &buffer[m_base], sizeof(double) * m_used);
+    }
+    else
+        m_buffer.swap(buffer);
+    m_base = alignedBase();
+}
+
+double *mlpArena::allocate(const size_t nbDouble)
+{
+    size_t size = blockSize(nbDouble);
+    if (m_used + size > capacity())
+        return NULL;
+
+    double *block = data() + m_used;
+    m_used += size;
+    return block;
+}
+
+void mlpArena::reset()
+{
+    m_used = 0;
+}
+
+double *mlpArena::data()
+{
+    return m_buffer.empty() ? NULL : &m_buffer[m_base];
+}
+
+const double *mlpArena::data() const
+{
+    return m_buffer.empty() ? NULL : &m_buffer[m_base];
+}
+
+size_t mlpArena::capacity() const
+{
+    return m_buffer.empty() ? 0 : m_buffer.size() - ALIGNMENT;
+}
+
+size_t mlpArena::used() const
+{
+    return m_used;
+}
+
+size_t mlpArena::blockSize(const size_t nbDouble)
+{
+    return (nbDouble + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
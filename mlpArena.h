@@ -0,0 +1,59 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef MLPARENA_H
+#define MLPARENA_H
+
+#include <vector>
+#include <stddef.h>
+using namespace std;
+
+// scratch memory of a network: one buffer sized once from the topology, cut into 64-byte aligned blocks.
+// reset() frees all the blocks at once and keeps the memory: the next blocks of the same size do not allocate.
+class mlpArena
+{
+public:
+    mlpArena();
+    mlpArena(const mlpArena &other);                    // same blocks at the same offsets (pointers must be rebased)
+    mlpArena &operator=(const mlpArena &other);
+    void reserve(const size_t nbDouble);                // grow the buffer (invalidates the blocks), no-op if large enough
+    double *allocate(const size_t nbDouble);            // next block, NULL if the arena is full
+    void reset();
+    double *data();                                     // first block
+    const double *data() const;
+    size_t capacity() const;                            // number of doubles
+    size_t used() const;                                // number of doubles, padding included
+
+    static size_t blockSize(const size_t nbDouble);     // number of doubles used by a block (multiple of 64 bytes)
+
+private:
+    vector<double> m_buffer;
+    size_t m_base;                                      // index of the first 64-byte aligned double of m_buffer
+    size_t m_used;
+    size_t alignedBase() const;
+};
+
+#endif // MLPARENA_H
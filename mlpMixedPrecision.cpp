@@ -0,0 +1,505 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "mlpMixedPrecision.h"
+#include "multilayerPerceptron.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// SSE2 is part of x86-64: bfloat16 conversions and float kernels; float16 uses F16C (checked at run time)
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MIXED_PRECISION_X86
+#include <immintrin.h>
+#endif
+
+static const int CONVERT_CHUNK = 256;                   // weights converted to float at a time (1 KB on the stack, in L1)
+
+static uint16_t bfloat16FromFloat(const float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    if ((bits & 0x7FFFFFFF) > 0x7F800000)
+        return (bits >> 16) | 0x40;                     // NaN stays a quiet NaN
+    bits += 0x7FFF + ((bits >> 16) & 1);
+    return bits >> 16;
+}
+
+static float bfloat16ToFloat(const uint16_t value)
+{
+    uint32_t bits = (uint32_t) value << 16;
+    float result;
+    memcpy(&result, &bits, sizeof result);
+    return result;
+}
+
+static uint16_t float16FromFloat(const float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int floatExponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (floatExponent == 0xFF)
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);  // infinity or NaN
+    int exponent = floatExponent - 127 + 15;
+    if (exponent >= 31)
+        return sign | 0x7C00;                           // too large: infinity
+    if (exponent <= 0)
+    {
+        // subnormal half: mantissa with its implicit bit, shifted to units of 2^-24
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return sign | half;
+    }
+
+    // a carry out of the mantissa increments the exponent (up to infinity)
+    uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | half;
+}
+
+static float float16ToFloat(const uint16_t value)
+{
+    uint32_t sign = (uint32_t) (value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F)
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    else if (exponent != 0)
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        bits = sign;
+    else
+    {
+        // subnormal half: normalized in float
+        int shift = 0;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            shift++;
+        }
+        bits = sign | ((uint32_t) (113 - shift) << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    float result;
+    memcpy(&result, &bits, sizeof result);
+    return result;
+}
+
+#ifdef MIXED_PRECISION_X86
+// the tail goes through the same instruction (padded): no call to non-VEX code while the upper ymm halves are in use
+__attribute__((target("avx,f16c")))
+static void float16ToFloatF16c(const uint16_t *tabValues, float *tabFloats, const size_t nbValue)
+{
+    size_t i = 0;
+    for (; i + 8 <= nbValue; i += 8)
+        _mm256_storeu_ps(tabFloats + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (tabValues + i))));
+    if (i < nbValue)
+    {
+        uint16_t tabIn[8] = {0};
+        float tabOut[8];
+        memcpy(tabIn, tabValues + i, (nbValue - i) * sizeof(uint16_t));
+        _mm256_storeu_ps(tabOut, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) tabIn)));
+        memcpy(tabFloats + i, tabOut, (nbValue - i) * sizeof(float));
+    }
+    _mm256_zeroupper();
+}
+
+__attribute__((target("avx,f16c")))
+static void float16FromFloatF16c(const float *tabFloats, uint16_t *tabValues, const size_t nbValue)
+{
+    size_t i = 0;
+    for (; i + 8 <= nbValue; i += 8)
+        _mm_storeu_si128((__m128i *) (tabValues + i), _mm256_cvtps_ph(_mm256_loadu_ps(tabFloats + i), _MM_FROUND_TO_NEAREST_INT));
+    if (i < nbValue)
+    {
+        float tabIn[8] = {0};
+        uint16_t tabOut[8];
+        memcpy(tabIn, tabFloats + i, (nbValue - i) * sizeof(float));
+        _mm_storeu_si128((__m128i *) tabOut, _mm256_cvtps_ph(_mm256_loadu_ps(tabIn), _MM_FROUND_TO_NEAREST_INT));
+        memcpy(tabValues + i, tabOut, (nbValue - i) * sizeof(uint16_t));
+    }
+    _mm256_zeroupper();
+}
+#endif
+
+bool hasF16c()
+{
+#ifdef MIXED_PRECISION_X86
+    static const bool f16c = __builtin_cpu_supports("f16c") && __builtin_cpu_supports("avx");
+    return f16c;
+#else
+    return false;
+#endif
+}
+
+const char *precisionName(const mlpPrecision precision)
+{
+    switch (precision)
+    {
+    case PRECISION_BFLOAT16:
+        return "bfloat16";
+    case PRECISION_FLOAT16:
+        return "float16";
+    default:
+        return "double";
+    }
+}
+
+void convertToFloat(const uint16_t *tabValues, float *tabFloats, const size_t nbValue, const mlpPrecision precision)
+{
+    size_t i = 0;
+    if (precision == PRECISION_FLOAT16)
+    {
+#ifdef MIXED_PRECISION_X86
+        if (hasF16c())
+        {
+            float16ToFloatF16c(tabValues, tabFloats, nbValue);
+            return;
+        }
+#endif
+        for (; i < nbValue; i++)
+            tabFloats[i] = float16ToFloat(tabValues[i]);
+        return;
+    }
+
+#ifdef MIXED_PRECISION_X86
+    // bfloat16: the 16 bits are the high half of the float
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= nbValue; i += 8)
+    {
+        __m128i values = _mm_loadu_si128((const __m128i *) (tabValues + i));
+        _mm_storeu_si128((__m128i *) (tabFloats + i), _mm_unpacklo_epi16(zero, values));
+        _mm_storeu_si128((__m128i *) (tabFloats + i + 4), _mm_unpackhi_epi16(zero, values));
+    }
+#endif
+    for (; i < nbValue; i++)
+        tabFloats[i] = bfloat16ToFloat(tabValues[i]);
+}
+
+void convertFromFloat(const float *tabFloats, uint16_t *tabValues, const size_t nbValue, const mlpPrecision precision)
+{
+    size_t i = 0;
+    if (precision == PRECISION_FLOAT16)
+    {
+#ifdef MIXED_PRECISION_X86
+        if (hasF16c())
+        {
+            float16FromFloatF16c(tabFloats, tabValues, nbValue);
+            return;
+        }
+#endif
+        for (; i < nbValue; i++)
+            tabValues[i] = float16FromFloat(tabFloats[i]);
+        return;
+    }
+
+#ifdef MIXED_PRECISION_X86
+    // bfloat16: round to nearest even on the 16 low bits; the arithmetic shift keeps the packs saturation exact
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i bias = _mm_set1_epi32(0x7FFF);
+    const __m128i quiet = _mm_set1_epi32(0x40);
+    for (; i + 8 <= nbValue; i += 8)
+    {
+        __m128i tabHalves[2];
+        for (int h=0; h < 2; h++)
+        {
+            __m128 floats = _mm_loadu_ps(tabFloats + i + 4 * h);
+            __m128i bits = _mm_castps_si128(floats);
+            __m128i rounded = _mm_add_epi32(bits, _mm_add_epi32(bias, _mm_and_si128(_mm_srli_epi32(bits, 16), one)));
+            __m128i nan = _mm_castps_si128(_mm_cmpunord_ps(floats, floats));
+            rounded = _mm_or_si128(_mm_andnot_si128(nan, rounded), _mm_and_si128(nan, _mm_or_si128(bits, _mm_slli_epi32(quiet, 16))));
+            tabHalves[h] = _mm_srai_epi32(rounded, 16);
+        }
+        _mm_storeu_si128((__m128i *) (tabValues + i), _mm_packs_epi32(tabHalves[0], tabHalves[1]));
+    }
+#endif
+    for (; i < nbValue; i++)
+        tabValues[i] = bfloat16FromFloat(tabFloats[i]);
+}
+
+// float kernels on a converted chunk
+static float dotFloat(const float *tabInputs, const float *tabWeights, const int nbWeight)
+{
+    int k = 0;
+    float sum = 0;
+#ifdef MIXED_PRECISION_X86
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (; k + 8 <= nbWeight; k += 8)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(tabInputs + k), _mm_loadu_ps(tabWeights + k)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(tabInputs + k + 4), _mm_loadu_ps(tabWeights + k + 4)));
+    }
+    float tabLanes[4];
+    _mm_storeu_ps(tabLanes, _mm_add_ps(sum0, sum1));
+    sum = (tabLanes[0] + tabLanes[1]) + (tabLanes[2] + tabLanes[3]);
+#endif
+    for (; k < nbWeight; k++)
+        sum += tabInputs[k] * tabWeights[k];
+    return sum;
+}
+
+static void addScaledFloat(float *tabSums, const float *tabWeights, const float factor, const int nbWeight)
+{
+    int k = 0;
+#ifdef MIXED_PRECISION_X86
+    __m128 scale = _mm_set1_ps(factor);
+    for (; k + 4 <= nbWeight; k += 4)
+        _mm_storeu_ps(tabSums + k, _mm_add_ps(_mm_loadu_ps(tabSums + k), _mm_mul_ps(scale, _mm_loadu_ps(tabWeights + k))));
+#endif
+    for (; k < nbWeight; k++)
+        tabSums[k] += factor * tabWeights[k];
+}
+
+mlpMixedPrecision::mlpMixedPrecision(const mlpPrecision precision)
+{
+    m_precision = precision;
+}
+
+mlpPrecision mlpMixedPrecision::getPrecision() const
+{
+    return m_precision;
+}
+
+size_t mlpMixedPrecision::getBytes() const
+{
+    size_t bytes = 0;
+    for (int i=0; i < m_tabMaster.size(); i++)
+    {
+        bytes += (m_tabWeights[i].capacity() + m_tabMomentum[i].capacity() + m_tabActivations[i].capacity()) * sizeof(uint16_t);
+        bytes += (m_tabMaster[i].capacity() + m_tabOutputs[i].capacity() + m_tabErrors[i].capacity()) * sizeof(float);
+    }
+    return bytes;
+}
+
+double mlpMixedPrecision::learnEpoch(multilayerPerceptron &mlp)
+{
+    load(mlp);
+    const vector<traningSetMlp> &trainingSet = *mlp.m_trainingSet;
+    double learningError = 0;
+    for (int np=0; np < trainingSet.size(); np++)
+        learningError += learnSample(mlp, trainingSet[mlp.m_tabOrder[np]]);
+    store(mlp);
+    return learningError / max(1, (int) trainingSet.size());
+}
+
+void mlpMixedPrecision::load(const multilayerPerceptron &mlp)
+{
+    const vector<layer> &network = mlp.m_neuralNetwork;
+    int nbLayer = network.size();
+    m_tabWeights.resize(nbLayer);
+    m_tabMomentum.resize(nbLayer);
+    m_tabMaster.resize(nbLayer);
+    m_tabActivations.resize(nbLayer);
+    m_tabOutputs.resize(nbLayer);
+    m_tabErrors.resize(nbLayer);
+
+    float tabChunk[CONVERT_CHUNK];
+    for (int i=0; i < nbLayer; i++)
+    {
+        int nbNeuron = network[i].tabNeurons.size();
+        int nbPrevious = (i == 0) ? 0 : network[i-1].tabNeurons.size();
+        size_t nbWeight = (size_t) nbNeuron * nbPrevious;
+        m_tabWeights[i].resize(nbWeight);
+        m_tabMomentum[i].resize(nbWeight);
+        m_tabMaster[i].resize(nbWeight);
+        m_tabActivations[i].resize(nbNeuron);
+        m_tabOutputs[i].resize(nbNeuron);
+        m_tabErrors[i].resize(nbNeuron);
+
+        for (int j=0; j < nbNeuron && i > 0; j++)
+        {
+            const neuron &current = network[i].tabNeurons[j];
+            float *master = &m_tabMaster[i][(size_t) j * nbPrevious];
+            for (int k=0; k < nbPrevious; k++)
+                master[k] = current.weight[k];
+            convertFromFloat(master, &m_tabWeights[i][(size_t) j * nbPrevious], nbPrevious, m_precision);
+            for (int first=0; first < nbPrevious; first += CONVERT_CHUNK)
+            {
+                int count = min(CONVERT_CHUNK, nbPrevious - first);
+                for (int k=0; k < count; k++)
+                    tabChunk[k] = current.deltaWeight[first + k];
+                convertFromFloat(tabChunk, &m_tabMomentum[i][(size_t) j * nbPrevious + first], count, m_precision);
+            }
+        }
+    }
+}
+
+void mlpMixedPrecision::store(multilayerPerceptron &mlp) const
+{
+    vector<layer> &network = mlp.m_neuralNetwork;
+    float tabChunk[CONVERT_CHUNK];
+    for (int i=1; i < network.size(); i++)
+    {
+        int nbPrevious = network[i-1].tabNeurons.size();
+        for (int j=0; j < network[i].tabNeurons.size(); j++)
+        {
+            neuron &current = network[i].tabNeurons[j];
+            const float *master = &m_tabMaster[i][(size_t) j * nbPrevious];
+            for (int k=0; k < nbPrevious; k++)
+                current.weight[k] = master[k];
+            for (int first=0; first < nbPrevious; first += CONVERT_CHUNK)
+            {
+                int count = min(CONVERT_CHUNK, nbPrevious - first);
+                convertToFloat(&m_tabMomentum[i][(size_t) j * nbPrevious + first], tabChunk, count, m_precision);
+                for (int k=0; k < count; k++)
+                    current.deltaWeight[first + k] = tabChunk[k];
+            }
+        }
+    }
+}
+
+void mlpMixedPrecision::setOutputs(const int i)
+{
+    convertFromFloat(m_tabOutputs[i].data(), m_tabActivations[i].data(), m_tabOutputs[i].size(), m_precision);
+    convertToFloat(m_tabActivations[i].data(), m_tabOutputs[i].data(), m_tabOutputs[i].size(), m_precision);
+}
+
+float mlpMixedPrecision::dot(const float *tabInputs, const uint16_t *tabWeights, const int nbWeight) const
+{
+    float tabChunk[CONVERT_CHUNK];
+    float sum = 0;
+    for (int first=0; first < nbWeight; first += CONVERT_CHUNK)
+    {
+        int count = min(CONVERT_CHUNK, nbWeight - first);
+        convertToFloat(tabWeights + first, tabChunk, count, m_precision);
+        sum += dotFloat(tabInputs + first, tabChunk, count);
+    }
+    return sum;
+}
+
+void mlpMixedPrecision::addScaled(float *tabSums, const uint16_t *tabWeights, const float factor, const int nbWeight) const
+{
+    float tabChunk[CONVERT_CHUNK];
+    for (int first=0; first < nbWeight; first += CONVERT_CHUNK)
+    {
+        int count = min(CONVERT_CHUNK, nbWeight - first);
+        convertToFloat(tabWeights + first, tabChunk, count, m_precision);
+        addScaledFloat(tabSums + first, tabChunk, factor, count);
+    }
+}
+
+void mlpMixedPrecision::updateRow(const float *tabInputs, const float error, const float eta, const float alpha, float *tabMaster,
+                                  uint16_t *tabWeights, uint16_t *tabMomentum, const int nbWeight) const
+{
+    // same update as learnSample: the momentum keeps the last step without its momentum term
+    float tabDelta[CONVERT_CHUNK];
+    for (int first=0; first < nbWeight; first += CONVERT_CHUNK)
+    {
+        int count = min(CONVERT_CHUNK, nbWeight - first);
+        convertToFloat(tabMomentum + first, tabDelta, count, m_precision);
+        for (int k=0; k < count; k++)
+        {
+            float delta = eta * (tabInputs[first + k] * error);
+            tabMaster[first + k] += delta + (alpha * tabDelta[k]);
+            tabDelta[k] = delta;
+        }
+        convertFromFloat(tabDelta, tabMomentum + first, count, m_precision);
+        convertFromFloat(tabMaster + first, tabWeights + first, count, m_precision);
+    }
+}
+
+double mlpMixedPrecision::learnSample(const multilayerPerceptron &mlp, const traningSetMlp &sample)
+{
+    int nbLayer = m_tabOutputs.size();
+
+    // inputs (a sparse example is expanded), rounded like the other activations
+    vector<float> &inputs = m_tabOutputs[0];
+    if (sample.tabExamples.empty())
+    {
+        fill(inputs.begin(), inputs.end(), 0.0f);
+        for (int p=0; p < sample.tabNonZeroIndexes.size(); p++)
+            inputs[sample.tabNonZeroIndexes[p]] = sample.tabNonZeroValues[p];
+    }
+    else
+    {
+        for (int k=0; k < inputs.size(); k++)
+            inputs[k] = sample.tabExamples[k];
+    }
+    setOutputs(0);
+
+    // forward: float sums of 16-bit weights
+    for (int i=1; i < nbLayer; i++)
+    {
+        int nbPrevious = m_tabOutputs[i-1].size();
+        for (int j=0; j < m_tabOutputs[i].size(); j++)
+        {
+            float sum = dot(m_tabOutputs[i-1].data(), &m_tabWeights[i][(size_t) j * nbPrevious], nbPrevious);
+            m_tabOutputs[i][j] = 1.0f / (1.0f + expf(-sum));
+        }
+        setOutputs(i);
+    }
+
+    double RmsError = 0;
+    const vector<float> &outputs = m_tabOutputs[nbLayer-1];
+    for (int k=0; k < outputs.size(); k++)
+    {
+        float output = outputs[k];
+        float target = sample.tabOutputTargets[k];
+        m_tabErrors[nbLayer-1][k] = (target - output) * output * (1.0f - output);
+        RmsError += (double) (target - output) * (target - output);
+    }
+    RmsError = sqrt(RmsError / (double) outputs.size());
+
+    // backward pass, from the output layer down, row by row: the 16-bit row is added to the errors of the previous layer,
+    // scaled by the error of its neuron, then updated while it is still in cache (the matrix is streamed once)
+    float eta = mlp.m_eta;
+    float alpha = mlp.m_alpha;
+    for (int i=nbLayer-1; i >= 1; i--)
+    {
+        int nbPrevious = m_tabOutputs[i-1].size();
+        vector<float> &errors = m_tabErrors[i-1];
+        if (i > 1)
+            fill(errors.begin(), errors.end(), 0.0f);
+        for (int j=0; j < m_tabOutputs[i].size(); j++)
+        {
+            size_t row = (size_t) j * nbPrevious;
+            if (i > 1)
+                addScaled(errors.data(), &m_tabWeights[i][row], m_tabErrors[i][j], nbPrevious);
+            updateRow(m_tabOutputs[i-1].data(), m_tabErrors[i][j], eta, alpha, &m_tabMaster[i][row], &m_tabWeights[i][row], &m_tabMomentum[i][row], nbPrevious);
+        }
+        if (i > 1)
+        {
+            for (int k=0; k < nbPrevious; k++)
+            {
+                float output = m_tabOutputs[i-1][k];
+                errors[k] *= output * (1.0f - output);
+            }
+        }
+    }
+    return RmsError;
+}
@@ -0,0 +1,81 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef MLPMIXEDPRECISION_H
+#define MLPMIXEDPRECISION_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+using namespace std;
+
+class multilayerPerceptron;
+struct traningSetMlp;
+
+enum mlpPrecision
+{
+    PRECISION_DOUBLE,                                   // weights, momentum and activations in double (default)
+    PRECISION_BFLOAT16,                                 // 8-bit exponent, 7-bit mantissa: range of float
+    PRECISION_FLOAT16                                   // IEEE half: 5-bit exponent, 10-bit mantissa (small updates underflow)
+};
+
+// 16-bit values <-> float, round to nearest even (SSE2 for bfloat16, F16C for float16 when the processor has it)
+void convertToFloat(const uint16_t *tabValues, float *tabFloats, const size_t nbValue, const mlpPrecision precision);
+void convertFromFloat(const float *tabFloats, uint16_t *tabValues, const size_t nbValue, const mlpPrecision precision);
+bool hasF16c();
+const char *precisionName(const mlpPrecision precision);
+
+// mixed-precision learning: the weights, momentum and activations read by each step are stored on 16 bits,
+// the dot products and the updates are computed in float on a float master copy of the weights.
+// The double weights of the network are copied in at the start of each epoch and written back at its end
+// (saveState, snapshots and compute use them); the buffers are kept from one epoch to the next.
+class mlpMixedPrecision
+{
+public:
+    mlpMixedPrecision(const mlpPrecision precision);
+    mlpPrecision getPrecision() const;
+    double learnEpoch(multilayerPerceptron &mlp);       // mean RMS error of the samples (order: m_tabOrder of the network)
+    size_t getBytes() const;                            // 16-bit copies, master weights and activations
+
+private:
+    mlpPrecision m_precision;
+    vector< vector<uint16_t> > m_tabWeights;            // per layer, nbNeurons x nbPrevious (read by forward and backpropagation)
+    vector< vector<uint16_t> > m_tabMomentum;           // last weight updates
+    vector< vector<float> > m_tabMaster;                // float weights updated by each step, rounded into m_tabWeights
+    vector< vector<uint16_t> > m_tabActivations;        // outputs of each layer, rounded to 16 bits
+    vector< vector<float> > m_tabOutputs;               // the same outputs in float, read by the next layer and the update
+    vector< vector<float> > m_tabErrors;
+    void load(const multilayerPerceptron &mlp);
+    void store(multilayerPerceptron &mlp) const;
+    double learnSample(const multilayerPerceptron &mlp, const traningSetMlp &sample);
+    void setOutputs(const int i);                       // round the float outputs of layer i to 16 bits
+    float dot(const float *tabInputs, const uint16_t *tabWeights, const int nbWeight) const;
+    void addScaled(float *tabSums, const uint16_t *tabWeights, const float factor, const int nbWeight) const;
+    void updateRow(const float *tabInputs, const float error, const float eta, const float alpha, float *tabMaster,
+                   uint16_t *tabWeights, uint16_t *tabMomentum, const int nbWeight) const;
+};
+
+#endif // MLPMIXEDPRECISION_H
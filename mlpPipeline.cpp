@@ -0,0 +1,547 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "mlpPipeline.h"
+#include "multilayerPerceptron.h"
+#include "threadPool.h"
+#include <thread>
+#include <chrono>
+#include <math.h>
+#include <algorithm>
+
+struct mlpPipeline::pipelineRun
+{
+    vector< unique_ptr< spscQueue<int> > > tabForward;  // stage s to stage s+1: micro-batches computed forward
+    vector< unique_ptr< spscQueue<int> > > tabBackward; // stage s+1 to stage s: micro-batches whose errors are computed
+    vector<double> tabBusy;                             // seconds computing, per stage
+    double wallTime;
+    double error;                                       // learning: sum of the RMS errors of the samples
+    const double *tabInputs;                            // compute: row-major samples
+    double *tabOutputs;
+    int nbSample;
+    vector< vector<double> > tabActivations;            // compute: activations of each layer, one buffer per queue slot
+};
+
+// a micro-batch is stored neuron by neuron: blockSize values per neuron, the inner loops run over contiguous samples
+void loadMicroBatch(const vector<traningSetMlp> &trainingSet, const int *tabIndexes, const int nbInput, double *in, const int nbSample, const int blockSize)
+{
+    for (int s=0; s < nbSample; s++)
+    {
+        const traningSetMlp &sample = trainingSet[tabIndexes[s]];
+        if (sample.tabExamples.empty())
+        {
+            for (int k=0; k < nbInput; k++)
+                in[k * blockSize + s] = 0;
+            for (int p=0; p < sample.tabNonZeroIndexes.size(); p++)
+                in[sample.tabNonZeroIndexes[p] * blockSize + s] = sample.tabNonZeroValues[p];
+        }
+        else
+        {
+            for (int k=0; k < nbInput; k++)
+                in[k * blockSize + s] = sample.tabExamples[k];
+        }
+    }
+}
+
+void forwardLayer(const layer &current, const int nbPrevious, const double *in, double *out, const int nbSample, const int blockSize)
+{
+    for (int j=0; j < current.tabNeurons.size(); j++)
+    {
+        double *sum = &out[j * blockSize];
+        fill_n(sum, nbSample, 0);
+        const double *weight = current.tabNeurons[j].weight;
+        for (int k=0; k < nbPrevious; k++)
+        {
+            double w = weight[k];
+            const double *input = &in[k * blockSize];
+            for (int s=0; s < nbSample; s++)
+                sum[s] += w * input[s];
+        }
+
+        // sigmoid function
+        for (int s=0; s < nbSample; s++)
+            sum[s] = 1.0 / (1.0 + exp(-sum[s]));
+    }
+}
+
+double outputErrors(const vector<traningSetMlp> &trainingSet, const int *tabIndexes, const int nbOutput, const double *out, double *error, const int nbSample, const int blockSize)
+{
+    double sum = 0;
+    for (int s=0; s < nbSample; s++)
+    {
+        const traningSetMlp &sample = trainingSet[tabIndexes[s]];
+        double rmsError = 0;
+        for (int k=0; k < nbOutput; k++)
+        {
+            double output = out[k * blockSize + s];
+            double target = sample.tabOutputTargets[k];
+            error[k * blockSize + s] = (target - output) * output * (1.0 - output);
+            rmsError += (target - output) * (target - output);
+        }
+        sum += sqrt(rmsError / nbOutput);
+    }
+    return sum;
+}
+
+// errors of a layer from the errors of the next one (weights of the next layer), times the sigmoid derivative
+void backwardLayer(const layer &next, const int nbNeuron, const double *out, const double *nextError, double *error, const int nbSample, const int blockSize)
+{
+    for (int j=0; j < nbNeuron; j++)
+        fill_n(&error[j * blockSize], nbSample, 0);
+    for (int k=0; k < next.tabNeurons.size(); k++)
+    {
+        const double *weight = next.tabNeurons[k].weight;
+        const double *e = &nextError[k * blockSize];
+        for (int j=0; j < nbNeuron; j++)
+        {
+            double w = weight[j];
+            double *sum = &error[j * blockSize];
+            for (int s=0; s < nbSample; s++)
+                sum[s] += w * e[s];
+        }
+    }
+    for (int j=0; j < nbNeuron; j++)
+        for (int s=0; s < nbSample; s++)
+        {
+            double output = out[j * blockSize + s];
+            error[j * blockSize + s] *= output * (1.0 - output);
+        }
+}
+
+void accumulateGradient(const int nbNeuron, const int nbPrevious, const double *in, const double *error, double *gradient, const int nbSample, const int blockSize)
+{
+    for (int j=0; j < nbNeuron; j++)
+    {
+        const double *e = &error[j * blockSize];
+        double *g = &gradient[(size_t) j * nbPrevious];
+        for (int k=0; k < nbPrevious; k++)
+        {
+            const double *input = &in[k * blockSize];
+            double sum = 0;
+            for (int s=0; s < nbSample; s++)
+                sum += e[s] * input[s];
+            g[k] += sum;
+        }
+    }
+}
+
+void applyGradient(layer &current, const int nbPrevious, const double *gradient, const double eta, const double alpha)
+{
+    for (int j=0; j < current.tabNeurons.size(); j++)
+    {
+        double *weight = current.tabNeurons[j].weight;
+        double *deltaWeight = current.tabNeurons[j].deltaWeight;
+        const double *g = &gradient[(size_t) j * nbPrevious];
+        for (int k=0; k < nbPrevious; k++)
+        {
+            double previous = deltaWeight[k];
+            deltaWeight[k] = eta * g[k];
+            weight[k] += deltaWeight[k] + alpha * previous;
+        }
+    }
+}
+
+static int waitFront(spscQueue<int> &queue)
+{
+    int item;
+    while (!queue.front(item))
+        this_thread::yield();
+    return item;
+}
+
+static void waitPush(spscQueue<int> &queue, const int item)
+{
+    while (!queue.push(item))
+        this_thread::yield();
+}
+
+static double elapsed(const chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+mlpPipeline::mlpPipeline()
+{
+    m_microBatchSize = 16;
+    m_nbMicroBatch = 8;
+    resetStats();
+}
+
+bool mlpPipeline::configure(const vector<int> &tabNbNeurons, const int nbStages, const int microBatchSize, const int nbMicroBatch, const vector<int> &tabLayersPerStage)
+{
+    int nbLayer = tabNbNeurons.size() - 1;             // layers with weights
+    if (microBatchSize < 1 || nbMicroBatch < 1)
+    {
+        cout << "Error: the micro-batch size and the number of micro-batches must be >= 1" << endl;
+        return false;
+    }
+    if (nbStages > nbLayer)
+    {
+        cout << "Error: " << nbStages << " stages for " << nbLayer << " layers with weights (at least one layer per stage)" << endl;
+        return false;
+    }
+
+    vector<long> tabCost(nbLayer + 1, 0);
+    for (int i=1; i <= nbLayer; i++)
+        tabCost[i] = (long) tabNbNeurons[i] * tabNbNeurons[i-1];
+
+    vector<int> tabFirstLayer;
+    if (!tabLayersPerStage.empty())
+    {
+        tabFirstLayer.push_back(1);
+        for (int s=0; s < tabLayersPerStage.size(); s++)
+            tabFirstLayer.push_back(tabFirstLayer.back() + tabLayersPerStage[s]);
+        if (tabLayersPerStage.size() != nbStages || *min_element(tabLayersPerStage.begin(), tabLayersPerStage.end()) < 1
+            || tabFirstLayer.back() != nbLayer + 1)
+        {
+            cout << "Error: the layers per stage must be >= 1 and sum to " << nbLayer << " for " << nbStages << " stages" << endl;
+            return false;
+        }
+    }
+    else
+    {
+        // contiguous stages with the smallest maximum number of weights: tabBest[s][i], layers 1..i in s+1 stages
+        vector<long> tabSum(nbLayer + 1, 0);
+        for (int i=1; i <= nbLayer; i++)
+            tabSum[i] = tabSum[i-1] + tabCost[i];
+        vector< vector<long> > tabBest(nbStages, vector<long>(nbLayer + 1, -1));
+        vector< vector<int> > tabSplit(nbStages, vector<int>(nbLayer + 1, 0));
+        for (int i=1; i <= nbLayer; i++)
+            tabBest[0][i] = tabSum[i];
+        for (int s=1; s < nbStages; s++)
+        {
+            for (int i=s+1; i <= nbLayer; i++)
+            {
+                for (int j=s; j < i; j++)
+                {
+                    long cost = max(tabBest[s-1][j], tabSum[i] - tabSum[j]);
+                    if (tabBest[s][i] < 0 || cost < tabBest[s][i])
+                    {
+                        tabBest[s][i] = cost;
+                        tabSplit[s][i] = j;
+                    }
+                }
+            }
+        }
+        tabFirstLayer.assign(nbStages + 1, nbLayer + 1);
+        int last = nbLayer;
+        for (int s=nbStages-1; s > 0; s--)
+        {
+            tabFirstLayer[s] = tabSplit[s][last] + 1;
+            last = tabSplit[s][last];
+        }
+        tabFirstLayer[0] = 1;
+    }
+
+    lock_guard<mutex> lock(m_statsMutex);
+    m_microBatchSize = microBatchSize;
+    m_nbMicroBatch = nbMicroBatch;
+    m_tabFirstLayer = tabFirstLayer;
+    m_tabNbWeight.assign(nbStages, 0);
+    for (int s=0; s < nbStages; s++)
+        for (int i=tabFirstLayer[s]; i < tabFirstLayer[s+1]; i++)
+            m_tabNbWeight[s] += tabCost[i];
+    m_tabOutputs.clear();
+    m_tabErrors.clear();
+    m_tabGradients.clear();
+    m_stats = pipelineStats();
+    return true;
+}
+
+int mlpPipeline::getNbStages() const
+{
+    return m_tabFirstLayer.size() - 1;
+}
+
+int mlpPipeline::getMicroBatchSize() const
+{
+    return m_microBatchSize;
+}
+
+double mlpPipeline::learnEpoch(multilayerPerceptron &mlp)
+{
+    const vector<layer> &network = mlp.m_neuralNetwork;
+    int nbStages = getNbStages();
+    int nbSample = mlp.m_trainingSet->size();
+
+    // buffers of the nbMicroBatch micro-batches of a mini-batch: kept until the backward pass
+    m_tabOutputs.resize(network.size());
+    m_tabErrors.resize(network.size());
+    m_tabGradients.resize(network.size());
+    for (int i=0; i < network.size(); i++)
+    {
+        size_t size = network[i].tabNeurons.size() * m_microBatchSize * m_nbMicroBatch;
+        m_tabOutputs[i].resize(size);
+        m_tabErrors[i].resize(i == 0 ? 0 : size);
+        m_tabGradients[i].resize(i == 0 ? 0 : network[i].tabNeurons.size() * network[i-1].tabNeurons.size());
+    }
+
+    pipelineRun run;
+    for (int s=0; s < nbStages - 1; s++)
+    {
+        run.tabForward.push_back(unique_ptr< spscQueue<int> >(new spscQueue<int>(m_nbMicroBatch)));
+        run.tabBackward.push_back(unique_ptr< spscQueue<int> >(new spscQueue<int>(m_nbMicroBatch)));
+    }
+    run.tabBusy.assign(nbStages, 0);
+    run.error = 0;
+
+    // the stages wait for each other: the calling thread runs the first one, parked threads of the pool the others
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    threadPool::instance().runConcurrent(nbStages, [&](int stage) { learningStage(mlp, run, stage); });
+    run.wallTime = elapsed(start);
+
+    addStats(run);
+    return run.error / max(1, nbSample);
+}
+
+void mlpPipeline::learningStage(multilayerPerceptron &mlp, pipelineRun &run, const int stage)
+{
+    vector<layer> &network = mlp.m_neuralNetwork;
+    const vector<traningSetMlp> &trainingSet = *mlp.m_trainingSet;
+    const vector<int> &tabOrder = mlp.m_tabOrder;
+    int nbStages = getNbStages();
+    int firstLayer = m_tabFirstLayer[stage];
+    int lastLayer = m_tabFirstLayer[stage + 1] - 1;
+    bool last = (stage == nbStages - 1);
+    int nbOutput = network.back().tabNeurons.size();
+    const int blockSize = m_microBatchSize;
+    int miniBatchSize = m_microBatchSize * m_nbMicroBatch;
+    int nbSample = trainingSet.size();
+    double busy = 0;
+    double error = 0;
+
+    for (int first=0; first < nbSample; first += miniBatchSize)
+    {
+        int nbInBatch = min(miniBatchSize, nbSample - first);
+        int nbMicroBatch = (nbInBatch + blockSize - 1) / blockSize;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int i=firstLayer; i <= lastLayer; i++)
+            fill(m_tabGradients[i].begin(), m_tabGradients[i].end(), 0);
+        busy += elapsed(start);
+
+        // errors of the layers of the stage from the errors of its last layer, gradients, errors of the previous stage
+        auto backward = [&](const int m, const int count) {
+            for (int i=lastLayer; i >= firstLayer; i--)
+            {
+                int nbNeuron = network[i].tabNeurons.size();
+                int nbPrevious = network[i-1].tabNeurons.size();
+                const double *in = &m_tabOutputs[i-1][(size_t) m * nbPrevious * blockSize];
+                const double *e = &m_tabErrors[i][(size_t) m * nbNeuron * blockSize];
+                accumulateGradient(nbNeuron, nbPrevious, in, e, m_tabGradients[i].data(), count, blockSize);
+                if (i > 1)
+                    backwardLayer(network[i], nbPrevious, in, e, &m_tabErrors[i-1][(size_t) m * nbPrevious * blockSize], count, blockSize);
+            }
+        };
+
+        // forward pass of the micro-batches (last stage: each micro-batch goes back as soon as it is computed)
+        for (int n=0; n < nbMicroBatch; n++)
+        {
+            int m = n;
+            if (stage > 0)
+            {
+                m = waitFront(*run.tabForward[stage - 1]);
+                run.tabForward[stage - 1]->pop();       // the activations are not reused before the next mini-batch
+            }
+            int count = min(blockSize, nbInBatch - m * blockSize);
+            start = chrono::steady_clock::now();
+
+            if (stage == 0)
+            {
+                int nbInput = network[0].tabNeurons.size();
+                loadMicroBatch(trainingSet, &tabOrder[first + m * blockSize], nbInput, &m_tabOutputs[0][(size_t) m * nbInput * blockSize], count, blockSize);
+            }
+
+            for (int i=firstLayer; i <= lastLayer; i++)
+            {
+                int nbNeuron = network[i].tabNeurons.size();
+                int nbPrevious = network[i-1].tabNeurons.size();
+                forwardLayer(network[i], nbPrevious, &m_tabOutputs[i-1][(size_t) m * nbPrevious * blockSize],
+                             &m_tabOutputs[i][(size_t) m * nbNeuron * blockSize], count, blockSize);
+            }
+
+            if (last)
+            {
+                error += outputErrors(trainingSet, &tabOrder[first + m * blockSize], nbOutput, &m_tabOutputs[lastLayer][(size_t) m * nbOutput * blockSize],
+                                      &m_tabErrors[lastLayer][(size_t) m * nbOutput * blockSize], count, blockSize);
+                backward(m, count);
+            }
+            busy += elapsed(start);
+
+            if (!last)
+                waitPush(*run.tabForward[stage], m);
+            else if (stage > 0)
+                waitPush(*run.tabBackward[stage - 1], m);
+        }
+
+        // backward pass, in the order the next stage finishes the micro-batches
+        for (int n=0; !last && n < nbMicroBatch; n++)
+        {
+            int m = waitFront(*run.tabBackward[stage]);
+            run.tabBackward[stage]->pop();
+            start = chrono::steady_clock::now();
+            backward(m, min(blockSize, nbInBatch - m * blockSize));
+            busy += elapsed(start);
+            if (stage > 0)
+                waitPush(*run.tabBackward[stage - 1], m);
+        }
+
+        // update of the weights of the stage: mean gradient of the mini-batch, momentum
+        start = chrono::steady_clock::now();
+        for (int i=firstLayer; i <= lastLayer; i++)
+            applyGradient(network[i], network[i-1].tabNeurons.size(), m_tabGradients[i].data(), mlp.m_eta / nbInBatch, mlp.m_alpha);
+        busy += elapsed(start);
+    }
+
+    run.tabBusy[stage] = busy;
+    if (last)
+        run.error = error;
+}
+
+void mlpPipeline::compute(const multilayerPerceptron &mlp, const double *tabInputs, double *tabOutputs, const int nbSample)
+{
+    const vector<layer> &network = mlp.m_neuralNetwork;
+    int nbStages = getNbStages();
+
+    // one activation buffer per queue slot: a stage rewrites a buffer once the next stage has popped its micro-batch
+    pipelineRun run;
+    for (int s=0; s < nbStages - 1; s++)
+        run.tabForward.push_back(unique_ptr< spscQueue<int> >(new spscQueue<int>(max(2, m_nbMicroBatch))));
+    int nbSlot = run.tabForward.empty() ? 1 : run.tabForward[0]->capacity();
+    run.tabActivations.resize(network.size());
+    for (int i=0; i < network.size(); i++)
+        run.tabActivations[i].resize((size_t) network[i].tabNeurons.size() * m_microBatchSize * nbSlot);
+    run.tabBusy.assign(nbStages, 0);
+    run.error = 0;
+    run.tabInputs = tabInputs;
+    run.tabOutputs = tabOutputs;
+    run.nbSample = nbSample;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    threadPool::instance().runConcurrent(nbStages, [&](int stage) { computeStage(mlp, run, stage); });
+    run.wallTime = elapsed(start);
+    addStats(run);
+}
+
+void mlpPipeline::computeStage(const multilayerPerceptron &mlp, pipelineRun &run, const int stage)
+{
+    const vector<layer> &network = mlp.m_neuralNetwork;
+    int nbStages = getNbStages();
+    int firstLayer = m_tabFirstLayer[stage];
+    int lastLayer = m_tabFirstLayer[stage + 1] - 1;
+    bool last = (stage == nbStages - 1);
+    int nbInput = network[0].tabNeurons.size();
+    int nbOutput = network.back().tabNeurons.size();
+    const int blockSize = m_microBatchSize;
+    int nbSlot = run.tabForward.empty() ? 1 : run.tabForward[0]->capacity();
+    int nbMicroBatch = (run.nbSample + blockSize - 1) / blockSize;
+    double busy = 0;
+
+    for (int m=0; m < nbMicroBatch; m++)
+    {
+        if (stage > 0)
+            waitFront(*run.tabForward[stage - 1]);
+        while (!last && run.tabForward[stage]->full())
+            this_thread::yield();
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        int slot = m % nbSlot;
+        int count = min(blockSize, run.nbSample - m * blockSize);
+        if (stage == 0)
+        {
+            double *in = &run.tabActivations[0][(size_t) slot * nbInput * blockSize];
+            for (int s=0; s < count; s++)
+                for (int k=0; k < nbInput; k++)
+                    in[k * blockSize + s] = run.tabInputs[(size_t) (m * blockSize + s) * nbInput + k];
+        }
+
+        for (int i=firstLayer; i <= lastLayer; i++)
+        {
+            int nbNeuron = network[i].tabNeurons.size();
+            int nbPrevious = network[i-1].tabNeurons.size();
+            forwardLayer(network[i], nbPrevious, &run.tabActivations[i-1][(size_t) slot * nbPrevious * blockSize],
+                         &run.tabActivations[i][(size_t) slot * nbNeuron * blockSize], count, blockSize);
+        }
+
+        if (last)
+        {
+            const double *out = &run.tabActivations[lastLayer][(size_t) slot * nbOutput * blockSize];
+            for (int s=0; s < count; s++)
+                for (int k=0; k < nbOutput; k++)
+                    run.tabOutputs[(size_t) (m * blockSize + s) * nbOutput + k] = out[k * blockSize + s];
+        }
+        busy += elapsed(start);
+
+        if (stage > 0)
+            run.tabForward[stage - 1]->pop();
+        if (!last)
+            run.tabForward[stage]->push(m);
+    }
+    run.tabBusy[stage] = busy;
+}
+
+void mlpPipeline::addStats(const pipelineRun &run)
+{
+    lock_guard<mutex> lock(m_statsMutex);
+    if (m_stats.tabStages.size() != getNbStages())
+    {
+        m_stats.tabStages.resize(getNbStages());
+        for (int s=0; s < getNbStages(); s++)
+            m_stats.tabStages[s].busyTime = 0;
+    }
+    m_stats.microBatchSize = m_microBatchSize;
+    m_stats.nbMicroBatch = m_nbMicroBatch;
+    m_stats.nbRun++;
+    m_stats.wallTime += run.wallTime;
+    for (int s=0; s < getNbStages(); s++)
+    {
+        m_stats.tabStages[s].firstLayer = m_tabFirstLayer[s];
+        m_stats.tabStages[s].lastLayer = m_tabFirstLayer[s+1] - 1;
+        m_stats.tabStages[s].nbWeight = m_tabNbWeight[s];
+        m_stats.tabStages[s].busyTime += run.tabBusy[s];
+    }
+}
+
+pipelineStats mlpPipeline::getStats() const
+{
+    lock_guard<mutex> lock(m_statsMutex);
+    pipelineStats stats = m_stats;
+    stats.microBatchSize = m_microBatchSize;
+    stats.nbMicroBatch = m_nbMicroBatch;
+    if (stats.tabStages.empty())
+    {
+        // layout before the first run
+        stats.tabStages.resize(getNbStages());
+        for (int s=0; s < getNbStages(); s++)
+            stats.tabStages[s] = {m_tabFirstLayer[s], m_tabFirstLayer[s+1] - 1, m_tabNbWeight[s], 0};
+    }
+    return stats;
+}
+
+void mlpPipeline::resetStats()
+{
+    lock_guard<mutex> lock(m_statsMutex);
+    m_stats = pipelineStats();
+}
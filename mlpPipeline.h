@@ -0,0 +1,102 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef MLPPIPELINE_H
+#define MLPPIPELINE_H
+
+#include <vector>
+#include <mutex>
+#include <memory>
+#include "spscQueue.h"
+using namespace std;
+
+class multilayerPerceptron;
+struct layer;
+struct traningSetMlp;
+
+struct pipelineStage
+{
+    int firstLayer;                                     // layers computed by the stage (weights of layers firstLayer..lastLayer)
+    int lastLayer;
+    long nbWeight;
+    double busyTime;                                    // seconds computing (the rest of the time, the stage waits)
+};
+
+struct pipelineStats
+{
+    int microBatchSize;
+    int nbMicroBatch;                                   // micro-batches per weight update (learning)
+    long nbRun;                                         // learning epochs and computeBatch calls
+    double wallTime;                                    // seconds of the runs
+    vector<pipelineStage> tabStages;
+};
+
+// micro-batch kernels, shared by the pipeline stages and gradient accumulation (mlpAccumulation.h):
+// a micro-batch is stored neuron by neuron, blockSize values per neuron (nbSample <= blockSize are used)
+void loadMicroBatch(const vector<traningSetMlp> &trainingSet, const int *tabIndexes, const int nbInput, double *in, const int nbSample, const int blockSize);
+void forwardLayer(const layer &current, const int nbPrevious, const double *in, double *out, const int nbSample, const int blockSize);
+double outputErrors(const vector<traningSetMlp> &trainingSet, const int *tabIndexes, const int nbOutput, const double *out, double *error,
+                    const int nbSample, const int blockSize);  // sum of the RMS errors of the samples
+void backwardLayer(const layer &next, const int nbNeuron, const double *out, const double *nextError, double *error, const int nbSample, const int blockSize);
+void accumulateGradient(const int nbNeuron, const int nbPrevious, const double *in, const double *error, double *gradient, const int nbSample, const int blockSize);
+void applyGradient(layer &current, const int nbPrevious, const double *gradient, const double eta, const double alpha);  // momentum step
+
+// pipeline-parallel execution of a network: consecutive layers are assigned to stages, one thread per stage,
+// so that the weights of a stage stay in the caches of its core. Micro-batches of samples go from stage to stage
+// through lock-free queues (identifiers of activation buffers).
+// Learning follows the GPipe schedule: the nbMicroBatch micro-batches of a mini-batch go forward through all the
+// stages, then backward; the gradients are accumulated and each stage updates its weights once per mini-batch
+// (mean gradient of the mini-batch, with momentum). Bubble: the part of the time a stage waits for its neighbours.
+class mlpPipeline
+{
+public:
+    mlpPipeline();
+    bool configure(const vector<int> &tabNbNeurons, const int nbStages, const int microBatchSize, const int nbMicroBatch,
+                   const vector<int> &tabLayersPerStage = vector<int>());    // empty: stages balanced by number of weights
+    int getNbStages() const;
+    int getMicroBatchSize() const;
+    double learnEpoch(multilayerPerceptron &mlp);       // mean RMS error of the samples (order: m_tabOrder of the network)
+    void compute(const multilayerPerceptron &mlp, const double *tabInputs, double *tabOutputs, const int nbSample);
+    pipelineStats getStats() const;
+    void resetStats();
+
+private:
+    struct pipelineRun;
+    int m_microBatchSize;
+    int m_nbMicroBatch;
+    vector<int> m_tabFirstLayer;                        // first layer of each stage, then the number of layers
+    vector<long> m_tabNbWeight;                         // weights of each stage
+    vector< vector<double> > m_tabOutputs;              // learning: activations of each layer, nbMicroBatch buffers
+    vector< vector<double> > m_tabErrors;               // learning: errors of each layer, nbMicroBatch buffers
+    vector< vector<double> > m_tabGradients;            // learning: gradients accumulated over the mini-batch
+    mutable mutex m_statsMutex;
+    pipelineStats m_stats;
+    void learningStage(multilayerPerceptron &mlp, pipelineRun &run, const int stage);
+    void computeStage(const multilayerPerceptron &mlp, pipelineRun &run, const int stage);
+    void addStats(const pipelineRun &run);
+};
+
+#endif // MLPPIPELINE_H
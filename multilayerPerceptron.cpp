@@ -25,14 +25,41 @@
 */
 
 #include "multilayerPerceptron.h"
+#include "perfProfiler.h"
+#include "trainingSetCache.h"
+#include "threadPool.h"
 #include <fstream>
 #include <string>
 #include <math.h>
 #include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
 #include <algorithm>
+#include <thread>
+#include <functional>
+#include <sstream>
+#include <sys/resource.h>
+
+static const double SPARSE_KERNEL_MAX_DENSITY = 0.5;   // pruned layers denser than this use the dense kernel
+static const int BATCH_BLOCK_SIZE = 64;                 // number of samples computed together by computeBatch
+static const int MAX_LAYER_NEURONS = 1 << 24;           // loadState: a wider layer is a corrupt header
 
 multilayerPerceptron::multilayerPerceptron(const vector<int> tabNbNeurons, const double eta, const double alpha)
 {
+    m_statsEnabled = false;
+    m_maxReportRate = 10;
+    m_learningCallback = NULL;
+    m_learningCallbackData = NULL;
+    m_profiler = NULL;
+    m_cancelLearning = false;
+    m_snapshotRate = 0;
+    m_replaySize = 1000;
+    m_replayRatio = 1;
+    m_nbStreamed = 0;
+    m_trainingSet = make_shared< vector<traningSetMlp> >();
+    resetStats();
+
     if (tabNbNeurons.size() < 2)
     {
         cout <<  "Error: the neural network must contain at least 2 layers" << endl;
@@ -75,20 +102,115 @@ bool multilayerPerceptron::loadTrainingSet(const vector< vector<double> > &tabIn
         }
     }
 
-    m_trainingSet.resize(tabInputs.size());
-    for (int i=0; i < m_trainingSet.size(); i++)
+    editTrainingSet(false).resize(tabInputs.size());
+    for (int i=0; i < m_trainingSet->size(); i++)
+    {
+        (*m_trainingSet)[i].tabExamples = tabInputs[i];
+        (*m_trainingSet)[i].tabOutputTargets = tabOutputTargets[i];
+        (*m_trainingSet)[i].tabNonZeroIndexes.clear();
+        (*m_trainingSet)[i].tabNonZeroValues.clear();
+    }
+
+    return true;
+}
+
+bool multilayerPerceptron::loadSparseTrainingSet(const vector< vector<int> > &tabIndexes, const vector< vector<double> > &tabValues, const vector< vector<double> > &tabOutputTargets)
+{
+    if (tabIndexes.size() != tabOutputTargets.size() || tabValues.size() != tabOutputTargets.size())
+    {
+        cout <<  "Error: the number of inputs data does not match with the number of outputs data" << endl;
+        return false;
+    }
+
+    for (int i=0; i < tabIndexes.size(); i++)
+    {
+        if (tabIndexes[i].size() != tabValues[i].size())
+        {
+            cout <<  "Error: the number of indexes does not match the number of values" << endl;
+            return false;
+        }
+
+        for (int j=0; j < tabIndexes[i].size(); j++)
+        {
+            if (tabIndexes[i][j] < 0 || tabIndexes[i][j] >= m_neuralNetwork[0].tabNeurons.size())
+            {
+                cout <<  "Error: input index out of range" << endl;
+                return false;
+            }
+        }
+
+        if (tabOutputTargets[i].size() != m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size())
+        {
+            cout <<  "Error: the number of outputs data does not match" << endl;
+            return false;
+        }
+    }
+
+    editTrainingSet(false).resize(tabIndexes.size());
+    for (int i=0; i < m_trainingSet->size(); i++)
+    {
+        (*m_trainingSet)[i].tabExamples.clear();
+        (*m_trainingSet)[i].tabNonZeroIndexes = tabIndexes[i];
+        (*m_trainingSet)[i].tabNonZeroValues = tabValues[i];
+        (*m_trainingSet)[i].tabOutputTargets = tabOutputTargets[i];
+    }
+
+    return true;
+}
+
+bool multilayerPerceptron::loadTrainingSetFile(const string fileUrl, const bool cached)
+{
+    // read once (streamed chunk): parsed without evicting the cached training sets, no sidecar
+    bool binary = false;
+    if (!cached)
+        return parseTrainingSetFile(fileUrl, binary);
+
+    // file already parsed by a network of the process (same size and modification time): shared, not parsed again
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    trainingSetCache &cache = trainingSetCache::instance();
+    shared_ptr< const vector<traningSetMlp> > trainingSet = cache.find(fileUrl);
+    if (trainingSet)
+    {
+        bool ret = setTrainingSet(trainingSet);
+        addIoTime(start);
+        return ret;
+    }
+
+    // binary sidecar of a text training set, saved by a previous process
+    bool sidecar = cache.getSidecar();
+    string sidecarFile = trainingSetCache::sidecarFile(fileUrl);
+    bool parsed = false;
+    if (sidecar && cache.isSidecarValid(fileUrl))
+    {
+        parsed = parseTrainingSetFile(sidecarFile, binary) && binary;
+        if (!parsed)
+            cout << "sidecar " << sidecarFile << " discarded, parsing " << fileUrl << endl;
+    }
+
+    // text file (or corrupt sidecar): the sidecar is written under another name then renamed, never read half written.
+    // Its stamp is taken before parsing: a file changed meanwhile does not match it
+    if (!parsed)
     {
-        m_trainingSet[i].tabExamples = tabInputs[i];
-        m_trainingSet[i].tabOutputTargets = tabOutputTargets[i];
+        string stamp = trainingSetCache::sidecarStamp(fileUrl);
+        if (!parseTrainingSetFile(fileUrl, binary))
+            return false;
+        if (sidecar && !binary && !stamp.empty())
+        {
+            string tmpFile = sidecarFile + ".tmp";
+            if (!saveTrainingSetFile(tmpFile, stamp) || rename(tmpFile.c_str(), sidecarFile.c_str()) != 0)
+                remove(tmpFile.c_str());
+        }
     }
 
+    cache.insert(fileUrl, m_trainingSet);
     return true;
 }
 
-bool multilayerPerceptron::loadTrainingSetFile(const string fileUrl)
+bool multilayerPerceptron::parseTrainingSetFile(const string fileUrl, bool &binary)
 {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
     ifstream file;
-    file.open(fileUrl.c_str());
+    file.open(fileUrl.c_str(), ios::in | ios::binary);
 
     if (!file.is_open())
     {
@@ -96,23 +218,50 @@ bool multilayerPerceptron::loadTrainingSetFile(const string fileUrl)
         return false;
     }
 
+    // binary training set (saveTrainingSetFile), after the stamp of the text file for a sidecar
+    char tag[8] = {0};
+    file.read(tag, sizeof tag);
+    if (file && string(tag, sizeof tag) == "[mlpsrc]")
+    {
+        file.seekg(2 * sizeof(long long), ios::cur);
+        file.read(tag, sizeof tag);
+    }
+    binary = (file && string(tag, sizeof tag) == "[mlpbin]");
+    if (binary)
+    {
+        bool ret = loadTrainingSetBinary(file, fileUrl);
+        file.close();
+        addIoTime(start);
+        return ret;
+    }
+    file.clear();
+    file.seekg(0);
+
     string word;
     int nbInput = 0;
     int nbOutput = 0;
     int nbSample = 0;
 
+    // [mlp]: dense inputs, [mlp_sparse]: inputs saved as number of non-zero inputs followed by index:value pairs
     file >> word;
-    if (word !=  "[mlp]")
+    if (word !=  "[mlp]" && word != "[mlp_sparse]")
     {
         cout <<  "Error can't find [mlp] tag in file: " << fileUrl << endl;
         file.close();
         return false;
 
     }
+    bool sparse = (word == "[mlp_sparse]");
 
     file >> nbInput >> nbOutput >> nbSample;
 
-    if (nbInput != m_neuralNetwork[0].tabNeurons.size())
+    if (nbSample < 0)
+    {
+        cout <<  "Error: invalid number of examples in file " << fileUrl << endl;
+        file.close();
+        return false;
+    }
+    else if (nbInput != m_neuralNetwork[0].tabNeurons.size())
     {
         cout <<  "Error: the number of inputs data does not match the number defined in file " << fileUrl << endl;
         file.close();
@@ -133,14 +282,45 @@ bool multilayerPerceptron::loadTrainingSetFile(const string fileUrl)
         return false;
     }
 
-    m_trainingSet.resize(nbSample);
-    for (int i=0; i < m_trainingSet.size(); i++)
+    editTrainingSet(false).resize(nbSample);
+    for (int i=0; i < m_trainingSet->size(); i++)
     {
-        m_trainingSet[i].tabExamples.resize(nbInput);
+        if (sparse)
+        {
+            int nbNonZero = 0;
+            file >> nbNonZero;
+            (*m_trainingSet)[i].tabExamples.clear();
+            (*m_trainingSet)[i].tabNonZeroIndexes.resize(nbNonZero);
+            (*m_trainingSet)[i].tabNonZeroValues.resize(nbNonZero);
+            for (int j=0; j < nbNonZero; j++)
+            {
+                char separator = 0;
+                file >> (*m_trainingSet)[i].tabNonZeroIndexes[j] >> separator >> (*m_trainingSet)[i].tabNonZeroValues[j];
+                if (file.fail() || separator != ':')
+                {
+                    cout <<  "Error: expected index:value pair in file " << fileUrl << endl;
+                    m_trainingSet->clear();
+                    file.close();
+                    return false;
+                }
+                if ((*m_trainingSet)[i].tabNonZeroIndexes[j] < 0 || (*m_trainingSet)[i].tabNonZeroIndexes[j] >= nbInput)
+                {
+                    cout <<  "Error: input index out of range in file " << fileUrl << endl;
+                    m_trainingSet->clear();
+                    file.close();
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        (*m_trainingSet)[i].tabNonZeroIndexes.clear();
+        (*m_trainingSet)[i].tabNonZeroValues.clear();
+        (*m_trainingSet)[i].tabExamples.resize(nbInput);
 
-        for (int j=0; j < m_trainingSet[i].tabExamples.size(); j++)
+        for (int j=0; j < (*m_trainingSet)[i].tabExamples.size(); j++)
         {
-            file >> m_trainingSet[i].tabExamples[j];
+            file >> (*m_trainingSet)[i].tabExamples[j];
         }
     }
 
@@ -152,17 +332,163 @@ bool multilayerPerceptron::loadTrainingSetFile(const string fileUrl)
         return false;
     }
 
-    for (int i=0; i < m_trainingSet.size(); i++)
+    for (int i=0; i < m_trainingSet->size(); i++)
+    {
+        (*m_trainingSet)[i].tabOutputTargets.resize(nbOutput);
+
+        for (int j=0; j < (*m_trainingSet)[i].tabOutputTargets.size(); j++)
+        {
+            file >> (*m_trainingSet)[i].tabOutputTargets[j];
+        }
+    }
+
+    file.close();
+    addIoTime(start);
+    return true;
+}
+
+bool multilayerPerceptron::loadTrainingSetBinary(istream &file, const string fileUrl)
+{
+    int sparse = 0;
+    int nbInput = 0;
+    int nbOutput = 0;
+    int nbSample = 0;
+    file.read((char *) &sparse, sizeof sparse);
+    file.read((char *) &nbInput, sizeof nbInput);
+    file.read((char *) &nbOutput, sizeof nbOutput);
+    file.read((char *) &nbSample, sizeof nbSample);
+
+    // smallest example: inputs (dense: nbInput values, sparse: its number of non-zero inputs) then the outputs
+    long position = file.tellg();
+    file.seekg(0, ios::end);
+    long remaining = (long) file.tellg() - position;
+    file.seekg(position);
+    long minSampleSize = (sparse ? sizeof(int) : sizeof(double) * (long) nbInput) + sizeof(double) * (long) nbOutput;
+
+    if (!file || nbSample < 0 || (long) nbSample * minSampleSize > remaining)
+    {
+        cout <<  "Error: truncated or corrupted file " << fileUrl << endl;
+        return false;
+    }
+    else if (nbInput != m_neuralNetwork[0].tabNeurons.size())
+    {
+        cout <<  "Error: the number of inputs data does not match the number defined in file " << fileUrl << endl;
+        return false;
+    }
+    else if (nbOutput != m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size())
+    {
+        cout <<  "Error: the number of outputs data does not match the number defined in file " << fileUrl << endl;
+        return false;
+    }
+
+    // each example: inputs (dense: nbInput values, sparse: nb of non-zero inputs, indexes, values) then nbOutput values
+    editTrainingSet(false).resize(nbSample);
+    for (int i=0; i < m_trainingSet->size(); i++)
+    {
+        traningSetMlp &sample = (*m_trainingSet)[i];
+        if (sparse)
+        {
+            int nbNonZero = 0;
+            file.read((char *) &nbNonZero, sizeof nbNonZero);
+            if (nbNonZero < 0 || nbNonZero > nbInput)
+            {
+                file.setstate(ios::failbit);
+                break;
+            }
+            sample.tabExamples.clear();
+            sample.tabNonZeroIndexes.resize(nbNonZero);
+            sample.tabNonZeroValues.resize(nbNonZero);
+            if (nbNonZero > 0)
+            {
+                file.read((char *) &sample.tabNonZeroIndexes[0], sizeof(int) * nbNonZero);
+                file.read((char *) &sample.tabNonZeroValues[0], sizeof(double) * nbNonZero);
+            }
+            for (int j=0; j < nbNonZero && file; j++)
+            {
+                if (sample.tabNonZeroIndexes[j] < 0 || sample.tabNonZeroIndexes[j] >= nbInput)
+                {
+                    cout <<  "Error: input index out of range in file " << fileUrl << endl;
+                    m_trainingSet->clear();
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            sample.tabNonZeroIndexes.clear();
+            sample.tabNonZeroValues.clear();
+            sample.tabExamples.resize(nbInput);
+            file.read((char *) &sample.tabExamples[0], sizeof(double) * nbInput);
+        }
+
+        sample.tabOutputTargets.resize(nbOutput);
+        file.read((char *) &sample.tabOutputTargets[0], sizeof(double) * nbOutput);
+        if (!file)
+            break;
+    }
+
+    if (!file)
+    {
+        cout <<  "Error: truncated or corrupted file " << fileUrl << endl;
+        m_trainingSet->clear();
+        return false;
+    }
+    return true;
+}
+
+bool multilayerPerceptron::saveTrainingSetFile(const string fileUrl)
+{
+    return saveTrainingSetFile(fileUrl, string());
+}
+
+bool multilayerPerceptron::saveTrainingSetFile(const string fileUrl, const string &header)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (m_trainingSet->size() < 1)
+    {
+        cout <<  "Error: no training set loaded" << endl;
+        return false;
+    }
+
+    ofstream file(fileUrl.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!file.is_open())
     {
-        m_trainingSet[i].tabOutputTargets.resize(nbOutput);
+        cout <<  "error: can't open file " << fileUrl << endl;
+        return false;
+    }
 
-        for (int j=0; j < m_trainingSet[i].tabOutputTargets.size(); j++)
+    int sparse = (*m_trainingSet)[0].tabExamples.empty() ? 1 : 0;
+    int nbInput = m_neuralNetwork[0].tabNeurons.size();
+    int nbOutput = m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size();
+    int nbSample = m_trainingSet->size();
+    file.write(header.data(), header.size());
+    file.write("[mlpbin]", 8);
+    file.write((char *) &sparse, sizeof sparse);
+    file.write((char *) &nbInput, sizeof nbInput);
+    file.write((char *) &nbOutput, sizeof nbOutput);
+    file.write((char *) &nbSample, sizeof nbSample);
+
+    for (int i=0; i < m_trainingSet->size(); i++)
+    {
+        const traningSetMlp &sample = (*m_trainingSet)[i];
+        if (sparse)
         {
-            file >> m_trainingSet[i].tabOutputTargets[j];
+            int nbNonZero = sample.tabNonZeroIndexes.size();
+            file.write((char *) &nbNonZero, sizeof nbNonZero);
+            if (nbNonZero > 0)
+            {
+                file.write((char *) &sample.tabNonZeroIndexes[0], sizeof(int) * nbNonZero);
+                file.write((char *) &sample.tabNonZeroValues[0], sizeof(double) * nbNonZero);
+            }
         }
+        else
+            file.write((char *) &sample.tabExamples[0], sizeof(double) * nbInput);
+
+        file.write((char *) &sample.tabOutputTargets[0], sizeof(double) * nbOutput);
     }
 
     file.close();
+    addIoTime(start);
     return true;
 }
 
@@ -184,24 +510,46 @@ bool multilayerPerceptron::computeOutput(const vector<double> &tabInput, vector<
         return false;
     }
 
+    if (m_profiler)
+        m_profiler->start();
+
     // set inputs
     for (int i=0; i < tabInput.size(); i++)
         m_neuralNetwork[0].tabNeurons[i].output = tabInput[i];
 
     // compute output
-    for(int i=1; i < m_neuralNetwork.size(); i++)
+    computeLayers();
+
+    // save outputs
+    tabOutput.resize(m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size());
+    for (int i=0; i < m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size(); i++)
+        tabOutput[i] = m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons[i].output;
+
+    return true;
+}
+
+bool multilayerPerceptron::computeOutput(const vector<int> &tabIndexes, const vector<double> &tabValues, vector<double>& tabOutput)
+{
+    if (tabIndexes.size() != tabValues.size())
     {
-        for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
-        {
-            double sum = 0;
-            for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
-                sum += m_neuralNetwork[i-1].tabNeurons[k].output * m_neuralNetwork[i].tabNeurons[j].weight[k];
+        cout <<  "Error: the number of indexes does not match the number of values" << endl;
+        return false;
+    }
 
-            // sigmoid function
-            m_neuralNetwork[i].tabNeurons[j].output = 1.0 / (1.0 + exp(-sum));
+    for (int i=0; i < tabIndexes.size(); i++)
+    {
+        if (tabIndexes[i] < 0 || tabIndexes[i] >= m_neuralNetwork[0].tabNeurons.size())
+        {
+            cout <<  "Error: input index out of range" << endl;
+            return false;
         }
     }
 
+    // compute output
+    if (m_profiler)
+        m_profiler->start();
+    computeSparseInput(tabIndexes, tabValues);
+
     // save outputs
     tabOutput.resize(m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size());
     for (int i=0; i < m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size(); i++)
@@ -210,8 +558,183 @@ bool multilayerPerceptron::computeOutput(const vector<double> &tabInput, vector<
     return true;
 }
 
+// rows of a contiguous row-major matrix, indexed as a vector of vectors by computeBlock
+// blocks per task: about 4 tasks per thread, the idle workers steal the end of a slow range
+static long batchGrain(const int nbBlock, const int nbThreads)
+{
+    return max(1, nbBlock / (4 * max(1, nbThreads)));
+}
+
+template <class value>
+struct matrixRows
+{
+    value *data;
+    int nbColumn;
+    value *operator[](const int row) const { return data + (size_t) row * nbColumn; }
+};
+
+bool multilayerPerceptron::computeBatch(const vector< vector<double> > &tabInputs, vector< vector<double> > &tabOutputs, const int nbThreads) const
+{
+    int nbInput = m_neuralNetwork[0].tabNeurons.size();
+    for (int i=0; i < tabInputs.size(); i++)
+    {
+        if (tabInputs[i].size() != nbInput)
+        {
+            cout <<  "Error: the number of inputs data does not match" << endl;
+            return false;
+        }
+    }
+
+    // the output rows are sized before the workers start (no allocation once the caller reuses tabOutputs)
+    tabOutputs.resize(tabInputs.size());
+    for (int i=0; i < tabOutputs.size(); i++)
+        tabOutputs[i].resize(m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size());
+
+    if (nbThreads <= 1 || tabInputs.size() < 2 * BATCH_BLOCK_SIZE)
+    {
+        computeBlock(tabInputs, tabOutputs, 0, tabInputs.size(), m_profiler != NULL);
+        return true;
+    }
+
+    // chunks of whole blocks run on the thread pool (counters are per thread: no profiling)
+    int nbBlock = (tabInputs.size() + BATCH_BLOCK_SIZE - 1) / BATCH_BLOCK_SIZE;
+    threadPool::instance().parallelFor(0, nbBlock, batchGrain(nbBlock, nbThreads), [&](long firstBlock, long lastBlock) {
+        computeBlock(tabInputs, tabOutputs, firstBlock * BATCH_BLOCK_SIZE, min((long) tabInputs.size(), lastBlock * BATCH_BLOCK_SIZE), false);
+    });
+
+    return true;
+}
+
+bool multilayerPerceptron::computeBatch(const double *tabInputs, double *tabOutputs, const int nbSample, const int nbThreads) const
+{
+    if (m_pipeline && nbSample >= 2 * m_pipeline->getMicroBatchSize())
+    {
+        m_pipeline->compute(*this, tabInputs, tabOutputs, nbSample);
+        return true;
+    }
+
+    matrixRows<const double> inputs = {tabInputs, (int) m_neuralNetwork[0].tabNeurons.size()};
+    matrixRows<double> outputs = {tabOutputs, (int) m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size()};
+
+    if (nbThreads <= 1 || nbSample < 2 * BATCH_BLOCK_SIZE)
+    {
+        computeBlock(inputs, outputs, 0, nbSample, m_profiler != NULL);
+        return true;
+    }
+
+    int nbBlock = (nbSample + BATCH_BLOCK_SIZE - 1) / BATCH_BLOCK_SIZE;
+    threadPool::instance().parallelFor(0, nbBlock, batchGrain(nbBlock, nbThreads), [&](long firstBlock, long lastBlock) {
+        computeBlock(inputs, outputs, firstBlock * BATCH_BLOCK_SIZE, min((long) nbSample, lastBlock * BATCH_BLOCK_SIZE), false);
+    });
+
+    return true;
+}
+
+template <class inputRows, class outputRows>
+void multilayerPerceptron::computeBlock(const inputRows &tabInputs, outputRows &tabOutputs, const int firstSample, const int lastSample, const bool profile) const
+{
+    if (profile)
+        m_profiler->start();
+
+    int nbInput = m_neuralNetwork[0].tabNeurons.size();
+    int nbOutput = m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size();
+
+    // samples are computed by blocks: activations are stored neuron by neuron (blockSize values per neuron)
+    // so that each weight is read once per block and the inner loop runs over contiguous samples
+    const int blockSize = BATCH_BLOCK_SIZE;
+    int nbMaxNeuron = 0;
+    for (int i=0; i < m_neuralNetwork.size(); i++)
+        nbMaxNeuron = max(nbMaxNeuron, (int) m_neuralNetwork[i].tabNeurons.size());
+
+    // activations of two layers per thread: the arena only grows with the largest network computed by the thread
+    static thread_local mlpArena arena;
+    arena.reset();
+    arena.reserve(2 * mlpArena::blockSize((size_t) nbMaxNeuron * blockSize));
+    double *tabIn = arena.allocate((size_t) nbMaxNeuron * blockSize);
+    double *tabOut = arena.allocate((size_t) nbMaxNeuron * blockSize);
+
+    for (int first=firstSample; first < lastSample; first += blockSize)
+    {
+        // a partial block (last block, small request) only computes its own samples
+        int nbSample = min(blockSize, lastSample - first);
+
+        for (int s=0; s < nbSample; s++)
+            for (int k=0; k < nbInput; k++)
+                tabIn[k * blockSize + s] = tabInputs[first + s][k];
+
+        for (int i=1; i < m_neuralNetwork.size(); i++)
+        {
+            const layer &current = m_neuralNetwork[i];
+            int nbPrevious = m_neuralNetwork[i-1].tabNeurons.size();
+            for (int j=0; j < current.tabNeurons.size(); j++)
+            {
+                double *sum = &tabOut[j * blockSize];
+                fill_n(sum, nbSample, 0);
+                if (current.sparseKernel)
+                {
+                    for (int p=current.csr.rowStart[j]; p < current.csr.rowStart[j+1]; p++)
+                    {
+                        double weight = current.csr.value[p];
+                        const double *input = &tabIn[current.csr.column[p] * blockSize];
+                        for (int s=0; s < nbSample; s++)
+                            sum[s] += weight * input[s];
+                    }
+                }
+                else
+                {
+                    for (int k=0; k < nbPrevious; k++)
+                    {
+                        double weight = current.tabNeurons[j].weight[k];
+                        const double *input = &tabIn[k * blockSize];
+                        for (int s=0; s < nbSample; s++)
+                            sum[s] += weight * input[s];
+                    }
+                }
+
+                // sigmoid function
+                for (int s=0; s < nbSample; s++)
+                    sum[s] = 1.0 / (1.0 + exp(-sum[s]));
+            }
+            swap(tabIn, tabOut);
+            if (profile)
+                m_profiler->stop(PROFILE_FORWARD, i);
+        }
+
+        // save outputs
+        for (int s=0; s < nbSample; s++)
+            for (int k=0; k < nbOutput; k++)
+                tabOutputs[first + s][k] = tabIn[k * blockSize + s];
+    }
+}
+
+double multilayerPerceptron::computeError()
+{
+    if (!checkTrainingSet())
+        return -1;
+
+    double learningError = 0;
+    vector<double> tabOutput;
+    for(int np=0; np < m_trainingSet->size(); np++)
+    {
+        const traningSetMlp &sample = (*m_trainingSet)[np];
+        if (sample.tabExamples.empty())
+            computeOutput(sample.tabNonZeroIndexes, sample.tabNonZeroValues, tabOutput);
+        else
+            computeOutput(sample.tabExamples, tabOutput);
+
+        double RmsError = 0;
+        for(int i=0; i < tabOutput.size(); i++)
+            RmsError += pow((sample.tabOutputTargets[i] - tabOutput[i]), 2);
+        learningError += sqrt(RmsError / (double) tabOutput.size());
+    }
+    return learningError / m_trainingSet->size();
+}
+
 bool multilayerPerceptron::computeFile(const string fileInUrl, string fileOutUrl)
 {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (m_profiler)
+        m_profiler->start();
     if (fileOutUrl == "")
         fileOutUrl = fileInUrl + "_out.txt";
 
@@ -260,16 +783,22 @@ bool multilayerPerceptron::computeFile(const string fileInUrl, string fileOutUrl
         return false;
     }
 
-    vector< vector<double> > tabSample;
-    tabSample.resize(nbSample);
+    // one contiguous matrix for all the samples, one for all the results
+    // the inputs are parsed from one buffer: extracting a double from the stream allocates for each value
+    vector<double> tabSample(max(0, nbSample) * nbInput);
+    long position = fileIn.tellg();
+    fileIn.seekg(0, ios::end);
+    string text(max(0L, (long) fileIn.tellg() - position), '\0');
+    fileIn.seekg(position);
+    fileIn.read(&text[0], text.size());
+    const char *p = text.c_str();
     for (int i=0; i < tabSample.size(); i++)
     {
-        tabSample[i].resize(nbInput);
-
-        for (int j=0; j < tabSample[i].size(); j++)
-        {
-            fileIn >> tabSample[i][j];
-        }
+        char *end = NULL;
+        tabSample[i] = strtod(p, &end);
+        if (end == p)
+            break;                                      // missing values stay 0
+        p = end;
     }
 
     ofstream fileOut(fileOutUrl.c_str(), ios::out | ios::trunc);
@@ -282,56 +811,82 @@ bool multilayerPerceptron::computeFile(const string fileInUrl, string fileOutUrl
 
     fileOut << "[mlp_result]" << endl;
 
-    // compute and save all samples
-    for (int i=0; i < tabSample.size(); i++)
-    {
-        vector<double> tabOutput;
-        computeOutput(tabSample[i], tabOutput);
+    // compute all samples
+    if (m_profiler)
+        m_profiler->stop(PROFILE_READ, 0);
+    vector<double> tabResult(max(0, nbSample) * nbOutput);
+    computeBatch(tabSample.data(), tabResult.data(), max(0, nbSample), (m_profiler != NULL) ? 1 : threadPool::instance().size());
 
+    // save all samples
+    for (int i=0; i < nbSample; i++)
+    {
         // write input
         fileOut << "Input: ";
-        for (int j=0; j < tabSample[i].size(); j++)
-            fileOut << tabSample[i][j] << " ";
+        for (int j=0; j < nbInput; j++)
+            fileOut << tabSample[i * nbInput + j] << " ";
 
         // write output
         fileOut << endl << "Output: ";
-        for (int k=0; k < tabOutput.size(); k++)
-            fileOut << tabOutput[k] << " ";
+        for (int k=0; k < nbOutput; k++)
+            fileOut << tabResult[i * nbOutput + k] << " ";
 
         fileOut << endl << endl;
     }
 
     fileIn.close();
     fileOut.close();
+    if (m_profiler)
+        m_profiler->stop(PROFILE_WRITE, 0);
+    addIoTime(start);
     return true;
 }
 
 bool multilayerPerceptron::learning(const int limit, const bool verbose, const bool randomShuffleTrainingSet)
 {
     // check training set
-    if (m_trainingSet.size() < 1)
-    {
-        cout <<  "Error: no training set loaded" << endl;
-        return false;
-    }
-    else if (m_trainingSet[0].tabExamples.size() != m_neuralNetwork[0].tabNeurons.size())
-    {
-        cout <<  "Error: the number of inputs of the training set does not match with the neural network layers" << endl;
-        return false;
-    }
-    else if (m_trainingSet[0].tabOutputTargets.size() != m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size())
-    {
-        cout <<  "Error: the number of outputs of the training set does not match with the neural network layers" << endl;
+    if (!checkTrainingSet())
         return false;
-    }
 
     srand((unsigned int) time(NULL));
     bool continueLearning = true;
     int nbLearning = 1;
+    randomizeWeights();
+
+    if (m_snapshotRate > 0)
+        publishSnapshot();
+
+    chrono::steady_clock::time_point lastReport;
+    while (continueLearning)
+    {
+        // learn all training patterns
+        double learningError = learnTrainingSet(randomShuffleTrainingSet);
+
+        if((limit > 0 && nbLearning >= limit) || m_cancelLearning)
+            continueLearning = false;
+
+        if (m_snapshotRate > 0 && (nbLearning % m_snapshotRate == 0 || !continueLearning))
+            publishSnapshot();
+
+        if (verbose || m_learningCallback)
+        {
+            ostringstream line;
+            line << "Epoch = " << nbLearning << " : " << "RMS Error = "  << learningError;
+            report(verbose, line.str(), lastReport, !continueLearning);
+        }
+        nbLearning++;
+    }
+    m_cancelLearning = false;
+    return true;
+}
 
-    // set random weights
+void multilayerPerceptron::randomizeWeights()
+{
+    m_tabPreviousIndexes.clear();
     for(int i=1; i < m_neuralNetwork.size(); i++)
     {
+        m_neuralNetwork[i].pruned = false;
+        m_neuralNetwork[i].sparseKernel = false;
+        m_neuralNetwork[i].csr = sparseLayer();
         for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
         {
             for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
@@ -341,90 +896,896 @@ bool multilayerPerceptron::learning(const int limit, const bool verbose, const b
             }
         }
     }
+}
 
-    while (continueLearning)
+bool multilayerPerceptron::partialFit(const vector< vector<double> > &tabInputs, const vector< vector<double> > &tabOutputTargets, const int nbPass)
+{
+    if (tabInputs.size() != tabOutputTargets.size())
     {
-        // random training data order (sometimes, gives better results)
-        if (randomShuffleTrainingSet)
-            random_shuffle(m_trainingSet.begin(), m_trainingSet.end());
+        cout <<  "Error: the number of inputs data does not match with the number of outputs data" << endl;
+        return false;
+    }
 
-        // learn all training patterns
-        double learningError = 0;
-        for(int np=0; np < m_trainingSet.size(); np++)
+    vector<traningSetMlp> tabSamples(tabInputs.size());
+    for (int i=0; i < tabSamples.size(); i++)
+    {
+        tabSamples[i].tabExamples = tabInputs[i];
+        tabSamples[i].tabOutputTargets = tabOutputTargets[i];
+    }
+    return partialFit(tabSamples, nbPass);
+}
+
+bool multilayerPerceptron::partialFit(const vector<traningSetMlp> &tabSamples, const int nbPass)
+{
+    if (nbPass < 1)
+    {
+        cout <<  "Error: the number of passes over the samples must be >= 1" << endl;
+        return false;
+    }
+
+    int nbInput = m_neuralNetwork[0].tabNeurons.size();
+    int nbOutput = m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size();
+    for (int i=0; i < tabSamples.size(); i++)
+    {
+        const traningSetMlp &sample = tabSamples[i];
+        bool inputs = sample.tabExamples.empty() ? sample.tabNonZeroIndexes.size() == sample.tabNonZeroValues.size()
+                                                 : sample.tabExamples.size() == nbInput;
+        for (int p=0; p < sample.tabNonZeroIndexes.size() && inputs; p++)
+            inputs = sample.tabNonZeroIndexes[p] >= 0 && sample.tabNonZeroIndexes[p] < nbInput;
+        if (!inputs)
+        {
+            cout <<  "Error: the number of inputs data does not match" << endl;
+            return false;
+        }
+        if (sample.tabOutputTargets.size() != nbOutput)
+        {
+            cout <<  "Error: the number of outputs data does not match" << endl;
+            return false;
+        }
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // a network that has neither learned nor loaded a state has zero weights: random weights from rand() (not reseeded).
+    // Otherwise the weights and the momentum are kept: the samples continue the previous learning
+    bool initialized = false;
+    for (int i=1; i < m_neuralNetwork.size() && !initialized; i++)
+    {
+        const double *weight = m_neuralNetwork[i].tabNeurons[0].weight;
+        size_t nbWeight = m_neuralNetwork[i].tabNeurons.size() * m_neuralNetwork[i-1].tabNeurons.size();
+        for (size_t w=0; w < nbWeight && !initialized; w++)
+            initialized = weight[w] != 0;
+    }
+    if (!initialized)
+        randomizeWeights();
+
+    // each pass learns the new samples in a random order, each one followed by replayRatio samples of the reservoir:
+    // the pass is a temporary training set learned by learnEpoch, as an epoch of learning() (same learning mode)
+    shared_ptr< vector<traningSetMlp> > trainingSet = m_trainingSet;
+    vector<int> tabTrainingOrder;
+    tabTrainingOrder.swap(m_tabOrder);
+    vector<int> tabOrder(tabSamples.size());
+    for (int i=0; i < tabOrder.size(); i++)
+        tabOrder[i] = i;
+    double learningError = 0;
+    long nbUpdate = 0;
+    double replayCredit = 0;
+    for (int pass=0; pass < nbPass; pass++)
+    {
+        random_shuffle(tabOrder.begin(), tabOrder.end());
+        shared_ptr< vector<traningSetMlp> > passSet = make_shared< vector<traningSetMlp> >();
+        passSet->reserve(tabSamples.size() * (1 + (int) ceil(m_replayRatio)));
+        for (int i=0; i < tabOrder.size(); i++)
+        {
+            passSet->push_back(tabSamples[tabOrder[i]]);
+            for (replayCredit += m_replayRatio; replayCredit >= 1 && !m_tabReplay.empty(); replayCredit -= 1)
+                passSet->push_back(m_tabReplay[rand() % m_tabReplay.size()]);
+        }
+
+        m_trainingSet = passSet;
+        m_tabOrder.resize(passSet->size());
+        for (int i=0; i < m_tabOrder.size(); i++)
+            m_tabOrder[i] = i;
+        learningError = learnEpoch();
+        nbUpdate += passSet->size();
+    }
+    m_trainingSet = trainingSet;
+    m_tabOrder.swap(tabTrainingOrder);
+
+    // reservoir sampling: the reservoir stays a uniform sample of all the samples given to partialFit
+    for (int i=0; i < tabSamples.size() && m_replaySize > 0; i++)
+    {
+        m_nbStreamed++;
+        if (m_tabReplay.size() < m_replaySize)
+            m_tabReplay.push_back(tabSamples[i]);
+        else
         {
-            // set inputs
-            for (int i=0; i < m_trainingSet[np].tabExamples.size(); i++)
-                m_neuralNetwork[0].tabNeurons[i].output = m_trainingSet[np].tabExamples[i];
+            long r = (long) ((double) rand() / ((double) RAND_MAX + 1) * m_nbStreamed);
+            if (r < m_replaySize)
+                m_tabReplay[r] = tabSamples[i];
+        }
+    }
+
+    if (m_snapshotRate > 0)
+        publishSnapshot();
+    m_stats.nbSample += nbUpdate;
+    m_stats.learningError = learningError;
+    m_stats.learningTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+double multilayerPerceptron::learnEpoch()
+{
+    // pipeline and accumulation: mini-batches, mixed precision: 16-bit copies (pruned layers are learned sample by sample in double)
+    bool dense = true;
+    for (int i=1; i < m_neuralNetwork.size(); i++)
+        dense = dense && !m_neuralNetwork[i].pruned;
+
+    if (m_pipeline && dense)
+        return m_pipeline->learnEpoch(*this);
+    else if (m_mixedPrecision && dense)
+        return m_mixedPrecision->learnEpoch(*this);
+    else if (m_accumulation && dense)
+        return m_accumulation->learnEpoch(*this);
+
+    double learningError = 0;
+    for(int np=0; np < m_trainingSet->size(); np++)
+        learningError = learningError + learnSample((*m_trainingSet)[m_tabOrder[np]]);
+    return learningError / max(1, (int) m_trainingSet->size());
+}
+
+void multilayerPerceptron::setReplay(const int replaySize, const double replayRatio)
+{
+    m_replaySize = max(0, replaySize);
+    m_replayRatio = max(0.0, replayRatio);
+    if (m_replaySize == 0)
+        m_nbStreamed = 0;
+    if (m_tabReplay.size() > m_replaySize)
+    {
+        // random subset of the reservoir
+        random_shuffle(m_tabReplay.begin(), m_tabReplay.end());
+        m_tabReplay.resize(m_replaySize);
+    }
+}
+
+int multilayerPerceptron::getReplaySize() const
+{
+    return m_replaySize;
+}
 
-            // compute output
-            for(int i=1; i < m_neuralNetwork.size(); i++)
+int multilayerPerceptron::getReplayCount() const
+{
+    return m_tabReplay.size();
+}
+
+double multilayerPerceptron::getReplayRatio() const
+{
+    return m_replayRatio;
+}
+
+bool multilayerPerceptron::prune(const double sparsity, const int fineTuneEpochs, const bool verbose)
+{
+    if (sparsity < 0 || sparsity >= 1)
+    {
+        cout <<  "Error: the sparsity must be in [0,1[" << endl;
+        return false;
+    }
+
+    if (fineTuneEpochs > 0 && !checkTrainingSet())
+        return false;
+
+    // zero the smallest-magnitude weights of each layer
+    for(int i=1; i < m_neuralNetwork.size(); i++)
+    {
+        vector<double> tabMagnitudes;
+        for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
+            for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
+                tabMagnitudes.push_back(fabs(m_neuralNetwork[i].tabNeurons[j].weight[k]));
+
+        int nbPruned = (int) (sparsity * tabMagnitudes.size());
+        if (nbPruned > 0)
+        {
+            nth_element(tabMagnitudes.begin(), tabMagnitudes.begin() + nbPruned - 1, tabMagnitudes.end());
+            double threshold = tabMagnitudes[nbPruned - 1];
+
+            // weights equal to the threshold are pruned until the target is reached
+            int nbTies = 0;
+            for (int p=0; p < nbPruned; p++)
+                if (tabMagnitudes[p] == threshold)
+                    nbTies++;
+
+            for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
             {
-                for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
+                for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
                 {
-                    double sum = 0;
-                    for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
-                        sum += m_neuralNetwork[i-1].tabNeurons[k].output * m_neuralNetwork[i].tabNeurons[j].weight[k];
-
-                    // sigmoid function
-                    m_neuralNetwork[i].tabNeurons[j].output = 1.0 / (1.0 + exp(-sum));
+                    double magnitude = fabs(m_neuralNetwork[i].tabNeurons[j].weight[k]);
+                    if (magnitude < threshold || (magnitude == threshold && nbTies-- > 0))
+                        m_neuralNetwork[i].tabNeurons[j].weight[k] = 0;
                 }
             }
+        }
+
+        m_neuralNetwork[i].pruned = true;
+        buildSparseLayer(i);
+    }
+
+    // fine-tuning: only the remaining weights are trained
+    chrono::steady_clock::time_point lastReport;
+    for (int epoch=1; epoch <= fineTuneEpochs; epoch++)
+    {
+        double learningError = learnTrainingSet(false);
+        if (verbose || m_learningCallback)
+        {
+            ostringstream line;
+            line << "Fine-tuning epoch = " << epoch << " : " << "RMS Error = "  << learningError;
+            report(verbose, line.str(), lastReport, epoch == fineTuneEpochs);
+        }
+    }
+
+    return true;
+}
 
-            double RmsError = 0;
-            for(int i=0; i < m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size(); i++)
+bool multilayerPerceptron::distill(const multilayerPerceptron &teacher, const int limit, const int nbGenerated, const bool verbose)
+{
+    if (!checkTrainingSet())
+        return false;
+
+    vector<int> tabTeacherNbNeurons = teacher.getTopology();
+    if (tabTeacherNbNeurons[0] != m_neuralNetwork[0].tabNeurons.size()
+            || tabTeacherNbNeurons[tabTeacherNbNeurons.size()-1] != m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size())
+    {
+        cout <<  "Error: the inputs and outputs of the teacher do not match with the neural network layers" << endl;
+        return false;
+    }
+
+    // temporary training set labelled by the teacher, the training set of the network is restored after learning
+    shared_ptr< const vector<traningSetMlp> > trainingSet = m_trainingSet;
+    shared_ptr< vector<traningSetMlp> > distillSet = make_shared< vector<traningSetMlp> >(*trainingSet);
+
+    // generated inputs: mixup of two random examples of the training set
+    srand((unsigned int) time(NULL));
+    int nbInput = m_neuralNetwork[0].tabNeurons.size();
+    int nbSample = trainingSet->size();
+    vector<double> tabMixup(nbInput, 0);
+    for (int g=0; g < nbGenerated; g++)
+    {
+        const traningSetMlp &a = (*trainingSet)[rand() % nbSample];
+        const traningSetMlp &b = (*trainingSet)[rand() % nbSample];
+        double lambda = (double) rand() / RAND_MAX;
+        traningSetMlp generated;
+
+        if (a.tabExamples.empty())
+        {
+            // sparse examples: the mixup is non-zero on the union of both index sets
+            for (int p=0; p < a.tabNonZeroIndexes.size(); p++)
+                tabMixup[a.tabNonZeroIndexes[p]] += lambda * a.tabNonZeroValues[p];
+            for (int p=0; p < b.tabNonZeroIndexes.size(); p++)
+                tabMixup[b.tabNonZeroIndexes[p]] += (1.0 - lambda) * b.tabNonZeroValues[p];
+
+            for (int pass=0; pass < 2; pass++)
             {
-                double output = m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons[i].output;
-                double target = m_trainingSet[np].tabOutputTargets[i];
-                m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons[i].error = (target - output) * output * (1.0 - output);
+                const vector<int> &tabIndexes = pass == 0 ? a.tabNonZeroIndexes : b.tabNonZeroIndexes;
+                for (int p=0; p < tabIndexes.size(); p++)
+                {
+                    int k = tabIndexes[p];
+                    if (tabMixup[k] != 0)
+                    {
+                        generated.tabNonZeroIndexes.push_back(k);
+                        generated.tabNonZeroValues.push_back(tabMixup[k]);
+                        tabMixup[k] = 0;
+                    }
+                }
+            }
+        }
+        else
+        {
+            generated.tabExamples.resize(nbInput);
+            for (int k=0; k < nbInput; k++)
+                generated.tabExamples[k] = lambda * a.tabExamples[k] + (1.0 - lambda) * b.tabExamples[k];
+        }
+        distillSet->push_back(generated);
+    }
+
+    // label all examples with the soft outputs of the teacher
+    vector< vector<double> > tabInputs(distillSet->size());
+    for (int i=0; i < distillSet->size(); i++)
+    {
+        if ((*distillSet)[i].tabExamples.empty())
+        {
+            tabInputs[i].assign(nbInput, 0);
+            for (int p=0; p < (*distillSet)[i].tabNonZeroIndexes.size(); p++)
+                tabInputs[i][(*distillSet)[i].tabNonZeroIndexes[p]] = (*distillSet)[i].tabNonZeroValues[p];
+        }
+        else
+            tabInputs[i] = (*distillSet)[i].tabExamples;
+    }
+
+    vector< vector<double> > tabTargets;
+    teacher.computeBatch(tabInputs, tabTargets, threadPool::instance().size());
+    for (int i=0; i < distillSet->size(); i++)
+        (*distillSet)[i].tabOutputTargets = tabTargets[i];
+
+    m_trainingSet = distillSet;
+    m_tabOrder.clear();
+    bool ret = learning(limit, verbose);
+    m_trainingSet = const_pointer_cast< vector<traningSetMlp> >(trainingSet);
+    m_tabOrder.clear();
+    return ret;
+}
+
+void multilayerPerceptron::cancelLearning()
+{
+    m_cancelLearning = true;
+}
+
+void multilayerPerceptron::setSnapshotRate(const int nbEpoch)
+{
+    m_snapshotRate = max(0, nbEpoch);
+    if (m_snapshotRate > 0)
+        publishSnapshot();                              // readers get the current weights until learning publishes
+}
+
+shared_ptr<multilayerPerceptron> multilayerPerceptron::getSnapshot() const
+{
+    return atomic_load(&m_snapshot);
+}
+
+void multilayerPerceptron::publishSnapshot()
+{
+    // double buffering: the weights are copied in the previous snapshot if no reader holds it any more,
+    // then the copy replaces the published one in a single atomic exchange
+    shared_ptr<multilayerPerceptron> snapshot;
+    snapshot.swap(m_spareSnapshot);
+    if (!snapshot || snapshot.use_count() > 1)
+        snapshot = make_shared<multilayerPerceptron>(getTopology(), m_eta, m_alpha);
+    else
+        atomic_thread_fence(memory_order_acquire);      // the last reader released it: its reads happen before the copy
+    snapshot->m_neuralNetwork = m_neuralNetwork;
+    m_spareSnapshot = atomic_exchange(&m_snapshot, snapshot);
+}
+
+void multilayerPerceptron::setStats(const bool enable)
+{
+    m_statsEnabled = enable;
+}
+
+void multilayerPerceptron::resetStats()
+{
+    m_stats = learningStats();
+}
+
+const learningStats &multilayerPerceptron::getStats()
+{
+    m_stats.samplesPerSecond = m_stats.learningTime > 0 ? m_stats.nbSample / m_stats.learningTime : 0;
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        m_stats.peakRss = usage.ru_maxrss * 1024L;      // kilobytes on Linux
+
+    long bytes = m_neuralNetwork.capacity() * sizeof(layer) + trainingSetCache::trainingSetBytes(*m_trainingSet);
+    for (int i=0; i < m_neuralNetwork.size(); i++)
+    {
+        const layer &current = m_neuralNetwork[i];
+        bytes += current.tabNeurons.capacity() * sizeof(neuron);
+        bytes += current.weights.capacity() * sizeof(double);
+        bytes += (current.csr.rowStart.capacity() + current.csr.column.capacity()) * sizeof(int)
+                 + (current.csr.value.capacity() + current.csr.deltaValue.capacity()) * sizeof(double);
+    }
+    if (m_mixedPrecision)
+        bytes += m_mixedPrecision->getBytes();
+    if (m_accumulation)
+        bytes += m_accumulation->getBytes();
+    bytes += trainingSetCache::trainingSetBytes(m_tabReplay);
+    m_stats.bytesAllocated = bytes;
+    return m_stats;
+}
+
+void multilayerPerceptron::setReportRate(const double maxReportRate)
+{
+    m_maxReportRate = maxReportRate;
+}
+
+void multilayerPerceptron::setLearningCallback(learningCallback callback, void *userData)
+{
+    m_learningCallback = callback;
+    m_learningCallbackData = userData;
+}
+
+void multilayerPerceptron::setProfiler(perfProfiler *profiler)
+{
+    m_profiler = profiler;
+}
+
+bool multilayerPerceptron::setPipeline(const int nbStages, const int microBatchSize, const int nbMicroBatch, const vector<int> &tabLayersPerStage)
+{
+    if (nbStages < 2)
+    {
+        m_pipeline.reset();
+        return true;
+    }
+    if (m_mixedPrecision)
+    {
+        cout << "Error: the pipeline learns in double (mixed precision is " << precisionName(getPrecision()) << ")" << endl;
+        return false;
+    }
+    if (m_accumulation)
+    {
+        cout << "Error: the pipeline accumulates its own micro-batches (accumulation off first)" << endl;
+        return false;
+    }
+
+    unique_ptr<mlpPipeline> pipeline(new mlpPipeline());
+    if (!pipeline->configure(getTopology(), nbStages, microBatchSize, nbMicroBatch, tabLayersPerStage))
+        return false;
+    m_pipeline.swap(pipeline);
+    return true;
+}
+
+int multilayerPerceptron::getPipelineStages() const
+{
+    return m_pipeline ? m_pipeline->getNbStages() : 1;
+}
+
+pipelineStats multilayerPerceptron::getPipelineStats() const
+{
+    return m_pipeline ? m_pipeline->getStats() : pipelineStats();
+}
+
+bool multilayerPerceptron::setPrecision(const mlpPrecision precision)
+{
+    if (precision == PRECISION_DOUBLE)
+    {
+        m_mixedPrecision.reset();
+        return true;
+    }
+    if (m_pipeline)
+    {
+        cout << "Error: the pipeline learns in double (pipeline off first)" << endl;
+        return false;
+    }
+    if (m_accumulation)
+    {
+        cout << "Error: gradient accumulation learns in double (accumulation off first)" << endl;
+        return false;
+    }
+    if (!m_mixedPrecision || m_mixedPrecision->getPrecision() != precision)
+        m_mixedPrecision.reset(new mlpMixedPrecision(precision));
+    return true;
+}
+
+mlpPrecision multilayerPerceptron::getPrecision() const
+{
+    return m_mixedPrecision ? m_mixedPrecision->getPrecision() : PRECISION_DOUBLE;
+}
+
+bool multilayerPerceptron::setAccumulation(const size_t memoryBudget, const int nbMicroBatch)
+{
+    if (memoryBudget == 0)
+    {
+        m_accumulation.reset();
+        return true;
+    }
+    if (m_pipeline)
+    {
+        cout << "Error: the pipeline accumulates its own micro-batches (pipeline off first)" << endl;
+        return false;
+    }
+    if (m_mixedPrecision)
+    {
+        cout << "Error: gradient accumulation learns in double (mixed precision is " << precisionName(getPrecision()) << ")" << endl;
+        return false;
+    }
+
+    unique_ptr<mlpAccumulation> accumulation(new mlpAccumulation());
+    if (!accumulation->configure(getTopology(), memoryBudget, nbMicroBatch))
+        return false;
+    m_accumulation.swap(accumulation);
+    return true;
+}
+
+bool multilayerPerceptron::getAccumulation(size_t &memoryBudget, int &microBatchSize, int &nbMicroBatch) const
+{
+    if (!m_accumulation)
+        return false;
+    memoryBudget = m_accumulation->getMemoryBudget();
+    microBatchSize = m_accumulation->getMicroBatchSize();
+    nbMicroBatch = m_accumulation->getNbMicroBatch();
+    return true;
+}
+
+void multilayerPerceptron::addPhaseTime(double &phaseTime, chrono::steady_clock::time_point &start)
+{
+    if (!m_statsEnabled)
+        return;
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+    phaseTime += chrono::duration<double>(stop - start).count();
+    start = stop;
+}
+
+void multilayerPerceptron::addIoTime(const chrono::steady_clock::time_point start)
+{
+    m_stats.ioTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void multilayerPerceptron::report(const bool verbose, const string &line, chrono::steady_clock::time_point &lastReport, const bool last)
+{
+    // rate-limited and buffered (no flush per line): reporting does not slow short epochs
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (!last && m_maxReportRate > 0 && chrono::duration<double>(now - lastReport).count() < 1.0 / m_maxReportRate)
+        return;
+    lastReport = now;
+
+    if (verbose)
+    {
+        cout << line << '\n';
+        if (last)
+            cout.flush();
+    }
+    if (m_learningCallback)
+        m_learningCallback(getStats(), m_learningCallbackData);
+}
+
+vector<int> multilayerPerceptron::getTopology() const
+{
+    vector<int> tabNbNeurons;
+    for (int i=0; i < m_neuralNetwork.size(); i++)
+        tabNbNeurons.push_back(m_neuralNetwork[i].tabNeurons.size());
+    return tabNbNeurons;
+}
+
+long multilayerPerceptron::getStateSize() const
+{
+    long size = sizeof(int) * (m_neuralNetwork.size() + 1);
+    for(int i=1; i < m_neuralNetwork.size(); i++)
+    {
+        if (m_neuralNetwork[i].pruned)
+            size += sizeof(int) * (2 + m_neuralNetwork[i].csr.rowStart.size() + m_neuralNetwork[i].csr.column.size())
+                    + sizeof(double) * m_neuralNetwork[i].csr.value.size();
+        else
+            size += sizeof(int) + sizeof(double) * m_neuralNetwork[i].tabNeurons.size() * m_neuralNetwork[i-1].tabNeurons.size();
+    }
+    return size;
+}
+
+shared_ptr< const vector<traningSetMlp> > multilayerPerceptron::getTrainingSet() const
+{
+    return m_trainingSet;
+}
+
+bool multilayerPerceptron::setTrainingSet(const shared_ptr< const vector<traningSetMlp> > &trainingSet)
+{
+    if (!trainingSet)
+    {
+        cout <<  "Error: no training set" << endl;
+        return false;
+    }
+    for (int i=0; i < trainingSet->size(); i++)
+    {
+        const traningSetMlp &sample = (*trainingSet)[i];
+        bool inputs = sample.tabExamples.empty() ? (sample.tabNonZeroIndexes.empty() || *max_element(sample.tabNonZeroIndexes.begin(), sample.tabNonZeroIndexes.end()) < m_neuralNetwork[0].tabNeurons.size())
+                                                 : (sample.tabExamples.size() == m_neuralNetwork[0].tabNeurons.size());
+        if (!inputs || sample.tabOutputTargets.size() != m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size())
+        {
+            cout <<  "Error: the training set does not match with the neural network layers" << endl;
+            return false;
+        }
+    }
+
+    // never modified in place while shared: editTrainingSet copies it first
+    m_trainingSet = const_pointer_cast< vector<traningSetMlp> >(trainingSet);
+    m_tabOrder.clear();
+    return true;
+}
+
+vector<traningSetMlp> &multilayerPerceptron::editTrainingSet(const bool keepSamples)
+{
+    if (m_trainingSet.use_count() > 1)
+    {
+        if (keepSamples)
+            m_trainingSet = make_shared< vector<traningSetMlp> >(*m_trainingSet);
+        else
+            m_trainingSet = make_shared< vector<traningSetMlp> >();
+    }
+    m_tabOrder.clear();
+    return *m_trainingSet;
+}
+
+bool multilayerPerceptron::checkTrainingSet()
+{
+    if (m_trainingSet->size() < 1)
+    {
+        cout <<  "Error: no training set loaded" << endl;
+        return false;
+    }
+    else if (!(*m_trainingSet)[0].tabExamples.empty() && (*m_trainingSet)[0].tabExamples.size() != m_neuralNetwork[0].tabNeurons.size())
+    {
+        cout <<  "Error: the number of inputs of the training set does not match with the neural network layers" << endl;
+        return false;
+    }
+    else if ((*m_trainingSet)[0].tabOutputTargets.size() != m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size())
+    {
+        cout <<  "Error: the number of outputs of the training set does not match with the neural network layers" << endl;
+        return false;
+    }
+    return true;
+}
 
-                RmsError += pow((target - output), 2);
+void multilayerPerceptron::computeLayers(const int firstLayer)
+{
+    for(int i=firstLayer; i < m_neuralNetwork.size(); i++)
+    {
+        const layer &previous = m_neuralNetwork[i-1];
+        layer &current = m_neuralNetwork[i];
+        for(int j=0; j < current.tabNeurons.size(); j++)
+        {
+            double sum = 0;
+            if (current.sparseKernel)
+            {
+                for (int p=current.csr.rowStart[j]; p < current.csr.rowStart[j+1]; p++)
+                    sum += previous.tabNeurons[current.csr.column[p]].output * current.csr.value[p];
+            }
+            else
+            {
+                for (int k=0; k < previous.tabNeurons.size(); k++)
+                    sum += previous.tabNeurons[k].output * current.tabNeurons[j].weight[k];
             }
-            RmsError = sqrt(RmsError / (double) m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size());
 
-            // error backpropagation
-            for(int i = m_neuralNetwork.size()-2; i >= 0; i--)
+            // sigmoid function
+            current.tabNeurons[j].output = 1.0 / (1.0 + exp(-sum));
+        }
+
+        if (m_profiler)
+            m_profiler->stop(PROFILE_FORWARD, i);
+    }
+}
+
+void multilayerPerceptron::computeSparseInput(const vector<int> &tabIndexes, const vector<double> &tabValues)
+{
+    layer &first = m_neuralNetwork[1];
+    if (first.pruned)
+    {
+        // the csr of a pruned layer is stored by neuron: use the dense path
+        for (int i=0; i < m_neuralNetwork[0].tabNeurons.size(); i++)
+            m_neuralNetwork[0].tabNeurons[i].output = 0;
+        for (int p=0; p < tabIndexes.size(); p++)
+            m_neuralNetwork[0].tabNeurons[tabIndexes[p]].output = tabValues[p];
+        computeLayers();
+        return;
+    }
+
+    // first layer: only the columns of the non-zero inputs are read
+    for(int j=0; j < first.tabNeurons.size(); j++)
+    {
+        const double *weight = first.tabNeurons[j].weight;
+        double sum = 0;
+        for (int p=0; p < tabIndexes.size(); p++)
+            sum += tabValues[p] * weight[tabIndexes[p]];
+
+        // sigmoid function
+        first.tabNeurons[j].output = 1.0 / (1.0 + exp(-sum));
+    }
+
+    if (m_profiler)
+        m_profiler->stop(PROFILE_FORWARD, 1);
+    computeLayers(2);
+}
+
+double multilayerPerceptron::learnTrainingSet(const bool randomShuffleTrainingSet)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    chrono::steady_clock::time_point phaseStart = start;
+
+    // random training data order (sometimes, gives better results): the indexes are shuffled, the training set may be shared
+    if (m_tabOrder.size() != m_trainingSet->size())
+    {
+        m_tabOrder.resize(m_trainingSet->size());
+        for (int i=0; i < m_tabOrder.size(); i++)
+            m_tabOrder[i] = i;
+    }
+    if (randomShuffleTrainingSet)
+    {
+        if (m_profiler)
+            m_profiler->start();
+        random_shuffle(m_tabOrder.begin(), m_tabOrder.end());
+        addPhaseTime(m_stats.shuffleTime, phaseStart);
+        if (m_profiler)
+            m_profiler->stop(PROFILE_SHUFFLE, 0);
+    }
+
+    double learningError = learnEpoch();
+
+    m_stats.nbEpoch++;
+    m_stats.nbSample += m_trainingSet->size();
+    m_stats.learningError = learningError;
+    m_stats.learningTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return learningError;
+}
+
+// one row of weights of the backward pass: its error is scattered into the previous layer with the weights
+// of the forward pass, then the row is updated (momentum)
+static inline void backwardRow(double *weight, double *deltaWeight, const double *tabPrevious, double *tabErrors, const double error, const double eta, const double alpha, const int nbPrevious)
+{
+    for (int k=0; k < nbPrevious; k++)
+    {
+        tabErrors[k] += weight[k] * error;
+        double momentum = deltaWeight[k];
+        deltaWeight[k] = eta * (tabPrevious[k] * error);
+        weight[k] += deltaWeight[k] + (alpha * momentum);
+    }
+}
+
+// row of the first layer: the errors of the inputs are not needed
+static inline void updateRow(double *weight, double *deltaWeight, const double *tabPrevious, const double error, const double eta, const double alpha, const int nbPrevious)
+{
+    for (int k=0; k < nbPrevious; k++)
+    {
+        double momentum = deltaWeight[k];
+        deltaWeight[k] = eta * (tabPrevious[k] * error);
+        weight[k] += deltaWeight[k] + (alpha * momentum);
+    }
+}
+
+double multilayerPerceptron::learnSample(const traningSetMlp &sample)
+{
+    chrono::steady_clock::time_point phaseStart;
+    if (m_statsEnabled)
+        phaseStart = chrono::steady_clock::now();
+    if (m_profiler)
+        m_profiler->start();
+
+    bool sparseInput = sample.tabExamples.empty() && !m_neuralNetwork[1].pruned;
+    if (sample.tabExamples.empty())
+    {
+        // compute output
+        computeSparseInput(sample.tabNonZeroIndexes, sample.tabNonZeroValues);
+    }
+    else
+    {
+        // set inputs
+        for (int i=0; i < sample.tabExamples.size(); i++)
+            m_neuralNetwork[0].tabNeurons[i].output = sample.tabExamples[i];
+
+        // compute output
+        computeLayers();
+    }
+    addPhaseTime(m_stats.forwardTime, phaseStart);
+
+    double RmsError = 0;
+    for(int i=0; i < m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size(); i++)
+    {
+        double output = m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons[i].output;
+        double target = sample.tabOutputTargets[i];
+        m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons[i].error = (target - output) * output * (1.0 - output);
+
+        RmsError += pow((target - output), 2);
+    }
+    RmsError = sqrt(RmsError / (double) m_neuralNetwork[m_neuralNetwork.size()-1].tabNeurons.size());
+    addPhaseTime(m_stats.outputErrorTime, phaseStart);
+    if (m_profiler)
+        m_profiler->stop(PROFILE_OUTPUT_ERROR, m_neuralNetwork.size()-1);
+
+    // backward pass, from the output layer down: the weights of a layer are read once, row by row (contiguous).
+    // Each row scatters the error of its neuron into the previous layer with the weights of the forward pass,
+    // then the same row is updated: the errors and the updates are the ones of separate passes.
+    // The input layer has no weights: layer 1 is only updated.
+    static thread_local mlpArena arena;
+    int nbMaxNeuron = 0;
+    for (int i=0; i < m_neuralNetwork.size(); i++)
+        nbMaxNeuron = max(nbMaxNeuron, (int) m_neuralNetwork[i].tabNeurons.size());
+    arena.reset();
+    arena.reserve(2 * mlpArena::blockSize(nbMaxNeuron));
+    double *tabPrevious = arena.allocate(nbMaxNeuron);  // outputs of the previous layer, contiguous
+    double *tabErrors = arena.allocate(nbMaxNeuron);    // errors of the previous layer, contiguous
+
+    for(int i = m_neuralNetwork.size()-1; i >= 1; i--)
+    {
+        layer &current = m_neuralNetwork[i];
+        layer &previous = m_neuralNetwork[i-1];
+        int nbPrevious = previous.tabNeurons.size();
+        bool propagate = (i > 1);
+        if (i == 1)
+            addPhaseTime(m_stats.backpropagationTime, phaseStart);
+
+        if (i == 1 && sparseInput)
+        {
+            for(int j=0; j < current.tabNeurons.size(); j++)
             {
-                for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
+                // zero inputs give a zero update: only the momentum of the columns of the previous example remains
+                double error = current.tabNeurons[j].error;
+                double *weight = current.tabNeurons[j].weight;
+                double *deltaWeight = current.tabNeurons[j].deltaWeight;
+                for (int p=0; p < m_tabPreviousIndexes.size(); p++)
                 {
-                    double output = m_neuralNetwork[i].tabNeurons[j].output;
-                    double sum = 0;
-                    for (int k=0; k < m_neuralNetwork[i+1].tabNeurons.size(); k++)
-                        sum += m_neuralNetwork[i+1].tabNeurons[k].weight[j] * m_neuralNetwork[i+1].tabNeurons[k].error;
-                    m_neuralNetwork[i].tabNeurons[j].error = sum * output * (1.0 - output);
+                    int k = m_tabPreviousIndexes[p];
+                    weight[k] += m_alpha * deltaWeight[k];
+                    deltaWeight[k] = 0;
+                }
+                for (int p=0; p < sample.tabNonZeroIndexes.size(); p++)
+                {
+                    int k = sample.tabNonZeroIndexes[p];
+                    deltaWeight[k] = m_eta * (sample.tabNonZeroValues[p] * error);
+                    weight[k] += deltaWeight[k];
                 }
             }
+        }
+        else
+        {
+            for (int k=0; k < nbPrevious; k++)
+                tabPrevious[k] = previous.tabNeurons[k].output;
+            if (propagate)
+                fill_n(tabErrors, nbPrevious, 0);
 
-            // compute weights
-            for(int i=1; i < m_neuralNetwork.size(); i++)
+            for(int j=0; j < current.tabNeurons.size(); j++)
             {
-                for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
+                double error = current.tabNeurons[j].error;
+                if (current.pruned)
                 {
-                    double error = m_neuralNetwork[i].tabNeurons[j].error;
-                    for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
+                    // only the remaining weights: pruned weights stay at zero, the dense copy is kept in sync
+                    for (int p=current.csr.rowStart[j]; p < current.csr.rowStart[j+1]; p++)
                     {
-                        double deltaWeight = m_neuralNetwork[i].tabNeurons[j].deltaWeight[k];
-                        double output = m_neuralNetwork[i-1].tabNeurons[k].output;
-                        m_neuralNetwork[i].tabNeurons[j].deltaWeight[k] = m_eta * (output * error);
-                        m_neuralNetwork[i].tabNeurons[j].weight[k] += m_neuralNetwork[i].tabNeurons[j].deltaWeight[k] + (m_alpha * deltaWeight);
+                        int k = current.csr.column[p];
+                        if (propagate)
+                            tabErrors[k] += current.csr.value[p] * error;
+                        double deltaWeight = current.csr.deltaValue[p];
+                        current.csr.deltaValue[p] = m_eta * (tabPrevious[k] * error);
+                        current.csr.value[p] += current.csr.deltaValue[p] + (m_alpha * deltaWeight);
+                        current.tabNeurons[j].weight[k] = current.csr.value[p];
                     }
                 }
+                else if (propagate)
+                    backwardRow(current.tabNeurons[j].weight, current.tabNeurons[j].deltaWeight, tabPrevious, tabErrors, error, m_eta, m_alpha, nbPrevious);
+                else
+                    updateRow(current.tabNeurons[j].weight, current.tabNeurons[j].deltaWeight, tabPrevious, error, m_eta, m_alpha, nbPrevious);
+            }
+
+            if (propagate)
+            {
+                for (int k=0; k < nbPrevious; k++)
+                {
+                    double output = tabPrevious[k];
+                    previous.tabNeurons[k].error = tabErrors[k] * output * (1.0 - output);
+                }
             }
-            learningError = learningError + RmsError;
         }
-        learningError = learningError / m_trainingSet.size();
 
-        if(limit > 0 && nbLearning >= limit)
-            continueLearning = false;
+        if (m_profiler)
+            m_profiler->stop(propagate ? PROFILE_BACKPROPAGATION : PROFILE_UPDATE, i);
+    }
 
-        if (verbose)
-            cout << "Epoch = " << nbLearning << " : " << "RMS Error = "  << learningError << endl;
-        nbLearning++;
+    if (sparseInput)
+        m_tabPreviousIndexes = sample.tabNonZeroIndexes;
+    addPhaseTime(m_stats.updateTime, phaseStart);
+    return RmsError;
+}
+
+void multilayerPerceptron::buildSparseLayer(const int i)
+{
+    layer &current = m_neuralNetwork[i];
+    int nbPrevious = m_neuralNetwork[i-1].tabNeurons.size();
+
+    current.csr = sparseLayer();
+    current.csr.rowStart.push_back(0);
+    for(int j=0; j < current.tabNeurons.size(); j++)
+    {
+        for (int k=0; k < nbPrevious; k++)
+        {
+            if (current.tabNeurons[j].weight[k] != 0)
+            {
+                current.csr.column.push_back(k);
+                current.csr.value.push_back(current.tabNeurons[j].weight[k]);
+            }
+        }
+        current.csr.rowStart.push_back(current.csr.value.size());
     }
-    return true;
+    current.csr.deltaValue.assign(current.csr.value.size(), 0);
+
+    // the csr kernel pays an index load per weight: only use it when enough weights are pruned
+    double density = (double) current.csr.value.size() / max(1, (int) current.tabNeurons.size() * nbPrevious);
+    current.sparseKernel = density <= SPARSE_KERNEL_MAX_DENSITY;
 }
 
 bool multilayerPerceptron::saveState(const string fileUrl)
 {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
     ofstream file(fileUrl.c_str(), ios::out | ios::binary);
     if (!file.is_open())
     {
@@ -432,9 +1793,16 @@ bool multilayerPerceptron::saveState(const string fileUrl)
         return false;
     }
 
+    bool sparse = false;
+    for(int i=1; i < m_neuralNetwork.size(); i++)
+        if (m_neuralNetwork[i].pruned)
+            sparse = true;
+
     // save neural network structure: save nb of layers
+    // (a negative number announces a pruned network: each layer starts with its format, dense or csr)
     int nbLayer = m_neuralNetwork.size();
-    file.write((char *) &nbLayer, sizeof nbLayer);
+    int header = sparse ? -nbLayer : nbLayer;
+    file.write((char *) &header, sizeof header);
 
     // save neural network structure: save nb of neurons per layer
     for (int i=0; i < nbLayer; i++)
@@ -446,6 +1814,26 @@ bool multilayerPerceptron::saveState(const string fileUrl)
     // save weights
     for(int i=1; i < m_neuralNetwork.size(); i++)
     {
+        if (sparse)
+        {
+            int pruned = m_neuralNetwork[i].pruned ? 1 : 0;
+            file.write((char *) &pruned, sizeof pruned);
+        }
+
+        if (m_neuralNetwork[i].pruned)
+        {
+            const sparseLayer &csr = m_neuralNetwork[i].csr;
+            int nbWeight = csr.value.size();
+            file.write((char *) &nbWeight, sizeof nbWeight);
+            file.write((char *) &csr.rowStart[0], sizeof(int) * csr.rowStart.size());
+            if (nbWeight > 0)
+            {
+                file.write((char *) &csr.column[0], sizeof(int) * nbWeight);
+                file.write((char *) &csr.value[0], sizeof(double) * nbWeight);
+            }
+            continue;
+        }
+
         for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
         {
             for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
@@ -457,19 +1845,36 @@ bool multilayerPerceptron::saveState(const string fileUrl)
     }
 
     file.close();
+    addIoTime(start);
     return true;
 }
 
 bool multilayerPerceptron::loadState(const string fileUrl)
 {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
     ifstream file;
     file.open(fileUrl.c_str(), ios::in | ios::binary);
     if (!file.is_open())
         return false;
+    file.seekg(0, ios::end);
+    long fileSize = file.tellg();
+    file.seekg(0, ios::beg);
+
+    // the whole file is read and checked before the network is changed: a corrupt or truncated file leaves it as it is
+    auto corrupt = [&]() {
+        cout << "Error: corrupt state file " << fileUrl << endl;
+        return false;
+    };
+    auto fits = [&](const long nbBytes) { return nbBytes >= 0 && (long) file.tellg() >= 0 && nbBytes <= fileSize - (long) file.tellg(); };
 
     // load neural network structure: load nb of layers
     int nbLayer = 0;
     file.read((char *) &nbLayer, sizeof nbLayer);
+    bool sparse = nbLayer < 0;
+    if (sparse)
+        nbLayer = -nbLayer;
+    if (file.fail() || nbLayer < 2 || !fits((long) nbLayer * sizeof(int)))
+        return corrupt();
 
     // load neural network structure: load nb of neurons per layer
     vector<int> tabNbNeurons;
@@ -477,32 +1882,94 @@ bool multilayerPerceptron::loadState(const string fileUrl)
     for (int i=0; i < nbLayer; i++)
     {
         file.read((char *) &nbNeuron, sizeof nbNeuron);
+        if (file.fail() || nbNeuron < 1 || nbNeuron > MAX_LAYER_NEURONS)
+            return corrupt();
         tabNbNeurons.push_back(nbNeuron);
     }
 
+    // load weights: csr arrays of the pruned layers, nbNeurons x nbPrevious weights of the dense ones
+    vector<int> tabPruned(nbLayer, 0);
+    vector< vector<int> > tabRowStart(nbLayer);
+    vector< vector<int> > tabColumn(nbLayer);
+    vector< vector<double> > tabValue(nbLayer);
+    for(int i=1; i < nbLayer; i++)
+    {
+        int nbPrevious = tabNbNeurons[i-1];
+        long nbDense = (long) tabNbNeurons[i] * nbPrevious;
+        if (sparse)
+            file.read((char *) &tabPruned[i], sizeof tabPruned[i]);
+
+        if (tabPruned[i])
+        {
+            int nbWeight = -1;
+            file.read((char *) &nbWeight, sizeof nbWeight);
+            if (file.fail() || nbWeight < 0 || nbWeight > nbDense
+                || !fits(sizeof(int) * (tabNbNeurons[i] + 1L) + (sizeof(int) + sizeof(double)) * (long) nbWeight))
+                return corrupt();
+
+            vector<int> &rowStart = tabRowStart[i];
+            vector<int> &column = tabColumn[i];
+            rowStart.resize(tabNbNeurons[i] + 1);
+            column.resize(nbWeight);
+            tabValue[i].resize(nbWeight);
+            file.read((char *) &rowStart[0], sizeof(int) * rowStart.size());
+            if (nbWeight > 0)
+            {
+                file.read((char *) &column[0], sizeof(int) * nbWeight);
+                file.read((char *) &tabValue[i][0], sizeof(double) * nbWeight);
+            }
+            if (file.fail() || rowStart[0] != 0 || rowStart.back() != nbWeight)
+                return corrupt();
+            for (int j=0; j < tabNbNeurons[i]; j++)
+                if (rowStart[j+1] < rowStart[j])
+                    return corrupt();
+            for (int p=0; p < nbWeight; p++)
+                if (column[p] < 0 || column[p] >= nbPrevious)
+                    return corrupt();
+            continue;
+        }
+
+        if (!fits(sizeof(double) * nbDense))
+            return corrupt();
+        tabValue[i].resize(nbDense);
+        file.read((char *) tabValue[i].data(), sizeof(double) * nbDense);
+        if (file.fail())
+            return corrupt();
+    }
+    file.close();
+
     // adapt layers
     initLayers(tabNbNeurons);
-
-    // load weights
     for(int i=1; i < m_neuralNetwork.size(); i++)
     {
+        int nbPrevious = tabNbNeurons[i-1];
         for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
         {
-            for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
+            double *weight = m_neuralNetwork[i].tabNeurons[j].weight;
+            if (!tabPruned[i])
             {
-                double weight;
-                file.read((char *) &weight, sizeof weight);
-                m_neuralNetwork[i].tabNeurons[j].weight[k] = weight;
+                copy_n(&tabValue[i][(size_t) j * nbPrevious], nbPrevious, weight);
+                continue;
             }
+            fill_n(weight, nbPrevious, 0);
+            for (int p=tabRowStart[i][j]; p < tabRowStart[i][j+1]; p++)
+                weight[tabColumn[i][p]] = tabValue[i][p];
+        }
+
+        if (tabPruned[i])
+        {
+            m_neuralNetwork[i].pruned = true;
+            buildSparseLayer(i);
         }
     }
 
-    file.close();
+    addIoTime(start);
     return true;
 }
 
 bool multilayerPerceptron::saveStateText(const string fileUrl)
 {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
     ofstream file(fileUrl.c_str(), ios::out | ios::trunc);
     if (!file.is_open())
     {
@@ -523,6 +1990,39 @@ bool multilayerPerceptron::saveStateText(const string fileUrl)
         file << " " << nbNeuron ;
     }
 
+    bool sparse = false;
+    for(int i=1; i < m_neuralNetwork.size(); i++)
+        if (m_neuralNetwork[i].pruned)
+            sparse = true;
+
+    if (sparse)
+    {
+        // pruned network: each neuron is saved as its number of weights followed by index:weight pairs
+        file << endl << endl << "[mlp_sparse_weights]" << endl;
+        for(int i=1; i < m_neuralNetwork.size(); i++)
+        {
+            file << "pruned " << m_neuralNetwork[i].pruned << endl;  // explicit: a layer pruned by 0 keeps all its weights
+            for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
+            {
+                int nbWeight = 0;
+                for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
+                    if (!m_neuralNetwork[i].pruned || m_neuralNetwork[i].tabNeurons[j].weight[k] != 0)
+                        nbWeight++;
+
+                file << nbWeight << " ";
+                for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
+                    if (!m_neuralNetwork[i].pruned || m_neuralNetwork[i].tabNeurons[j].weight[k] != 0)
+                        file << k << ":" << m_neuralNetwork[i].tabNeurons[j].weight[k] << " ";
+
+                file << endl ;
+            }
+            file << endl ;
+        }
+        file.close();
+        addIoTime(start);
+        return true;
+    }
+
     file << endl << endl << "[mlp_weights]" << endl;
     for(int i=1; i < m_neuralNetwork.size(); i++)
     {
@@ -537,11 +2037,13 @@ bool multilayerPerceptron::saveStateText(const string fileUrl)
     }
 
     file.close();
+    addIoTime(start);
     return true;
 }
 
 bool multilayerPerceptron::loadStateText(const string fileUrl)
 {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
     ifstream file;
     file.open(fileUrl.c_str());
     if (!file.is_open())
@@ -572,7 +2074,50 @@ bool multilayerPerceptron::loadStateText(const string fileUrl)
     initLayers(tabNbNeurons);
 
     file >> word;
-    if (word !=  "[mlp_weights]")
+    if (word ==  "[mlp_sparse_weights]")
+    {
+        for(int i=1; i < m_neuralNetwork.size(); i++)
+        {
+            // layer marker, files saved before it have the first nbWeight instead
+            int pruned = -1;
+            file >> word;
+            if (word == "pruned")
+                file >> pruned;
+            else
+                file.seekg(-(streamoff) word.size(), ios::cur);
+
+            int nbLayerWeight = 0;
+            for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
+            {
+                int nbWeight = 0;
+                file >> nbWeight;
+                fill_n(m_neuralNetwork[i].tabNeurons[j].weight, m_neuralNetwork[i-1].tabNeurons.size(), 0);
+                for (int p=0; p < nbWeight; p++)
+                {
+                    int k = 0;
+                    char separator;
+                    double weight = 0;
+                    file >> k >> separator >> weight;
+                    if (k >= 0 && k < m_neuralNetwork[i-1].tabNeurons.size())
+                        m_neuralNetwork[i].tabNeurons[j].weight[k] = weight;
+                }
+                nbLayerWeight += nbWeight;
+            }
+
+            // without a marker, a layer with missing weights has been pruned
+            if (pruned == -1)
+                pruned = nbLayerWeight < m_neuralNetwork[i].tabNeurons.size() * m_neuralNetwork[i-1].tabNeurons.size();
+            if (pruned)
+            {
+                m_neuralNetwork[i].pruned = true;
+                buildSparseLayer(i);
+            }
+        }
+        file.close();
+        addIoTime(start);
+        return true;
+    }
+    else if (word !=  "[mlp_weights]")
         return false;
 
     for(int i=1; i < m_neuralNetwork.size(); i++)
@@ -584,31 +2129,160 @@ bool multilayerPerceptron::loadStateText(const string fileUrl)
         }
     }
 
+    file.close();
+    addIoTime(start);
+    return true;
+}
+
+bool multilayerPerceptron::exportCpp(const string fileUrl) const
+{
+    ofstream file(fileUrl.c_str(), ios::out | ios::trunc);
+    if (!file.is_open())
+    {
+        cout <<  "error: can't open file " << fileUrl << endl;
+        return false;
+    }
+
+    // namespace and include guard from the file name
+    string name = fileUrl.substr(fileUrl.find_last_of("/\\") + 1);
+    name = name.substr(0, name.find('.'));
+    for (int i=0; i < name.size(); i++)
+        if (!isalnum((unsigned char) name[i]))
+            name[i] = '_';
+    if (name == "" || isdigit((unsigned char) name[0]))
+        name = "mlp_" + name;
+    string guard = name;
+    for (int i=0; i < guard.size(); i++)
+        guard[i] = toupper((unsigned char) guard[i]);
+    guard += "_HPP";
+
+    // 17 significant digits: the weights are read back exactly, outputs match computeOutput
+    file.precision(17);
+
+    file << "// Generated by mimetik (exportCpp): multilayer perceptron";
+    for (int i=0; i < m_neuralNetwork.size(); i++)
+        file << " " << m_neuralNetwork[i].tabNeurons.size();
+    file << endl;
+    file << "// usage: " << name << "::predict(inputs, outputs) with double inputs[nbInputs], outputs[nbOutputs]" << endl << endl;
+    file << "#ifndef " << guard << endl;
+    file << "#define " << guard << endl << endl;
+    file << "#include <cmath>" << endl << endl;
+    file << "namespace " << name << endl << "{" << endl;
+
+    file << "constexpr int nbLayers = " << m_neuralNetwork.size() << ";" << endl;
+    for (int i=0; i < m_neuralNetwork.size(); i++)
+        file << "constexpr int nbNeurons" << i << " = " << m_neuralNetwork[i].tabNeurons.size() << ";" << endl;
+    file << "constexpr int nbInputs = nbNeurons0;" << endl;
+    file << "constexpr int nbOutputs = nbNeurons" << m_neuralNetwork.size() - 1 << ";" << endl << endl;
+
+    for(int i=1; i < m_neuralNetwork.size(); i++)
+    {
+        file << "alignas(64) static constexpr double weights" << i << "[nbNeurons" << i << "][nbNeurons" << i-1 << "] =" << endl << "{" << endl;
+        for(int j=0; j < m_neuralNetwork[i].tabNeurons.size(); j++)
+        {
+            file << "    {";
+            for (int k=0; k < m_neuralNetwork[i-1].tabNeurons.size(); k++)
+                file << (k > 0 ? ", " : "") << m_neuralNetwork[i].tabNeurons[j].weight[k];
+            file << "}," << endl;
+        }
+        file << "};" << endl << endl;
+    }
+
+    // the loop bounds are compile-time constants: the compiler unrolls and vectorizes them for each layer
+    file << "template <int nbNeuron, int nbPrevious>" << endl;
+    file << "inline void computeLayer(const double (&weights)[nbNeuron][nbPrevious], const double *input, double *output)" << endl;
+    file << "{" << endl;
+    file << "    for (int j = 0; j < nbNeuron; j++)" << endl;
+    file << "    {" << endl;
+    file << "        double sum = 0;" << endl;
+    file << "        for (int k = 0; k < nbPrevious; k++)" << endl;
+    file << "            sum += input[k] * weights[j][k];" << endl;
+    file << "        output[j] = 1.0 / (1.0 + std::exp(-sum));     // sigmoid function" << endl;
+    file << "    }" << endl;
+    file << "}" << endl << endl;
+
+    file << "inline void predict(const double *input, double *output)" << endl << "{" << endl;
+    for(int i=1; i < m_neuralNetwork.size() - 1; i++)
+        file << "    alignas(64) double layer" << i << "[nbNeurons" << i << "];" << endl;
+    for(int i=1; i < m_neuralNetwork.size(); i++)
+    {
+        string in = (i == 1) ? "input" : "layer" + to_string(i-1);
+        string out = (i == m_neuralNetwork.size() - 1) ? "output" : "layer" + to_string(i);
+        file << "    computeLayer(weights" << i << ", " << in << ", " << out << ");" << endl;
+    }
+    file << "}" << endl;
+    file << "} // namespace " << name << endl << endl;
+    file << "#endif // " << guard << endl;
+
     file.close();
     return true;
 }
 
 void multilayerPerceptron::initLayers(const vector<int> &tabNbNeurons)
 {
+    if (m_pipeline && tabNbNeurons != getTopology())
+        m_pipeline.reset();                             // stages of the previous topology
+    if (m_accumulation && tabNbNeurons != getTopology()
+        && !m_accumulation->configure(tabNbNeurons, m_accumulation->getMemoryBudget(), m_accumulation->getNbMicroBatch()))
+        m_accumulation.reset();                         // the budget does not fit the new topology
+    if (tabNbNeurons != getTopology())
+    {
+        m_tabReplay.clear();                            // samples of the previous topology
+        m_nbStreamed = 0;
+    }
+
     m_neuralNetwork.resize(tabNbNeurons.size());
     for (int i=0; i < tabNbNeurons.size(); i++)
     {
-        m_neuralNetwork[i].tabNeurons.resize(tabNbNeurons[i]);
+        layer &current = m_neuralNetwork[i];
+        current.pruned = false;
+        current.sparseKernel = false;
+        current.csr = sparseLayer();
+        current.tabNeurons.resize(tabNbNeurons[i]);
+
+        // one arena per layer: the weights then the momentum of all neurons, neuron by neuron
+        int nbPrevious = (i == 0) ? 0 : tabNbNeurons[i-1];
+        size_t nbWeight = (size_t) tabNbNeurons[i] * nbPrevious;
+        current.weights.reset();
+        current.weights.reserve(2 * mlpArena::blockSize(nbWeight));
+        double *weight = current.weights.allocate(nbWeight);
+        double *deltaWeight = current.weights.allocate(nbWeight);
+        fill_n(current.weights.data(), current.weights.used(), 0);
+
         for(int j=0; j < tabNbNeurons[i]; j++)
         {
-            m_neuralNetwork[i].tabNeurons[j].output = 0;
-            m_neuralNetwork[i].tabNeurons[j].error = 0;
+            current.tabNeurons[j].output = 0;
+            current.tabNeurons[j].error = 0;
+            current.tabNeurons[j].weight = (i == 0) ? NULL : weight + j * nbPrevious;
+            current.tabNeurons[j].deltaWeight = (i == 0) ? NULL : deltaWeight + j * nbPrevious;
+        }
+    }
+}
 
-            if(i == 0)
-            {
-                m_neuralNetwork[i].tabNeurons[j].weight.resize(0);
-                m_neuralNetwork[i].tabNeurons[j].deltaWeight.resize(0);
-            }
-            else
-            {
-                m_neuralNetwork[i].tabNeurons[j].weight.resize(tabNbNeurons[i-1]);
-                m_neuralNetwork[i].tabNeurons[j].deltaWeight.resize(tabNbNeurons[i-1]);
-            }
+layer::layer(const layer &other)
+{
+    *this = other;
+}
+
+layer &layer::operator=(const layer &other)
+{
+    if (this == &other)
+        return *this;
+
+    tabNeurons = other.tabNeurons;
+    pruned = other.pruned;
+    sparseKernel = other.sparseKernel;
+    csr = other.csr;
+    weights = other.weights;
+
+    // same offsets in the copied arena
+    for (int j=0; j < tabNeurons.size(); j++)
+    {
+        if (other.tabNeurons[j].weight)
+        {
+            tabNeurons[j].weight = weights.data() + (other.tabNeurons[j].weight - other.weights.data());
+            tabNeurons[j].deltaWeight = weights.data() + (other.tabNeurons[j].deltaWeight - other.weights.data());
         }
     }
+    return *this;
 }
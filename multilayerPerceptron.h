@@ -29,52 +29,177 @@
 
 #include <vector>
 #include <iostream>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include "mlpArena.h"
+#include "mlpPipeline.h"
+#include "mlpMixedPrecision.h"
+#include "mlpAccumulation.h"
 using namespace std;
 
 struct traningSetMlp
 {
-    vector<double> tabExamples;
+    vector<double> tabExamples;                         // inputs (empty for a sparse example)
     vector<double> tabOutputTargets;
+    vector<int> tabNonZeroIndexes;                      // sparse example: indexes of the non-zero inputs
+    vector<double> tabNonZeroValues;                    // sparse example: values of the non-zero inputs
 };
 
 struct neuron
 {
     double output;
     double error;
-    vector<double> weight;
-    vector<double> deltaWeight;
+    double *weight;                                     // input weights, in the arena of the layer (NULL for the input layer)
+    double *deltaWeight;                                // last weight updates (momentum), in the arena of the layer
+};
+
+struct sparseLayer
+{
+    vector<int> rowStart;                               // index of the first non-zero weight of each neuron (nbNeurons + 1)
+    vector<int> column;                                 // input index of each non-zero weight
+    vector<double> value;                               // non-zero weights
+    vector<double> deltaValue;                          // last weight update of each non-zero weight (momentum)
 };
 
 struct layer
 {
 public:
+    layer() : pruned(false), sparseKernel(false) {}
+    layer(const layer &other);                          // the neurons of the copy point to its own arena
+    layer &operator=(const layer &other);
     vector<neuron> tabNeurons;
+    bool pruned;                                        // only the weights stored in csr are kept and trained
+    bool sparseKernel;                                  // compute the layer with csr (sparse enough to be faster)
+    sparseLayer csr;                                    // compressed sparse row copy of the weights (pruned layer)
+    mlpArena weights;                                   // weight and momentum matrices (nbNeurons x nbPrevious, contiguous)
 };
 
+struct learningStats
+{
+    long nbEpoch;                                       // epochs learned
+    long nbSample;                                      // samples learned
+    double learningError;                               // RMS error of the last epoch
+    double learningTime;                                // seconds spent in learning epochs
+    double forwardTime;                                 // per-phase seconds (setStats(true) only)
+    double outputErrorTime;
+    double backpropagationTime;
+    double updateTime;
+    double shuffleTime;
+    double ioTime;                                      // training set, state and computeFile I/O
+    double samplesPerSecond;
+    long peakRss;                                       // peak resident set size of the process (bytes)
+    long bytesAllocated;                                // bytes held by the network and the training set
+};
+
+class perfProfiler;
+
+// called at most maxReportRate times per second during learning (and once at the end)
+typedef void (*learningCallback)(const learningStats &stats, void *userData);
+
 class multilayerPerceptron
 {
 public:
     multilayerPerceptron(const vector<int> tabNbNeurons, const double eta = 0.5, const double alpha = 0.9);
     ~multilayerPerceptron();
-    bool loadTrainingSetFile(const string fileUrl);
+    bool loadTrainingSetFile(const string fileUrl, const bool cached = true);  // cached: through the process-wide cache (trainingSetCache.h)
     bool loadTrainingSet(const vector< vector<double> > &tabInputs, const vector< vector<double> > &tabOutputTargets, const bool verbose = false);
+    bool loadSparseTrainingSet(const vector< vector<int> > &tabIndexes, const vector< vector<double> > &tabValues, const vector< vector<double> > &tabOutputTargets);
+    bool saveTrainingSetFile(const string fileUrl);     // save the training set in binary file
+    shared_ptr< const vector<traningSetMlp> > getTrainingSet() const;  // read-only, can be shared with other networks
+    bool setTrainingSet(const shared_ptr< const vector<traningSetMlp> > &trainingSet);  // share a training set (copied before any change)
     void setEta(const double eta);
     void setAlpha(const double alpha);
     bool computeOutput(const vector<double> &tabInput, vector<double> &tabOutput);
-    bool computeFile(const string fileInUrl, string fileOutUrl = "");
+    bool computeOutput(const vector<int> &tabIndexes, const vector<double> &tabValues, vector<double> &tabOutput);
+    bool computeBatch(const vector< vector<double> > &tabInputs, vector< vector<double> > &tabOutputs, const int nbThreads = 1) const;  // nbThreads > 1: blocks run on threadPool
+    bool computeBatch(const double *tabInputs, double *tabOutputs, const int nbSample, const int nbThreads = 1) const;  // row-major, no allocation
+    double computeError();                              // average RMS error on the training set
+    bool computeFile(const string fileInUrl, string fileOutUrl = "");   // on all the threads of threadPool unless profiled
     bool learning(const int limit, const bool verbose = false, const bool randomShuffleTrainingSet = false);
+    // streaming: nbPass passes over the samples from the current weights and momentum, in the learning mode of learning()
+    // (pipeline, mixed precision, accumulation). All-zero weights are first randomized with rand(), which is not reseeded
+    bool partialFit(const vector< vector<double> > &tabInputs, const vector< vector<double> > &tabOutputTargets, const int nbPass = 1);
+    bool partialFit(const vector<traningSetMlp> &tabSamples, const int nbPass = 1);    // the training set is not used nor changed
+    void setReplay(const int replaySize, const double replayRatio = 1);     // partialFit: reservoir of past samples, replayed per new sample
+    int getReplaySize() const;
+    int getReplayCount() const;                         // samples in the reservoir
+    double getReplayRatio() const;
+    bool prune(const double sparsity, const int fineTuneEpochs = 0, const bool verbose = false);
+    bool distill(const multilayerPerceptron &teacher, const int limit, const int nbGenerated = 0, const bool verbose = false);  // learns the teacher outputs, the training set is kept
+    void cancelLearning();                              // stop learning at the end of the current epoch (from any thread)
+    void setSnapshotRate(const int nbEpoch);            // publish a copy of the weights now and every nbEpoch learning epochs (0: never)
+    shared_ptr<multilayerPerceptron> getSnapshot() const;   // last published copy (NULL before the first one), safe during learning
+
+    vector<int> getTopology() const;                    // number of neurons per layer
+    void setStats(const bool enable);                   // enable the per-phase timers
+    void resetStats();
+    const learningStats &getStats();
+    void setReportRate(const double maxReportRate);     // max verbose lines / callbacks per second (0: every epoch)
+    void setLearningCallback(learningCallback callback, void *userData = NULL);
+    void setProfiler(perfProfiler *profiler);           // hardware counters by phase and layer (NULL: disabled)
+    bool setPipeline(const int nbStages, const int microBatchSize = 16, const int nbMicroBatch = 8,
+                     const vector<int> &tabLayersPerStage = vector<int>());     // pipeline-parallel learning and computeBatch (nbStages < 2: off)
+    int getPipelineStages() const;                      // 1: no pipeline
+    pipelineStats getPipelineStats() const;
+    bool setPrecision(const mlpPrecision precision);    // storage of the weights, momentum and activations during learning
+    mlpPrecision getPrecision() const;
+    bool setAccumulation(const size_t memoryBudget, const int nbMicroBatch = 1);  // gradient accumulation in memoryBudget bytes (0: off)
+    bool getAccumulation(size_t &memoryBudget, int &microBatchSize, int &nbMicroBatch) const;    // false: off
+    long getStateSize() const;                          // size in bytes of the state written by saveState
 
     bool saveState(const string fileUrl);               // save neural network state (weights) in bin file
     bool loadState(const string fileUrl);               // load neural network state (weights) in bin file
     bool saveStateText(const string fileUrl);           // save neural network state (weights) in text file
     bool loadStateText(const string fileUrl);           // load neural network state (weights) in text file
+    bool exportCpp(const string fileUrl) const;         // generate a standalone c++ header computing the outputs
 
 private:
+    friend class mlpPipeline;
+    friend class mlpMixedPrecision;
+    friend class mlpAccumulation;
     double m_alpha;                                     // momentum factor [0,1]
     double m_eta;                                       // learning rate factor [0,1]
     vector<layer> m_neuralNetwork;                      // neural network
-    vector<traningSetMlp> m_trainingSet;                // training set inputs and outputs
+    shared_ptr< vector<traningSetMlp> > m_trainingSet;  // training set inputs and outputs, may be shared (copy on write)
+    vector<int> m_tabOrder;                             // learning order of the training set examples
+    vector<int> m_tabPreviousIndexes;                   // inputs of the last sparse example (non-zero first layer momentum)
+    bool m_statsEnabled;                                // per-phase timers
+    learningStats m_stats;                              // accumulated since the last resetStats
+    double m_maxReportRate;                             // max reports per second
+    learningCallback m_learningCallback;
+    void *m_learningCallbackData;
+    perfProfiler *m_profiler;
+    atomic<bool> m_cancelLearning;
+    int m_snapshotRate;                                 // epochs between two snapshots
+    shared_ptr<multilayerPerceptron> m_snapshot;        // published copy, read with atomic_load
+    shared_ptr<multilayerPerceptron> m_spareSnapshot;   // previous copy, rewritten when no reader holds it
+    unique_ptr<mlpPipeline> m_pipeline;                 // NULL: layers computed by the calling thread
+    unique_ptr<mlpMixedPrecision> m_mixedPrecision;     // NULL: learning in double
+    unique_ptr<mlpAccumulation> m_accumulation;         // NULL: learning sample by sample
+    vector<traningSetMlp> m_tabReplay;                  // partialFit: uniform sample of the streamed samples (reservoir)
+    int m_replaySize;                                   // capacity of the reservoir (0: no replay)
+    double m_replayRatio;                               // samples of the reservoir learned per new sample
+    long m_nbStreamed;                                  // samples given to partialFit since the reservoir was emptied
     void initLayers(const vector<int> &tabNbNeurons);
+    void randomizeWeights();                            // random weights, no momentum, layers no longer pruned
+    bool checkTrainingSet();
+    vector<traningSetMlp> &editTrainingSet(const bool keepSamples);  // own the training set before modifying it
+    bool parseTrainingSetFile(const string fileUrl, bool &binary);  // text or binary training set, without the cache
+    bool saveTrainingSetFile(const string fileUrl, const string &header);  // header: sidecar stamp
+    bool loadTrainingSetBinary(istream &file, const string fileUrl);
+    void computeLayers(const int firstLayer = 1);       // forward pass from the outputs of layer firstLayer-1
+    void computeSparseInput(const vector<int> &tabIndexes, const vector<double> &tabValues);
+    template <class inputRows, class outputRows>
+    void computeBlock(const inputRows &tabInputs, outputRows &tabOutputs, const int first, const int last, const bool profile) const;
+    double learnSample(const traningSetMlp &sample);    // one backpropagation step, returns the RMS error
+    double learnTrainingSet(const bool randomShuffleTrainingSet);
+    double learnEpoch();                                // m_trainingSet in m_tabOrder, through the learning mode, returns the RMS error
+    void buildSparseLayer(const int i);                 // build csr from the dense weights of a pruned layer
+    void publishSnapshot();
+    void addPhaseTime(double &phaseTime, chrono::steady_clock::time_point &start);
+    void addIoTime(const chrono::steady_clock::time_point start);
+    void report(const bool verbose, const string &line, chrono::steady_clock::time_point &lastReport, const bool last);
 };
 
 #endif // MULTILAYERPERCEPTRON_H
@@ -25,18 +25,99 @@
 */
 
 #include "perceptron.h"
+#include "threadPool.h"
 #include <fstream>
 #include <string>
+#include <math.h>
+#include <bitset>
+#include <algorithm>
+#include <chrono>
+
+static const int MIN_EXAMPLES_PER_THREAD = 1024;    // countErrors: examples per task (a single task runs on the calling thread)
+
+static inline int popcount(const uint64_t bits)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(bits);
+#else
+    return bitset<64>(bits).count();
+#endif
+}
+
+static inline int firstBit(const uint64_t bits)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    int k = 0;
+    while (!((bits >> k) & 1))
+        k++;
+    return k;
+#endif
+}
+
+// popcnt instruction when the processor has it (the default build targets any x86-64)
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define POPCOUNT_CLONES __attribute__((target_clones("popcnt", "default")))
+#else
+#define POPCOUNT_CLONES
+#endif
+
+// weight = -2^(nbPlane-1) * plane[nbPlane-1] + sum of 2^b * plane[b]: one AND and one popcount per plane and word
+POPCOUNT_CLONES
+static void computePlanes(const uint64_t *tabBits, const uint64_t *tabPlanes, const int nbPlane, const int nbWord, int *tabOutputs, const int nbSample)
+{
+    for (int s=0; s < nbSample; s++)
+    {
+        const uint64_t *bits = &tabBits[(size_t) s * nbWord];
+        long long sum = 0;
+        for (int b=0; b < nbPlane; b++)
+        {
+            const uint64_t *plane = &tabPlanes[b * nbWord];
+            long long count = 0;
+            for (int w=0; w < nbWord; w++)
+                count += popcount(bits[w] & plane[w]);
+            sum += (b == nbPlane - 1) ? -(count << b) : (count << b);
+        }
+        tabOutputs[s] = (sum > 0) ? 1 : 0;
+    }
+}
+
+// four independent sums: consecutive products are added in parallel (and by SIMD units when available)
+static double dot(const double *tabA, const double *tabB, const int n)
+{
+    double sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        sum0 += tabA[i] * tabB[i];
+        sum1 += tabA[i+1] * tabB[i+1];
+        sum2 += tabA[i+2] * tabB[i+2];
+        sum3 += tabA[i+3] * tabB[i+3];
+    }
+    for (; i < n; i++)
+        sum0 += tabA[i] * tabB[i];
+    return (sum0 + sum1) + (sum2 + sum3);
+}
 
 perceptron::perceptron(const int nbEntry)
 {
+    m_nbInput = nbEntry;
     m_tabWeights.resize(nbEntry);
+    m_bitPacked = false;
+    m_nbWord = (nbEntry + 63) / 64;
+    m_nbPlane = 0;
 }
 
 perceptron::~perceptron()
 {
 }
 
+int perceptron::nbExample() const
+{
+    return m_tabOutputTargets.size();
+}
+
 bool perceptron::loadTrainingSetFile(const string fileUrl)
 {
     ifstream file;
@@ -61,6 +142,13 @@ bool perceptron::loadTrainingSetFile(const string fileUrl)
     }
 
     file >> nbInput >> nbExample;
+    if (nbInput != m_nbInput)
+    {
+        cout <<  "Error: the number of inputs data does not match the number defined in file " << fileUrl << endl;
+        file.close();
+        return false;
+    }
+
     file >> word;
     if (word !=  "[inputs]")
     {
@@ -69,16 +157,9 @@ bool perceptron::loadTrainingSetFile(const string fileUrl)
         return false;
     }
 
-    m_trainingSet.resize(nbExample);
-    for (int i=0; i < m_trainingSet.size(); i++)
-    {
-        m_trainingSet[i].tabExamples.resize(nbInput);
-
-        for (int j=0; j < m_trainingSet[i].tabExamples.size(); j++)
-        {
-            file >> m_trainingSet[i].tabExamples[j];
-        }
-    }
+    m_tabExamples.resize((size_t) nbExample * nbInput);
+    for (int i=0; i < m_tabExamples.size(); i++)
+        file >> m_tabExamples[i];
 
     file >> word;
     if (word !=  "[outputs]")
@@ -88,12 +169,13 @@ bool perceptron::loadTrainingSetFile(const string fileUrl)
         return false;
     }
 
-    for (int i=0; i < m_trainingSet.size(); i++)
-    {
-        file >> m_trainingSet[i].outputTarget;
-    }
+    m_tabOutputTargets.resize(nbExample);
+    for (int i=0; i < m_tabOutputTargets.size(); i++)
+        file >> m_tabOutputTargets[i];
 
     file.close();
+    if (m_bitPacked)
+        return setBitPacked(true);              // pack the new training set
     return true;
 }
 
@@ -105,42 +187,48 @@ bool perceptron::loadTrainingSet(const vector< vector<double> > &tabInputs, vect
         return false;
     }
 
-    m_trainingSet.resize(tabInputs.size());
-    for (int i=0; i < m_trainingSet.size(); i++)
+    for (int i=0; i < tabInputs.size(); i++)
     {
-        m_trainingSet[i].tabExamples = tabInputs[i];
-        m_trainingSet[i].outputTarget = tabOutputTargets[i];
+        if (tabInputs[i].size() != m_nbInput)
+        {
+            cout <<  "Error: the number of inputs data does not match" << endl;
+            return false;
+        }
     }
 
+    m_tabExamples.resize(tabInputs.size() * m_nbInput);
+    for (int i=0; i < tabInputs.size(); i++)
+        copy(tabInputs[i].begin(), tabInputs[i].end(), m_tabExamples.begin() + i * m_nbInput);
+    m_tabOutputTargets = tabOutputTargets;
+
     if(verbose)
     {
         cout << "Examples :" << endl << endl;
-        for (int i=0; i < m_trainingSet.size(); i++)
+        for (int i=0; i < nbExample(); i++)
         {
-            for (int j=0; j < m_trainingSet[i].tabExamples.size(); j++)
+            for (int j=0; j < m_nbInput; j++)
             {
-                cout << m_trainingSet[i].tabExamples[j];
+                cout << m_tabExamples[i * m_nbInput + j];
             }
             cout << endl;
         }
 
         cout << endl << "Outputs :" <<endl << endl;
-        for (int i=0; i < m_trainingSet.size(); i++)
+        for (int i=0; i < nbExample(); i++)
         {
-            cout << m_trainingSet[i].outputTarget;
+            cout << m_tabOutputTargets[i];
             cout << endl;
         }
     }
+
+    if (m_bitPacked)
+        return setBitPacked(true);
     return true;
 }
 
 void perceptron::computeOutput(const vector<double> &tabInput, int &output)
 {
-    int sum = 0;
-    for (int i=0; i < m_tabWeights.size(); i++)
-    {
-        sum += tabInput[i] * m_tabWeights[i];
-    }
+    double sum = dot(tabInput.data(), m_tabWeights.data(), m_nbInput);
 
     if (sum > 0)
         output = 1;
@@ -148,26 +236,49 @@ void perceptron::computeOutput(const vector<double> &tabInput, int &output)
         output = 0;
 }
 
+bool perceptron::computeBatch(const double *tabInputs, int *tabOutputs, const int nbSample) const
+{
+    if (nbSample < 0)
+        return false;
+
+    for (int s=0; s < nbSample; s++)
+        tabOutputs[s] = (dot(&tabInputs[(size_t) s * m_nbInput], m_tabWeights.data(), m_nbInput) > 0) ? 1 : 0;
+    return true;
+}
+
 void perceptron::learning(const int limit, const bool verbose)
 {
-    int nbLearning = 1;
-    bool continueLearning = true;
-    double *saveTabWeights = new double[m_tabWeights.size()];
-    for (int i=0; i < m_tabWeights.size(); i++)
+    if (m_bitPacked)
     {
-        saveTabWeights[i] = m_tabWeights[i];    // =0
+        learningBits(limit, verbose);
+        return;
     }
 
+    int nbLearning = 1;
+    bool continueLearning = true;
+    vector<double> saveTabWeights;
+
     while (continueLearning)
     {
-        for (int i=0; i < m_trainingSet.size(); i++)
+        if (verbose)
+            saveTabWeights = m_tabWeights;
+
+        // weights change only on a misclassified example with non-zero inputs
+        bool difference = false;
+        for (int i=0; i < nbExample(); i++)
         {
-            int output = 0;
-            computeOutput(m_trainingSet[i].tabExamples, output);
+            const double *example = &m_tabExamples[(size_t) i * m_nbInput];
+            int output = (dot(example, m_tabWeights.data(), m_nbInput) > 0) ? 1 : 0;
+            int error = m_tabOutputTargets[i] - output;
+            if (error == 0)
+                continue;
 
-            for (int j=0; j < m_tabWeights.size(); j++)
+            for (int j=0; j < m_nbInput; j++)
             {
-                m_tabWeights[j] = m_tabWeights[j] + ( ((m_trainingSet[i].outputTarget - output) * m_trainingSet[i].tabExamples[j]) );
+                double weight = m_tabWeights[j] + error * example[j];
+                if (weight != m_tabWeights[j])
+                    difference = true;
+                m_tabWeights[j] = weight;
             }
         }
 
@@ -181,13 +292,6 @@ void perceptron::learning(const int limit, const bool verbose)
             }
         }
 
-        bool difference = false;
-        for (int i=0; i < m_tabWeights.size(); i++)
-        {
-            if (m_tabWeights[i] != saveTabWeights[i])
-                difference = true;
-        }
-
         if (!difference)
             continueLearning = false;
 
@@ -196,25 +300,173 @@ void perceptron::learning(const int limit, const bool verbose)
             if(nbLearning >= limit)
                 continueLearning = false;
         }
+        nbLearning++;
+    }
+
+    if (verbose)
+    {
+        cout << endl << "Outputs :" << endl << endl;
+        for (int i=0; i < nbExample(); i++)
+        {
+            int output = (dot(&m_tabExamples[(size_t) i * m_nbInput], m_tabWeights.data(), m_nbInput) > 0) ? 1 : 0;
+            cout << output << endl;
+        }
+    }
+}
+
+void perceptron::learningBits(const int limit, const bool verbose)
+{
+    int nbLearning = 1;
+    bool continueLearning = true;
+    vector<int> saveTabWeights;
+
+    while (continueLearning)
+    {
+        if (verbose)
+            saveTabWeights = m_tabIntWeights;
+
+        // sums and updates only visit the inputs set to 1
+        bool difference = false;
+        for (int i=0; i < nbExample(); i++)
+        {
+            const uint64_t *bits = &m_tabBits[(size_t) i * m_nbWord];
+            long long sum = 0;
+            for (int w=0; w < m_nbWord; w++)
+                for (uint64_t word = bits[w]; word; word &= word - 1)
+                    sum += m_tabIntWeights[w * 64 + firstBit(word)];
+
+            int error = m_tabOutputTargets[i] - ((sum > 0) ? 1 : 0);
+            if (error == 0)
+                continue;
+
+            for (int w=0; w < m_nbWord; w++)
+            {
+                for (uint64_t word = bits[w]; word; word &= word - 1)
+                {
+                    m_tabIntWeights[w * 64 + firstBit(word)] += error;
+                    difference = true;
+                }
+            }
+        }
 
-        for (int i=0; i < m_tabWeights.size(); i++)
+        if (verbose)
         {
-            saveTabWeights[i] = m_tabWeights[i];
+            cout << endl << "Saved Weights / Weights :" <<endl << endl;
+            for (int aff=0; aff < m_tabIntWeights.size(); aff++)
+            {
+                cout << saveTabWeights[aff] << "\t" << m_tabIntWeights[aff];
+                cout << endl;
+            }
         }
+
+        if (!difference || (limit > 0 && nbLearning >= limit))
+            continueLearning = false;
         nbLearning++;
     }
 
+    for (int i=0; i < m_nbInput; i++)
+        m_tabWeights[i] = m_tabIntWeights[i];
+    buildPlanes();
+
     if (verbose)
     {
+        vector<int> tabOutputs(nbExample());
+        computeBits(m_tabBits.data(), tabOutputs.data(), nbExample());
         cout << endl << "Outputs :" << endl << endl;
-        for (int i=0; i < m_trainingSet.size(); i++)
+        for (int i=0; i < nbExample(); i++)
+            cout << tabOutputs[i] << endl;
+    }
+}
+
+bool perceptron::setBitPacked(const bool enable)
+{
+    m_bitPacked = false;
+    m_tabBits.clear();
+    m_tabPlanes.clear();
+    if (!enable)
+        return true;
+
+    for (int i=0; i < m_tabExamples.size(); i++)
+    {
+        if (m_tabExamples[i] != 0 && m_tabExamples[i] != 1)
+        {
+            cout <<  "Error: bit-packed mode needs binary inputs (0 or 1)" << endl;
+            return false;
+        }
+    }
+    for (int i=0; i < m_nbInput; i++)
+    {
+        if (m_tabWeights[i] != floor(m_tabWeights[i]) || fabs(m_tabWeights[i]) > 1e9)
         {
-            int Output = 0;
-            computeOutput(m_trainingSet[i].tabExamples, Output);
-            cout << Output << endl;
+            cout <<  "Error: bit-packed mode needs integer weights" << endl;
+            return false;
         }
     }
-    delete saveTabWeights;
+
+    m_tabIntWeights.resize(m_nbInput);
+    for (int i=0; i < m_nbInput; i++)
+        m_tabIntWeights[i] = (int) m_tabWeights[i];
+    m_tabBits.resize((size_t) nbExample() * m_nbWord);
+    packInputs(m_tabExamples.data(), nbExample(), m_tabBits.data());
+    buildPlanes();
+    m_bitPacked = true;
+    return true;
+}
+
+bool perceptron::isBitPacked() const
+{
+    return m_bitPacked;
+}
+
+int perceptron::getNbWord() const
+{
+    return m_nbWord;
+}
+
+void perceptron::packInputs(const double *tabInputs, const int nbSample, uint64_t *tabBits) const
+{
+    fill_n(tabBits, (size_t) nbSample * m_nbWord, 0);
+    for (int s=0; s < nbSample; s++)
+    {
+        const double *inputs = &tabInputs[(size_t) s * m_nbInput];
+        uint64_t *bits = &tabBits[(size_t) s * m_nbWord];
+        for (int k=0; k < m_nbInput; k++)
+            if (inputs[k] != 0)
+                bits[k / 64] |= (uint64_t) 1 << (k % 64);
+    }
+}
+
+bool perceptron::computeBits(const uint64_t *tabBits, int *tabOutputs, const int nbSample) const
+{
+    if (!m_bitPacked)
+    {
+        cout <<  "Error: the perceptron is not in bit-packed mode" << endl;
+        return false;
+    }
+
+    computePlanes(tabBits, m_tabPlanes.data(), m_nbPlane, m_nbWord, tabOutputs, nbSample);
+    return true;
+}
+
+void perceptron::buildPlanes()
+{
+    // smallest nbPlane such that every weight is a nbPlane-bit two's complement integer
+    int minWeight = 0;
+    int maxWeight = 0;
+    for (int i=0; i < m_nbInput; i++)
+    {
+        minWeight = min(minWeight, m_tabIntWeights[i]);
+        maxWeight = max(maxWeight, m_tabIntWeights[i]);
+    }
+    m_nbPlane = 1;
+    while (minWeight < -(1LL << (m_nbPlane - 1)) || maxWeight > (1LL << (m_nbPlane - 1)) - 1)
+        m_nbPlane++;
+
+    m_tabPlanes.assign((size_t) m_nbPlane * m_nbWord, 0);
+    for (int b=0; b < m_nbPlane; b++)
+        for (int k=0; k < m_nbInput; k++)
+            if (((unsigned int) m_tabIntWeights[k] >> b) & 1)
+                m_tabPlanes[b * m_nbWord + k / 64] |= (uint64_t) 1 << (k % 64);
 }
 
 bool perceptron::saveStateText(const string fileUrl)
@@ -254,6 +506,453 @@ bool perceptron::loadStateText(const string fileUrl)
     }
 
     file.close();
+    if (m_bitPacked)
+        return setBitPacked(true);              // integer weights only
     return true;
 }
 
+multiClassPerceptron::multiClassPerceptron(const int nbInput, const int nbOutput, const perceptronMode mode)
+{
+    m_nbInput = nbInput;
+    m_nbOutput = nbOutput;
+    m_mode = mode;
+    m_tabWeights.assign((size_t) nbOutput * nbInput, 0);
+    m_pocket = false;
+    m_nbThreads = threadPool::instance().size();
+    m_stats = {0, 0, 0, 0};
+}
+
+int multiClassPerceptron::nbExample() const
+{
+    return m_tabExamples.size() / max(1, m_nbInput);
+}
+
+bool multiClassPerceptron::loadTrainingSetFile(const string fileUrl)
+{
+    ifstream file;
+    file.open(fileUrl);
+
+    if (!file.is_open())
+    {
+        cout <<  "Error: can't open file " << fileUrl << endl;
+        return false;
+    }
+
+    string word;
+    int nbInput = 0;
+    int nbExample = 0;
+
+    file >> word;
+    if (word !=  "[perceptron]")
+    {
+        cout <<  "Error: can't find [perceptron] tag in file " << fileUrl << endl;
+        return false;
+    }
+
+    file >> nbInput >> nbExample;
+    if (nbInput != m_nbInput || nbExample < 0)
+    {
+        cout <<  "Error: the number of inputs data does not match the number defined in file " << fileUrl << endl;
+        return false;
+    }
+
+    file >> word;
+    if (word !=  "[inputs]")
+    {
+        cout <<  "Error: can't find [inputs] tag in file " << fileUrl << endl;
+        return false;
+    }
+
+    vector<double> tabExamples((size_t) nbExample * nbInput);
+    for (size_t i=0; i < tabExamples.size(); i++)
+        file >> tabExamples[i];
+
+    file >> word;
+    if (word !=  "[outputs]")
+    {
+        cout <<  "Error: can't find [outputs] tag in file " << fileUrl << endl;
+        return false;
+    }
+
+    vector<int> tabOutputTargets((size_t) nbExample * m_nbOutput);
+    for (size_t i=0; i < tabOutputTargets.size(); i++)
+        file >> tabOutputTargets[i];
+    if (file.fail())
+    {
+        cout <<  "Error: the number of outputs data does not match (" << m_nbOutput << " per example) in file " << fileUrl << endl;
+        return false;
+    }
+
+    if (!setTargets(tabOutputTargets))
+        return false;
+    m_tabExamples.swap(tabExamples);
+    return true;
+}
+
+bool multiClassPerceptron::loadTrainingSet(const vector< vector<double> > &tabInputs, const vector< vector<int> > &tabOutputTargets)
+{
+    if (tabInputs.size() != tabOutputTargets.size())
+    {
+        cout <<  "Error: the number of inputs data does not match with the number of outputs data" << endl;
+        return false;
+    }
+
+    vector<double> tabExamples(tabInputs.size() * m_nbInput);
+    vector<int> tabTargets(tabInputs.size() * m_nbOutput);
+    for (size_t i=0; i < tabInputs.size(); i++)
+    {
+        if (tabInputs[i].size() != m_nbInput || tabOutputTargets[i].size() != m_nbOutput)
+        {
+            cout <<  "Error: the number of inputs or outputs data does not match" << endl;
+            return false;
+        }
+        copy(tabInputs[i].begin(), tabInputs[i].end(), tabExamples.begin() + i * m_nbInput);
+        copy(tabOutputTargets[i].begin(), tabOutputTargets[i].end(), tabTargets.begin() + i * m_nbOutput);
+    }
+
+    if (!setTargets(tabTargets))
+        return false;
+    m_tabExamples.swap(tabExamples);
+    return true;
+}
+
+bool multiClassPerceptron::setTargets(const vector<int> &tabOutputTargets)
+{
+    int nbExample = tabOutputTargets.size() / max(1, m_nbOutput);
+    vector<int> tabClasses;
+    if (m_mode == PERCEPTRON_MULTI_CLASS)
+    {
+        tabClasses.resize(nbExample);
+        for (int i=0; i < nbExample; i++)
+        {
+            const int *targets = &tabOutputTargets[(size_t) i * m_nbOutput];
+            if (count(targets, targets + m_nbOutput, 1) != 1 || count(targets, targets + m_nbOutput, 0) != m_nbOutput - 1)
+            {
+                cout <<  "Error: example " << i << " must have one output set to 1 and the others to 0 (multi-class)" << endl;
+                return false;
+            }
+            tabClasses[i] = find(targets, targets + m_nbOutput, 1) - targets;
+        }
+    }
+
+    m_tabOutputTargets = tabOutputTargets;
+    m_tabClasses.swap(tabClasses);
+    return true;
+}
+
+void multiClassPerceptron::setPocket(const bool enable)
+{
+    m_pocket = enable;
+}
+
+void multiClassPerceptron::setNbThreads(const int nbThreads)
+{
+    m_nbThreads = max(1, nbThreads);
+}
+
+void multiClassPerceptron::learning(const int limit, const bool verbose)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    m_stats = {0, 0, 0, 0};
+    vector<double> tabSums(m_nbOutput);
+
+    // pocket: the weights with the fewest misclassified examples seen at the end of an epoch, replaced only by strictly better ones
+    vector<double> tabPocket;
+    if (m_pocket)
+    {
+        tabPocket = m_tabWeights;
+        m_stats.nbError = countErrors(tabPocket.data());
+    }
+
+    bool continueLearning = nbExample() > 0 && (!m_pocket || m_stats.nbError > 0);
+    while (continueLearning)
+    {
+        // an epoch without update means that every example is classified correctly
+        long nbUpdate = 0;
+        for (int i=0; i < nbExample(); i++)
+        {
+            const double *example = &m_tabExamples[(size_t) i * m_nbInput];
+            for (int o=0; o < m_nbOutput; o++)
+                tabSums[o] = dot(example, &m_tabWeights[(size_t) o * m_nbInput], m_nbInput);
+
+            if (m_mode == PERCEPTRON_MULTI_CLASS)
+            {
+                int predicted = max_element(tabSums.begin(), tabSums.end()) - tabSums.begin();
+                int target = m_tabClasses[i];
+                if (predicted == target)
+                    continue;
+
+                double *weightsTarget = &m_tabWeights[(size_t) target * m_nbInput];
+                double *weightsPredicted = &m_tabWeights[(size_t) predicted * m_nbInput];
+                for (int j=0; j < m_nbInput; j++)
+                {
+                    weightsTarget[j] += example[j];
+                    weightsPredicted[j] -= example[j];
+                }
+                nbUpdate++;
+            }
+            else
+            {
+                for (int o=0; o < m_nbOutput; o++)
+                {
+                    int error = m_tabOutputTargets[(size_t) i * m_nbOutput + o] - ((tabSums[o] > 0) ? 1 : 0);
+                    if (error == 0)
+                        continue;
+
+                    double *weights = &m_tabWeights[(size_t) o * m_nbInput];
+                    for (int j=0; j < m_nbInput; j++)
+                        weights[j] += error * example[j];
+                    nbUpdate++;
+                }
+            }
+        }
+        m_stats.nbEpoch++;
+
+        int nbError = -1;
+        if (m_pocket)
+        {
+            nbError = (nbUpdate == 0) ? 0 : countErrors(m_tabWeights.data());
+            if (nbError < m_stats.nbError)
+            {
+                tabPocket = m_tabWeights;
+                m_stats.nbError = nbError;
+                m_stats.bestEpoch = m_stats.nbEpoch;
+            }
+        }
+
+        if (verbose)
+        {
+            cout << "epoch " << m_stats.nbEpoch << ": " << nbUpdate << " updates";
+            if (m_pocket)
+                cout << ", " << nbError << " errors, pocket " << m_stats.nbError << " errors (epoch " << m_stats.bestEpoch << ")";
+            cout << endl;
+        }
+
+        if (nbUpdate == 0 || (m_pocket && m_stats.nbError == 0))
+            continueLearning = false;
+        if (limit > 0 && m_stats.nbEpoch >= limit)
+            continueLearning = false;
+    }
+
+    if (m_pocket)
+        m_tabWeights.swap(tabPocket);
+    else
+    {
+        m_stats.nbError = countErrors(m_tabWeights.data());
+        m_stats.bestEpoch = m_stats.nbEpoch;
+    }
+    m_stats.learningTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void multiClassPerceptron::computeRow(const double *inputs, const double *tabWeights, int *outputs) const
+{
+    if (m_mode == PERCEPTRON_MULTI_CLASS)
+    {
+        int best = 0;
+        double bestSum = 0;
+        for (int o=0; o < m_nbOutput; o++)
+        {
+            double sum = dot(inputs, &tabWeights[(size_t) o * m_nbInput], m_nbInput);
+            if (o == 0 || sum > bestSum)
+            {
+                best = o;
+                bestSum = sum;
+            }
+        }
+        for (int o=0; o < m_nbOutput; o++)
+            outputs[o] = (o == best) ? 1 : 0;
+    }
+    else
+    {
+        for (int o=0; o < m_nbOutput; o++)
+            outputs[o] = (dot(inputs, &tabWeights[(size_t) o * m_nbInput], m_nbInput) > 0) ? 1 : 0;
+    }
+}
+
+void multiClassPerceptron::computeOutput(const vector<double> &tabInput, vector<int> &tabOutputs) const
+{
+    tabOutputs.resize(m_nbOutput);
+    computeRow(tabInput.data(), m_tabWeights.data(), tabOutputs.data());
+}
+
+int multiClassPerceptron::computeClass(const vector<double> &tabInput) const
+{
+    vector<int> tabOutputs(m_nbOutput);
+    computeRow(tabInput.data(), m_tabWeights.data(), tabOutputs.data());
+    return max_element(tabOutputs.begin(), tabOutputs.end()) - tabOutputs.begin();
+}
+
+bool multiClassPerceptron::computeBatch(const double *tabInputs, int *tabOutputs, const int nbSample) const
+{
+    if (nbSample < 0)
+        return false;
+
+    for (int s=0; s < nbSample; s++)
+        computeRow(&tabInputs[(size_t) s * m_nbInput], m_tabWeights.data(), &tabOutputs[(size_t) s * m_nbOutput]);
+    return true;
+}
+
+void multiClassPerceptron::computeScores(const double *tabInputs, double *tabScores, const int nbSample) const
+{
+    for (int s=0; s < nbSample; s++)
+        for (int o=0; o < m_nbOutput; o++)
+            tabScores[(size_t) s * m_nbOutput + o] = dot(&tabInputs[(size_t) s * m_nbInput], &m_tabWeights[(size_t) o * m_nbInput], m_nbInput);
+}
+
+bool multiClassPerceptron::computeFile(const string fileInUrl, string fileOutUrl) const
+{
+    if (fileOutUrl == "")
+        fileOutUrl = fileInUrl + "_out.txt";
+
+    ifstream fileIn;
+    fileIn.open(fileInUrl);
+
+    if (!fileIn.is_open())
+    {
+        cout <<  "Error: can't open file " << fileInUrl << endl;
+        return false;
+    }
+
+    string word;
+    int nbInput = 0;
+    int nbSample = 0;
+
+    fileIn >> word;
+    if (word !=  "[perceptron]")
+    {
+        cout <<  "Error: can't find [perceptron] tag in file " << fileInUrl << endl;
+        return false;
+    }
+
+    fileIn >> nbInput >> nbSample;
+    if (nbInput != m_nbInput)
+    {
+        cout <<  "Error: the number of inputs data does not match the number defined in file " << fileInUrl << endl;
+        return false;
+    }
+
+    fileIn >> word;
+    if (word !=  "[inputs]")
+    {
+        cout <<  "Error: can't find [inputs] tag in file " << fileInUrl << endl;
+        return false;
+    }
+
+    // one contiguous matrix for all the samples, one for all the results
+    vector<double> tabSample((size_t) max(0, nbSample) * nbInput);
+    for (size_t i=0; i < tabSample.size(); i++)
+        fileIn >> tabSample[i];
+
+    ofstream fileOut(fileOutUrl, ios::out | ios::trunc);
+    if (!fileOut.is_open())
+    {
+        cout <<  "Error: can't open file " << fileOutUrl << endl;
+        return false;
+    }
+
+    vector<int> tabResult((size_t) max(0, nbSample) * m_nbOutput);
+    computeBatch(tabSample.data(), tabResult.data(), max(0, nbSample));
+
+    fileOut << "[perceptron_result]" << endl;
+    for (int i=0; i < nbSample; i++)
+    {
+        fileOut << "Input: ";
+        for (int j=0; j < nbInput; j++)
+            fileOut << tabSample[(size_t) i * nbInput + j] << " ";
+
+        fileOut << endl << "Output: ";
+        for (int k=0; k < m_nbOutput; k++)
+            fileOut << tabResult[(size_t) i * m_nbOutput + k] << " ";
+
+        fileOut << endl << endl;
+    }
+
+    fileOut.close();
+    return true;
+}
+
+int multiClassPerceptron::countErrors() const
+{
+    return countErrors(m_tabWeights.data());
+}
+
+int multiClassPerceptron::countErrors(const double *tabWeights) const
+{
+    // ranges of examples counted on the thread pool: the weights are only read
+    long grain = max((long) MIN_EXAMPLES_PER_THREAD, (long) (nbExample() + m_nbThreads - 1) / m_nbThreads);
+    return threadPool::instance().parallelReduce(0, nbExample(), grain, 0,
+        [this, tabWeights](long first, long last) { return countRange(tabWeights, first, last); },
+        [](int a, int b) { return a + b; });
+}
+
+int multiClassPerceptron::countRange(const double *tabWeights, const int first, const int last) const
+{
+    vector<int> tabOutputs(m_nbOutput);
+    int nbError = 0;
+    for (int i=first; i < last; i++)
+    {
+        computeRow(&m_tabExamples[(size_t) i * m_nbInput], tabWeights, tabOutputs.data());
+        if (!equal(tabOutputs.begin(), tabOutputs.end(), m_tabOutputTargets.begin() + (size_t) i * m_nbOutput))
+            nbError++;
+    }
+    return nbError;
+}
+
+const perceptronStats &multiClassPerceptron::getStats() const
+{
+    return m_stats;
+}
+
+int multiClassPerceptron::getNbInput() const
+{
+    return m_nbInput;
+}
+
+int multiClassPerceptron::getNbOutput() const
+{
+    return m_nbOutput;
+}
+
+perceptronMode multiClassPerceptron::getMode() const
+{
+    return m_mode;
+}
+
+bool multiClassPerceptron::saveStateText(const string fileUrl)
+{
+    ofstream file(fileUrl, ios::out | ios::trunc);
+
+    if (!file.is_open())
+        return false;
+
+    // one weight per line, output after output: a single output file is also a perceptron state
+    file << "[weights]" << endl;
+    for (size_t i=0; i < m_tabWeights.size(); i++)
+        file << m_tabWeights[i] << endl;
+
+    file.close();
+    return true;
+}
+
+bool multiClassPerceptron::loadStateText(const string fileUrl)
+{
+    ifstream file;
+    file.open(fileUrl);
+
+    if (!file.is_open())
+        return false;
+
+    string word;
+    file >> word;
+    if (word !=  "[weights]")
+        return false;
+
+    vector<double> tabWeights(m_tabWeights.size());
+    for (size_t i=0; i < tabWeights.size(); i++)
+        file >> tabWeights[i];
+    if (file.fail())
+        return false;
+
+    m_tabWeights.swap(tabWeights);
+    return true;
+}
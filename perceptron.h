@@ -29,14 +29,9 @@
 
 #include <vector>
 #include <iostream>
+#include <stdint.h>
 using namespace std;
 
-struct traningSetP
-{
-    vector<double> tabExamples;
-    int outputTarget;
-};
-
 class perceptron
 {
 public:
@@ -45,14 +40,88 @@ public:
     bool loadTrainingSetFile(const string fileUrl);
     bool loadTrainingSet(const vector< vector<double> > &tabInputs, vector<int> &tabOutputTargets, const bool verbose = false);
     void computeOutput(const vector<double> &tabInput, int &output);
+    bool computeBatch(const double *tabInputs, int *tabOutputs, const int nbSample) const;     // row-major inputs, one output per sample
     void learning(const int limit = -1, const bool verbose = false);
 
+    // bit-packed mode: binary inputs (0/1) stored as bits, integer weights, popcount kernels
+    bool setBitPacked(const bool enable);       // false if the training set or the weights are not binary / integer
+    bool isBitPacked() const;
+    int getNbWord() const;                      // 64-bit words per packed sample
+    void packInputs(const double *tabInputs, const int nbSample, uint64_t *tabBits) const;     // nbSample x getNbWord() words
+    bool computeBits(const uint64_t *tabBits, int *tabOutputs, const int nbSample) const;      // bit-packed mode only
+
     bool saveStateText(const string fileUrl);   // save neural network state (weights) in text file
     bool loadStateText(const string fileUrl);   // load neural network state (weights) in text file
 
 private:
+    int m_nbInput;
     vector<double> m_tabWeights;                // weights
-    vector<traningSetP> m_trainingSet;          // training set inputs and outputs
+    vector<double> m_tabExamples;               // training set inputs: nbExample x nbInput, contiguous
+    vector<int> m_tabOutputTargets;             // training set outputs
+    bool m_bitPacked;
+    int m_nbWord;
+    vector<uint64_t> m_tabBits;                 // bit-packed training set inputs: nbExample x nbWord
+    vector<int> m_tabIntWeights;                // bit-packed mode weights
+    vector<uint64_t> m_tabPlanes;               // two's complement bit planes of the integer weights: nbPlane x nbWord
+    int m_nbPlane;
+    int nbExample() const;
+    void learningBits(const int limit, const bool verbose);
+    void buildPlanes();                         // after a change of the integer weights
+};
+
+enum perceptronMode
+{
+    PERCEPTRON_MULTI_OUTPUT,                    // independent binary outputs: one row of the weight matrix per output
+    PERCEPTRON_MULTI_CLASS                      // one class per example (one-hot outputs): the row with the highest sum wins
+};
+
+struct perceptronStats
+{
+    long nbEpoch;                               // epochs learned
+    int nbError;                                // misclassified examples of the weights kept
+    long bestEpoch;                             // pocket: epoch of the weights kept (0: initial weights)
+    double learningTime;                        // seconds
+};
+
+// perceptron with nbOutput outputs sharing one nbOutput x nbInput weight matrix
+class multiClassPerceptron
+{
+public:
+    multiClassPerceptron(const int nbInput, const int nbOutput, const perceptronMode mode = PERCEPTRON_MULTI_CLASS);
+    bool loadTrainingSetFile(const string fileUrl);                 // [perceptron] file with nbOutput outputs per example
+    bool loadTrainingSet(const vector< vector<double> > &tabInputs, const vector< vector<int> > &tabOutputTargets);
+    void setPocket(const bool enable);          // keep the weights with the fewest misclassified examples (ratchet)
+    void setNbThreads(const int nbThreads);     // threadPool tasks counting the misclassified examples of each epoch
+    void learning(const int limit = -1, const bool verbose = false);
+    void computeOutput(const vector<double> &tabInput, vector<int> &tabOutputs) const;     // multi-class: one-hot
+    int computeClass(const vector<double> &tabInput) const;
+    bool computeBatch(const double *tabInputs, int *tabOutputs, const int nbSample) const;  // nbOutput outputs per sample
+    bool computeFile(const string fileInUrl, string fileOutUrl = "") const;                // [perceptron] inputs (outputs ignored)
+    void computeScores(const double *tabInputs, double *tabScores, const int nbSample) const; // sums of the nbOutput rows
+    int countErrors() const;                    // misclassified examples of the training set
+    const perceptronStats &getStats() const;
+    int getNbInput() const;
+    int getNbOutput() const;
+    perceptronMode getMode() const;
+    bool saveStateText(const string fileUrl);
+    bool loadStateText(const string fileUrl);
+
+private:
+    int m_nbInput;
+    int m_nbOutput;
+    perceptronMode m_mode;
+    vector<double> m_tabWeights;                // nbOutput x nbInput
+    vector<double> m_tabExamples;               // nbExample x nbInput
+    vector<int> m_tabOutputTargets;             // nbExample x nbOutput
+    vector<int> m_tabClasses;                   // multi-class: class of each example
+    bool m_pocket;
+    int m_nbThreads;
+    perceptronStats m_stats;
+    int nbExample() const;
+    bool setTargets(const vector<int> &tabOutputTargets);           // checks the one-hot outputs of the multi-class mode
+    void computeRow(const double *inputs, const double *tabWeights, int *outputs) const;
+    int countErrors(const double *tabWeights) const;
+    int countRange(const double *tabWeights, const int first, const int last) const;
 };
 
 #endif // PERCEPTRON_H
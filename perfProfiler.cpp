@@ -0,0 +1,262 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "perfProfiler.h"
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *PHASE_NAMES[PROFILE_NB_PHASE] = {"forward", "output error", "backpropagation", "weight update", "shuffle", "read", "write"};
+static const char *COUNTER_NAMES[COUNTER_NB] = {"cycles", "instructions", "L1d misses", "LLC misses", "branch misses"};
+static const char *COUNTER_KEYS[COUNTER_NB] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+perfProfiler::perfProfiler()
+{
+    m_nbOpen = 0;
+    for (int c=0; c < COUNTER_NB; c++)
+    {
+        m_tabFd[c] = -1;
+        m_tabIndex[c] = -1;
+        m_tabStart[c] = 0;
+    }
+    reset();
+}
+
+perfProfiler::~perfProfiler()
+{
+    close();
+}
+
+bool perfProfiler::open()
+{
+    close();
+#ifdef __linux__
+    unsigned int tabTypes[COUNTER_NB] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+    unsigned long long tabConfigs[COUNTER_NB] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES};
+
+    // one group: a single read returns all the counters; a missing counter does not disable the others
+    for (int c=0; c < COUNTER_NB; c++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = tabTypes[c];
+        attr.config = tabConfigs[c];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        int leader = (m_nbOpen == 0) ? -1 : m_tabFd[COUNTER_CYCLES];
+        if (m_nbOpen == 0 && c != COUNTER_CYCLES)
+            break;                                  // no cycles counter: no group leader
+
+        int fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fd < 0)
+            continue;
+        m_tabFd[c] = fd;
+        m_tabIndex[c] = m_nbOpen++;
+    }
+
+    if (m_nbOpen > 0)
+    {
+        ioctl(m_tabFd[COUNTER_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_tabFd[COUNTER_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    return m_nbOpen > 0;
+}
+
+void perfProfiler::close()
+{
+#ifdef __linux__
+    for (int c=COUNTER_NB-1; c >= 0; c--)
+    {
+        if (m_tabFd[c] >= 0)
+            ::close(m_tabFd[c]);
+        m_tabFd[c] = -1;
+        m_tabIndex[c] = -1;
+    }
+#endif
+    m_nbOpen = 0;
+}
+
+bool perfProfiler::isAvailable(const int counter) const
+{
+    return m_tabFd[counter] >= 0;
+}
+
+void perfProfiler::reset()
+{
+    m_tabCounts.assign(PROFILE_NB_PHASE, vector<profileCount>());
+}
+
+bool perfProfiler::readCounters(long long *tabValues) const
+{
+#ifdef __linux__
+    if (m_nbOpen == 0)
+        return false;
+
+    // PERF_FORMAT_GROUP: number of counters then their values
+    unsigned long long buffer[1 + COUNTER_NB];
+    if (read(m_tabFd[COUNTER_CYCLES], buffer, sizeof(unsigned long long) * (1 + m_nbOpen)) <= 0)
+        return false;
+    for (int c=0; c < COUNTER_NB; c++)
+        tabValues[c] = (m_tabIndex[c] >= 0) ? (long long) buffer[1 + m_tabIndex[c]] : 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void perfProfiler::start()
+{
+    readCounters(m_tabStart);
+    m_startTime = chrono::steady_clock::now();
+}
+
+void perfProfiler::stop(const int phase, const int layer)
+{
+    long long tabValues[COUNTER_NB] = {0};
+    bool counters = readCounters(tabValues);
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    vector<profileCount> &tabLayers = m_tabCounts[phase];
+    if (layer >= tabLayers.size())
+    {
+        profileCount empty;
+        memset(&empty, 0, sizeof empty);
+        tabLayers.resize(layer + 1, empty);
+    }
+
+    profileCount &count = tabLayers[layer];
+    count.nbCall++;
+    count.time += chrono::duration<double>(now - m_startTime).count();
+    if (counters)
+    {
+        for (int c=0; c < COUNTER_NB; c++)
+        {
+            count.tabCounters[c] += tabValues[c] - m_tabStart[c];
+            m_tabStart[c] = tabValues[c];
+        }
+    }
+    m_startTime = now;
+}
+
+void perfProfiler::printTable(ostream &out) const
+{
+    char line[256];
+    snprintf(line, sizeof line, "%-24s %10s %12s", "phase / layer", "calls", "time (ms)");
+    out << line;
+    for (int c=0; c < COUNTER_NB; c++)
+    {
+        snprintf(line, sizeof line, " %14s", COUNTER_NAMES[c]);
+        out << line;
+    }
+    out << "        IPC" << endl;
+
+    for (int phase=0; phase < PROFILE_NB_PHASE; phase++)
+    {
+        const vector<profileCount> &tabLayers = m_tabCounts[phase];
+        for (int layer=0; layer < tabLayers.size(); layer++)
+        {
+            const profileCount &count = tabLayers[layer];
+            if (count.nbCall == 0)
+                continue;
+
+            string name = PHASE_NAMES[phase];
+            if (phase <= PROFILE_UPDATE && phase != PROFILE_OUTPUT_ERROR)
+                name += " layer " + to_string(layer);
+            snprintf(line, sizeof line, "%-24s %10ld %12.3f", name.c_str(), count.nbCall, 1e3 * count.time);
+            out << line;
+            for (int c=0; c < COUNTER_NB; c++)
+            {
+                if (isAvailable(c))
+                    snprintf(line, sizeof line, " %14lld", count.tabCounters[c]);
+                else
+                    snprintf(line, sizeof line, " %14s", "n/a");
+                out << line;
+            }
+            if (isAvailable(COUNTER_CYCLES) && isAvailable(COUNTER_INSTRUCTIONS) && count.tabCounters[COUNTER_CYCLES] > 0)
+                snprintf(line, sizeof line, " %10.2f", (double) count.tabCounters[COUNTER_INSTRUCTIONS] / count.tabCounters[COUNTER_CYCLES]);
+            else
+                snprintf(line, sizeof line, " %10s", "n/a");
+            out << line << endl;
+        }
+    }
+
+    if (m_nbOpen == 0)
+        out << "hardware counters unavailable (perf_event_open): time only" << endl;
+}
+
+bool perfProfiler::saveJson(const string fileUrl) const
+{
+    ofstream file(fileUrl.c_str(), ios::out | ios::trunc);
+    if (!file.is_open())
+    {
+        cout << "error: can't open file " << fileUrl << endl;
+        return false;
+    }
+
+    file << "{" << endl << "  \"counters_available\": " << (m_nbOpen > 0 ? "true" : "false") << "," << endl;
+    file << "  \"regions\": [";
+    bool first = true;
+    for (int phase=0; phase < PROFILE_NB_PHASE; phase++)
+    {
+        const vector<profileCount> &tabLayers = m_tabCounts[phase];
+        for (int layer=0; layer < tabLayers.size(); layer++)
+        {
+            const profileCount &count = tabLayers[layer];
+            if (count.nbCall == 0)
+                continue;
+
+            file << (first ? "" : ",") << endl << "    {\"phase\": \"" << PHASE_NAMES[phase] << "\", \"layer\": " << layer
+                 << ", \"calls\": " << count.nbCall << ", \"time_ms\": " << 1e3 * count.time;
+            for (int c=0; c < COUNTER_NB; c++)
+            {
+                file << ", \"" << COUNTER_KEYS[c] << "\": ";
+                if (isAvailable(c))
+                    file << count.tabCounters[c];
+                else
+                    file << "null";
+            }
+            file << "}";
+            first = false;
+        }
+    }
+    file << endl << "  ]" << endl << "}" << endl;
+    return true;
+}
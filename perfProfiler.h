@@ -0,0 +1,91 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef PERFPROFILER_H
+#define PERFPROFILER_H
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <chrono>
+using namespace std;
+
+enum profilePhase
+{
+    PROFILE_FORWARD = 0,
+    PROFILE_OUTPUT_ERROR,
+    PROFILE_BACKPROPAGATION,
+    PROFILE_UPDATE,
+    PROFILE_SHUFFLE,
+    PROFILE_READ,                                   // computeFile: parse inputs
+    PROFILE_WRITE,                                  // computeFile: write outputs
+    PROFILE_NB_PHASE
+};
+
+enum profileCounter
+{
+    COUNTER_CYCLES = 0,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_NB
+};
+
+struct profileCount
+{
+    long nbCall;
+    double time;                                    // seconds
+    long long tabCounters[COUNTER_NB];
+};
+
+// hardware performance counters (Linux perf_event_open) of the calling thread, by phase and by layer.
+// When the counters are unavailable (other OS, containers, perf_event_paranoid), only the time is measured.
+class perfProfiler
+{
+public:
+    perfProfiler();
+    ~perfProfiler();
+    bool open();                                    // open the counters, false if unavailable (time only)
+    void close();
+    bool isAvailable(const int counter) const;
+    void reset();
+    void start();                                   // snapshot the counters
+    void stop(const int phase, const int layer);    // add the counters since the last snapshot, then snapshot again
+    void printTable(ostream &out) const;
+    bool saveJson(const string fileUrl) const;
+
+private:
+    int m_tabFd[COUNTER_NB];                        // file descriptors (-1: counter unavailable), the first one leads the group
+    int m_tabIndex[COUNTER_NB];                     // position of each counter in the group read
+    int m_nbOpen;
+    long long m_tabStart[COUNTER_NB];
+    chrono::steady_clock::time_point m_startTime;
+    vector< vector<profileCount> > m_tabCounts;     // [phase][layer]
+    bool readCounters(long long *tabValues) const;
+};
+
+#endif // PERFPROFILER_H
@@ -0,0 +1,94 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <stddef.h>
+using namespace std;
+
+// ring buffer between one producer thread and one consumer thread, without lock: the producer only writes m_tail,
+// the consumer only writes m_head. front() reads the oldest item without removing it: the consumer pops it once it
+// has finished with the data the item refers to, so the producer can't reuse that data before.
+template <class T>
+class spscQueue
+{
+public:
+    spscQueue(const size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        m_tabItems.resize(size);
+        m_mask = size - 1;
+        m_head = 0;
+        m_tail = 0;
+    }
+
+    bool full() const                                   // producer
+    {
+        return m_tail.load(memory_order_relaxed) - m_head.load(memory_order_acquire) == m_tabItems.size();
+    }
+
+    bool push(const T &item)                            // producer, false if full
+    {
+        size_t tail = m_tail.load(memory_order_relaxed);
+        if (tail - m_head.load(memory_order_acquire) == m_tabItems.size())
+            return false;
+        m_tabItems[tail & m_mask] = item;
+        m_tail.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    bool front(T &item) const                           // consumer, false if empty
+    {
+        size_t head = m_head.load(memory_order_relaxed);
+        if (head == m_tail.load(memory_order_acquire))
+            return false;
+        item = m_tabItems[head & m_mask];
+        return true;
+    }
+
+    void pop()                                          // consumer, after a successful front()
+    {
+        m_head.store(m_head.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    size_t capacity() const
+    {
+        return m_tabItems.size();
+    }
+
+private:
+    vector<T> m_tabItems;
+    size_t m_mask;
+    alignas(64) atomic<size_t> m_head;                  // own cache lines: the two threads do not share a written line
+    alignas(64) atomic<size_t> m_tail;
+};
+
+#endif // SPSCQUEUE_H
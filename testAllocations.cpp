@@ -0,0 +1,119 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+// Test of the steady state: once warmed up, learning and inference do not allocate (heap allocations counted by allocationCounter.h)
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "multilayerPerceptron.h"
+#include "threadPool.h"
+#include "allocationCounter.h"
+
+using namespace std;
+
+static const vector<int> TOPOLOGY = {8, 32, 16, 4};
+
+// allocations of one run of f after the warm-up runs (buffers sized, each worker of the thread pool has computed a block)
+template <class function>
+static bool check(const string &name, function f)
+{
+    for (int i = 0; i < 20; i++)
+        f();
+    long nbAllocations = countAllocations(f);
+    cout << (nbAllocations == 0 ? "ok: " : "FAILED: ") << name << " allocations after warm-up = " << nbAllocations << endl;
+    return nbAllocations == 0;
+}
+
+static void writeInputs(const string &fileUrl, const int nbSample)
+{
+    ofstream file(fileUrl.c_str(), ios::out | ios::trunc);
+    file << "[mlp]" << endl << TOPOLOGY[0] << " " << TOPOLOGY[TOPOLOGY.size() - 1] << " " << nbSample << endl << "[inputs]" << endl;
+    for (int i = 0; i < nbSample; i++)
+    {
+        for (int k = 0; k < TOPOLOGY[0]; k++)
+            file << (double) rand() / RAND_MAX << " ";
+        file << endl;
+    }
+}
+
+int main()
+{
+    srand(1);
+    int nbSample = 512;
+    vector< vector<double> > tabInputs(nbSample, vector<double>(TOPOLOGY[0]));
+    vector< vector<double> > tabTargets(nbSample, vector<double>(TOPOLOGY[TOPOLOGY.size() - 1]));
+    for (int i = 0; i < nbSample; i++)
+    {
+        for (int k = 0; k < tabInputs[i].size(); k++)
+            tabInputs[i][k] = (double) rand() / RAND_MAX;
+        for (int k = 0; k < tabTargets[i].size(); k++)
+            tabTargets[i][k] = rand() % 2;
+    }
+    vector<double> tabRows;
+    for (int i = 0; i < nbSample; i++)
+        tabRows.insert(tabRows.end(), tabInputs[i].begin(), tabInputs[i].end());
+
+    multilayerPerceptron mlp(TOPOLOGY);
+    if (!mlp.loadTrainingSet(tabInputs, tabTargets))
+        return 1;
+    threadPool::instance().setThreads(4);
+
+    bool ok = true;
+    ok = check("learning", [&]() { mlp.learning(1); }) && ok;
+    mlp.setPrecision(PRECISION_BFLOAT16);
+    ok = check("learning bfloat16", [&]() { mlp.learning(1); }) && ok;
+    mlp.setPrecision(PRECISION_DOUBLE);
+    mlp.setAccumulation(64 * 1024, 4);
+    ok = check("learning with accumulation", [&]() { mlp.learning(1); }) && ok;
+    mlp.setAccumulation(0);
+
+    vector<double> tabOutput;
+    ok = check("computeOutput", [&]() { for (int i = 0; i < nbSample; i++) mlp.computeOutput(tabInputs[i], tabOutput); }) && ok;
+    vector< vector<double> > tabOutputs;
+    ok = check("computeBatch", [&]() { mlp.computeBatch(tabInputs, tabOutputs); }) && ok;
+    ok = check("computeBatch 4 threads", [&]() { mlp.computeBatch(tabInputs, tabOutputs, 4); }) && ok;
+    vector<double> tabResults(nbSample * TOPOLOGY[TOPOLOGY.size() - 1]);
+    ok = check("computeBatch rows", [&]() { mlp.computeBatch(&tabRows[0], &tabResults[0], nbSample, 4); }) && ok;
+
+    // computeFile opens its files and sizes its two matrices once per call: nothing is allocated per row
+    writeInputs("testAllocations_64.txt", 64);
+    writeInputs("testAllocations_512.txt", 512);
+    mlp.computeFile("testAllocations_512.txt", "testAllocations_out.txt");
+    long nbAllocations64 = countAllocations([&]() { mlp.computeFile("testAllocations_64.txt", "testAllocations_out.txt"); });
+    long nbAllocations512 = countAllocations([&]() { mlp.computeFile("testAllocations_512.txt", "testAllocations_out.txt"); });
+    bool fileOk = nbAllocations512 == nbAllocations64;
+    cout << (fileOk ? "ok: " : "FAILED: ") << "computeFile allocations 64 rows = " << nbAllocations64 << ", 512 rows = " << nbAllocations512 << endl;
+    ok = fileOk && ok;
+    remove("testAllocations_64.txt");
+    remove("testAllocations_512.txt");
+    remove("testAllocations_out.txt");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+
+// Test of exportCpp, in two builds of this file:
+// - without EXPORTED: learn a dense and a pruned network, save their states and export them as exportDense.hpp, exportPruned.hpp
+// - with EXPORTED: include the generated headers, reload the states and compare predict with computeOutput on random inputs
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <stdlib.h>
+#include "multilayerPerceptron.h"
+#ifdef EXPORTED
+#include "exportDense.hpp"
+#include "exportPruned.hpp"
+#endif
+
+using namespace std;
+
+static const vector<int> TOPOLOGY = {6, 16, 9, 3};
+static const double EPSILON = 1e-12;                    // same operations in the same order: the outputs are equal but for rounding
+
+#ifndef EXPORTED
+int main()
+{
+    srand(1);
+    vector< vector<double> > tabInputs(200, vector<double>(TOPOLOGY[0]));
+    vector< vector<double> > tabTargets(200, vector<double>(TOPOLOGY[TOPOLOGY.size() - 1]));
+    for (int i = 0; i < tabInputs.size(); i++)
+    {
+        for (int k = 0; k < tabInputs[i].size(); k++)
+            tabInputs[i][k] = 2.0 * rand() / RAND_MAX - 1.0;
+        for (int k = 0; k < tabTargets[i].size(); k++)
+            tabTargets[i][k] = tabInputs[i][k] * tabInputs[i][k + 1] > 0 ? 0.9 : 0.1;
+    }
+
+    multilayerPerceptron mlp(TOPOLOGY);
+    if (!mlp.loadTrainingSet(tabInputs, tabTargets) || !mlp.learning(20))
+        return 1;
+    if (!mlp.saveState("exportDense.bin") || !mlp.exportCpp("exportDense.hpp"))
+        return 1;
+    if (!mlp.prune(0.7) || !mlp.saveState("exportPruned.bin") || !mlp.exportCpp("exportPruned.hpp"))
+        return 1;
+
+    cout << "exportCpp: exportDense.hpp, exportPruned.hpp generated" << endl;
+    return 0;
+}
+#else
+template <class predictFunction>
+static bool check(const string &name, const string &stateFile, predictFunction predict)
+{
+    multilayerPerceptron mlp(TOPOLOGY);
+    if (!mlp.loadState(stateFile))
+        return false;
+
+    double maxError = 0;
+    vector<double> tabInput(TOPOLOGY[0]);
+    vector<double> tabOutput;
+    vector<double> tabExported(TOPOLOGY[TOPOLOGY.size() - 1]);
+    for (int i = 0; i < 10000; i++)
+    {
+        for (int k = 0; k < tabInput.size(); k++)
+            tabInput[k] = 4.0 * rand() / RAND_MAX - 2.0;
+        mlp.computeOutput(tabInput, tabOutput);
+        predict(&tabInput[0], &tabExported[0]);
+        for (int k = 0; k < tabOutput.size(); k++)
+            maxError = max(maxError, fabs(tabOutput[k] - tabExported[k]));
+    }
+
+    bool ok = maxError <= EPSILON;
+    cout << (ok ? "ok: " : "FAILED: ") << name << " max difference with computeOutput = " << maxError << endl;
+    return ok;
+}
+
+int main()
+{
+    srand(2);
+    bool ok = check("exportCpp dense", "exportDense.bin", exportDense::predict);
+    ok = check("exportCpp pruned", "exportPruned.bin", exportPruned::predict) && ok;
+    return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,455 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "threadPool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static thread_local int t_worker = -1;                  // index of the worker running the thread, -1: not a worker
+static thread_local bool t_pooled = false;              // worker or spare thread: its calls come from a task already counted
+static thread_local bool t_inCall = false;              // in a counted call: the nested calls (chunks run while waiting) are not
+#ifdef __linux__
+static cpu_set_t g_allowedCpus;                         // affinity of the process when the pool starts
+#endif
+
+threadPool &threadPool::instance()
+{
+    static threadPool pool;
+    return pool;
+}
+
+threadPool::threadPool()
+    : m_nbQueued(0), m_pinned(false), m_nbWorkers(0), m_nbActive(0), m_reconfiguring(false),
+      m_nbTask(0), m_nbSteal(0), m_nbParallelFor(0), m_nbConcurrent(0), m_nextQueue(0)
+{
+#ifdef __linux__
+    CPU_ZERO(&g_allowedCpus);
+    sched_getaffinity(0, sizeof g_allowedCpus, &g_allowedCpus);
+#endif
+    startWorkers(0, false);
+}
+
+threadPool::~threadPool()
+{
+    stopWorkers();
+}
+
+void threadPool::setThreads(const int nbThreads, const bool pinned)
+{
+    lock_guard<mutex> configLock(m_configMutex);
+
+    // the deques and the spare threads are replaced once no call from outside the pool uses them
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_reconfiguring = true;
+        m_idle.wait(lock, [this] { return m_nbActive == 0; });
+    }
+    stopWorkers();
+    startWorkers(nbThreads, pinned);
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_reconfiguring = false;
+    }
+    m_idle.notify_all();
+}
+
+bool threadPool::enterCall()
+{
+    if (t_pooled || t_inCall)
+        return false;
+    unique_lock<mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return !m_reconfiguring; });
+    m_nbActive++;
+    t_inCall = true;
+    return true;
+}
+
+void threadPool::leaveCall(const bool entered)
+{
+    if (!entered)
+        return;
+    t_inCall = false;
+    bool idle = false;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_nbActive--;
+        idle = (m_nbActive == 0 && m_reconfiguring);
+    }
+    if (idle)
+        m_idle.notify_all();
+}
+
+int threadPool::size() const
+{
+    return m_nbWorkers;
+}
+
+bool threadPool::isPinned() const
+{
+    return m_pinned;
+}
+
+void threadPool::startWorkers(const int nbThreads, const bool pinned)
+{
+    m_stop = false;
+    m_pinned = pinned;
+    int nbWorker = nbThreads;
+    if (nbWorker <= 0)
+        nbWorker = max(2, (int) thread::hardware_concurrency());
+
+    // the deques exist before the first worker can steal
+    for (int i=0; i < nbWorker; i++)
+        m_tabQueues.push_back(unique_ptr<workerQueue>(new workerQueue));
+    for (int i=0; i < nbWorker; i++)
+        m_tabWorkers.push_back(thread(&threadPool::worker, this, i));
+    m_nbWorkers = nbWorker;
+}
+
+void threadPool::stopWorkers()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_taskAdded.notify_all();
+    for (int i=0; i < m_tabWorkers.size(); i++)
+        m_tabWorkers[i].join();
+    m_tabWorkers.clear();
+    m_tabQueues.clear();
+
+    lock_guard<mutex> lock(m_spareMutex);
+    for (int i=0; i < m_tabSpares.size(); i++)
+    {
+        {
+            lock_guard<mutex> spareLock(m_tabSpares[i]->spareMutex);
+            m_tabSpares[i]->stop = true;
+        }
+        m_tabSpares[i]->wake.notify_one();
+        m_tabSpares[i]->worker.join();
+    }
+    m_tabSpares.clear();
+}
+
+void threadPool::submit(const function<void()> &task)
+{
+    {
+        unique_lock<mutex> lock(m_mutex);
+        if (!t_pooled && !t_inCall)
+            m_idle.wait(lock, [this] { return !m_reconfiguring; });
+        m_detached.push_back(task);
+        m_nbQueued++;
+    }
+    m_taskAdded.notify_one();
+}
+
+void threadPool::pushTask(const chunkTask &task)
+{
+    // a worker keeps its chunks (stolen by the idle workers), another thread spreads them over the deques
+    int index = t_worker;
+    if (index < 0 || index >= m_tabQueues.size())
+        index = m_nextQueue++ % m_tabQueues.size();
+    {
+        workerQueue &queue = *m_tabQueues[index];
+        lock_guard<mutex> lock(queue.queueMutex);
+        if (queue.count == queue.tasks.size())
+        {
+            // full: doubled, the tasks keep their order from head
+            vector<chunkTask> tasks(max((size_t) 16, 2 * queue.tasks.size()));
+            for (size_t i=0; i < queue.count; i++)
+                tasks[i] = queue.tasks[(queue.head + i) % queue.tasks.size()];
+            queue.tasks.swap(tasks);
+            queue.head = 0;
+        }
+        queue.tasks[(queue.head + queue.count) % queue.tasks.size()] = task;
+        queue.count++;
+    }
+    m_nbQueued++;
+}
+
+void threadPool::parallelChunks(const long first, const long last, const long grain, chunkFunction run, const void *body)
+{
+    if (last <= first)
+        return;
+    long grainSize = max(1L, grain);
+    long nbChunk = (last - first + grainSize - 1) / grainSize;
+    if (nbChunk == 1)
+    {
+        run(body, first, last);
+        return;
+    }
+    bool entered = enterCall();
+    if (m_tabQueues.empty())
+    {
+        run(body, first, last);
+        leaveCall(entered);
+        return;
+    }
+    m_nbParallelFor++;
+
+    // pushed from the end: the owner pops the chunks in order, the thieves take the end of the range
+    taskGroup group(nbChunk - 1);
+    for (long c=nbChunk-1; c >= 1; c--)
+    {
+        long begin = first + c * grainSize;
+        long end = min(last, begin + grainSize);
+        chunkTask task = {run, body, begin, end, &group};
+        pushTask(task);
+    }
+    {
+        lock_guard<mutex> lock(m_mutex);                // no worker misses the wake-up between its check and its wait
+    }
+    m_taskAdded.notify_all();
+
+    // then the queued tasks (of this call or not) until none is left: the last chunks run on other threads
+    run(body, first, min(last, first + grainSize));
+    while (group.nbPending.load(memory_order_acquire) > 0 && runTask(t_worker, false))
+        ;
+    waitGroup(&group);
+    leaveCall(entered);
+}
+
+void threadPool::finishTask(taskGroup *group)
+{
+    // decremented under the mutex: the waiter cannot miss the notification, nor destroy the group before it is sent
+    lock_guard<mutex> lock(group->groupMutex);
+    if (--group->nbPending == 0)
+        group->done.notify_one();
+}
+
+void threadPool::waitGroup(taskGroup *group)
+{
+    unique_lock<mutex> lock(group->groupMutex);
+    group->done.wait(lock, [group] { return group->nbPending == 0; });
+}
+
+bool threadPool::runTask(const int index, const bool detached)
+{
+    chunkTask task;
+    bool found = false;
+    bool stolen = false;
+    int nbQueue = m_tabQueues.size();
+
+    if (index >= 0 && index < nbQueue)
+    {
+        workerQueue &queue = *m_tabQueues[index];
+        lock_guard<mutex> lock(queue.queueMutex);
+        if (queue.count > 0)
+        {
+            queue.count--;
+            task = queue.tasks[(queue.head + queue.count) % queue.tasks.size()];
+            found = true;
+        }
+    }
+
+    int start = (index >= 0) ? index + 1 : (int) (m_nextQueue % max(1, nbQueue));
+    for (int i=0; !found && i < nbQueue; i++)
+    {
+        int victim = (start + i) % nbQueue;
+        if (victim == index)
+            continue;
+        workerQueue &queue = *m_tabQueues[victim];
+        lock_guard<mutex> lock(queue.queueMutex);
+        if (queue.count > 0)
+        {
+            task = queue.tasks[queue.head];
+            queue.head = (queue.head + 1) % queue.tasks.size();
+            queue.count--;
+            found = true;
+            stolen = true;
+        }
+    }
+
+    // the detached jobs are long: only a free worker starts one, never a thread waiting for its chunks
+    if (!found && detached)
+    {
+        function<void()> job;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (m_detached.empty())
+                return false;
+            job = move(m_detached.front());
+            m_detached.pop_front();
+        }
+        m_nbQueued--;
+        m_nbTask++;
+        job();
+        return true;
+    }
+
+    if (!found)
+        return false;
+    m_nbQueued--;
+    m_nbTask++;
+    if (stolen)
+        m_nbSteal++;
+    task.run(task.body, task.begin, task.end);
+    finishTask(task.group);
+    return true;
+}
+
+void threadPool::worker(const int index)
+{
+    t_worker = index;
+    t_pooled = true;
+    if (m_pinned)
+        pinThread(index);
+
+    while (true)
+    {
+        if (runTask(index, true))
+            continue;
+        unique_lock<mutex> lock(m_mutex);
+        m_taskAdded.wait(lock, [this] { return m_stop || m_nbQueued > 0; });
+        if (m_stop && m_nbQueued == 0)
+            return;                                     // stopped and nothing left to run
+    }
+}
+
+void threadPool::runConcurrent(const int nbTask, const function<void(int)> &task)
+{
+    if (nbTask <= 0)
+        return;
+    bool entered = enterCall();
+    m_nbConcurrent++;
+
+    // a blocked task must not hold a worker: the group gets its own threads, created once and parked between two groups
+    vector<spareThread*> tabSpares;
+    {
+        lock_guard<mutex> lock(m_spareMutex);
+        for (int i=0; i < m_tabSpares.size() && tabSpares.size() < nbTask - 1; i++)
+        {
+            if (!m_tabSpares[i]->busy)
+            {
+                m_tabSpares[i]->busy = true;
+                tabSpares.push_back(m_tabSpares[i].get());
+            }
+        }
+        while (tabSpares.size() < nbTask - 1)
+        {
+            spareThread *spare = new spareThread;
+            spare->busy = true;
+            spare->stop = false;
+            m_tabSpares.push_back(unique_ptr<spareThread>(spare));
+            spare->worker = thread(&threadPool::spare, this, spare, m_nbWorkers + (int) m_tabSpares.size() - 1);
+            tabSpares.push_back(spare);
+        }
+    }
+
+    taskGroup group(nbTask - 1);
+    for (int t=1; t < nbTask; t++)
+    {
+        spareThread *spare = tabSpares[t - 1];
+        {
+            lock_guard<mutex> lock(spare->spareMutex);
+            spare->task = [&task, &group, t]() {
+                task(t);
+                finishTask(&group);
+            };
+        }
+        spare->wake.notify_one();
+    }
+
+    // the other tasks are blocked or running on their own threads: nothing to help with
+    task(0);
+    waitGroup(&group);
+
+    {
+        lock_guard<mutex> lock(m_spareMutex);
+        for (int i=0; i < tabSpares.size(); i++)
+            tabSpares[i]->busy = false;
+    }
+    leaveCall(entered);
+}
+
+void threadPool::spare(spareThread *spare, const int core)
+{
+    t_pooled = true;
+    // pinned pool: on the core after the workers (wrapped on the cpus of the process), else on all the cpus
+    // (a spare created by a pinned worker would inherit the core of the worker)
+    pinThread(m_pinned ? core : -1);
+
+    unique_lock<mutex> lock(spare->spareMutex);
+    while (true)
+    {
+        spare->wake.wait(lock, [spare] { return spare->stop || spare->task; });
+        if (!spare->task)
+            return;
+        function<void()> task = move(spare->task);
+        spare->task = nullptr;
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+void threadPool::pinThread(const int core)
+{
+#ifdef __linux__
+    // core-th cpu allowed to the process (containers may not start at cpu 0), -1: all of them
+    int nbCpu = CPU_COUNT(&g_allowedCpus);
+    if (nbCpu == 0)
+        return;
+    if (core < 0)
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof g_allowedCpus, &g_allowedCpus);
+        return;
+    }
+    int target = core % nbCpu;
+    for (int cpu=0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &g_allowedCpus) || target-- > 0)
+            continue;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+        return;
+    }
+#endif
+}
+
+threadPoolStats threadPool::getStats() const
+{
+    threadPoolStats stats;
+    stats.nbTask = m_nbTask;
+    stats.nbSteal = m_nbSteal;
+    stats.nbParallelFor = m_nbParallelFor;
+    stats.nbConcurrent = m_nbConcurrent;
+    lock_guard<mutex> lock(m_spareMutex);
+    stats.nbSpare = m_tabSpares.size();
+    return stats;
+}
+
+void threadPool::resetStats()
+{
+    m_nbTask = 0;
+    m_nbSteal = 0;
+    m_nbParallelFor = 0;
+    m_nbConcurrent = 0;
+}
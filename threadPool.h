@@ -0,0 +1,179 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+using namespace std;
+
+struct threadPoolStats
+{
+    long nbTask;                                        // tasks run by the workers and by the threads waiting in parallelFor
+    long nbSteal;                                       // tasks taken from the deque of another worker
+    long nbParallelFor;
+    long nbConcurrent;                                  // runConcurrent groups
+    int nbSpare;                                        // threads created by runConcurrent, parked between two groups
+};
+
+// process-wide work-stealing scheduler: all the parallel paths (learning jobs, computeBatch, pipeline stages,
+// perceptron epochs) share its workers instead of creating their own threads
+// each worker owns a deque: it pops its own tasks from the back (the last pushed, still in cache)
+// and, once empty, steals from the front of the other deques (the oldest, largest remaining work)
+class threadPool
+{
+public:
+    static threadPool &instance();
+    ~threadPool();                                      // runs the queued tasks then joins the workers
+    void setThreads(const int nbThreads, const bool pinned = false);  // 0: hardware threads (at least 2), pinned: worker i on core i,
+                                                        // spare thread i on core nbThreads + i (Linux)
+                                                        // waits for the running calls, the new ones wait for the new workers (not from a task)
+    int size() const;                                   // number of workers
+    bool isPinned() const;
+    void submit(const function<void()> &task);          // detached task (background job): run by a worker in submission order
+    // body(begin, end) on the chunks [first + k*grain, first + (k+1)*grain) of [first, last), returns once all are done
+    // the calling thread runs the first chunk then the queued tasks while it waits: nested calls do not deadlock
+    template <class bodyFunction>
+    void parallelFor(const long first, const long last, const long grain, const bodyFunction &body);
+    // map(begin, end) on the chunks of parallelFor, partial results combined in chunk order (same result for any number of threads)
+    template <class value, class mapFunction, class combineFunction>
+    value parallelReduce(const long first, const long last, const long grain, const value identity, const mapFunction &map, const combineFunction &combine);
+    // tasks that wait for each other (pipeline stages): each one runs on its own thread at the same time,
+    // task(0) on the calling thread, the others on parked spare threads reused from one group to the next
+    void runConcurrent(const int nbTask, const function<void(int)> &task);
+    threadPoolStats getStats() const;
+    void resetStats();
+
+private:
+    typedef void (*chunkFunction)(const void *body, long begin, long end);
+    struct taskGroup                                    // tasks of one parallelFor or runConcurrent, the caller sleeps until they are done
+    {
+        taskGroup(const long nbTask) : nbPending(nbTask) {}
+        atomic<long> nbPending;                         // decremented with groupMutex held
+        mutex groupMutex;
+        condition_variable done;
+    };
+    struct chunkTask                                    // one chunk of a parallelFor, queued without allocation
+    {
+        chunkFunction run;
+        const void *body;
+        long begin;
+        long end;
+        taskGroup *group;
+    };
+    struct workerQueue
+    {
+        workerQueue() : head(0), count(0) {}
+        alignas(64) mutex queueMutex;
+        vector<chunkTask> tasks;                        // circular buffer, only grows: no allocation once sized
+        size_t head;                                    // oldest task
+        size_t count;
+    };
+    struct spareThread
+    {
+        thread worker;
+        mutex spareMutex;
+        condition_variable wake;
+        function<void()> task;
+        bool busy;                                      // reserved by a runConcurrent group
+        bool stop;
+    };
+
+    vector<thread> m_tabWorkers;
+    vector< unique_ptr<workerQueue> > m_tabQueues;      // one per worker
+    deque< function<void()> > m_detached;               // submit: FIFO shared by the workers
+    mutex m_mutex;                                      // detached queue and sleeping workers
+    condition_variable m_taskAdded;
+    atomic<long> m_nbQueued;                            // tasks in the deques and the detached queue
+    bool m_stop;
+    atomic<bool> m_pinned;
+    atomic<int> m_nbWorkers;
+    mutex m_configMutex;                                // setThreads
+    condition_variable m_idle;                          // m_nbActive or m_reconfiguring changed (with m_mutex)
+    int m_nbActive;                                     // parallelFor and runConcurrent calls from threads outside the pool
+    bool m_reconfiguring;                               // setThreads: new calls and submissions wait
+    vector< unique_ptr<spareThread> > m_tabSpares;
+    mutable mutex m_spareMutex;
+    atomic<long> m_nbTask;
+    atomic<long> m_nbSteal;
+    atomic<long> m_nbParallelFor;
+    atomic<long> m_nbConcurrent;
+    atomic<unsigned int> m_nextQueue;                   // round robin of the chunks pushed by a thread which is not a worker
+
+    threadPool();
+    threadPool(const threadPool &) = delete;
+    threadPool &operator=(const threadPool &) = delete;
+    void startWorkers(const int nbThreads, const bool pinned);
+    void stopWorkers();
+    void worker(const int index);
+    bool runTask(const int index, const bool detached); // one queued task (index -1: not a worker), false: nothing to run
+    void parallelChunks(const long first, const long last, const long grain, chunkFunction run, const void *body);
+    void pushTask(const chunkTask &task);
+    static void finishTask(taskGroup *group);
+    static void waitGroup(taskGroup *group);
+    bool enterCall();                                   // waits while setThreads replaces the workers, false: thread of the pool
+    void leaveCall(const bool entered);
+    void spare(spareThread *spare, const int core);
+    static void pinThread(const int core);              // -1: all the cpus of the process
+};
+
+template <class bodyFunction>
+void threadPool::parallelFor(const long first, const long last, const long grain, const bodyFunction &body)
+{
+    // the chunks call the body through a plain function pointer: no std::function to allocate
+    parallelChunks(first, last, grain, [](const void *context, long begin, long end) {
+        (*(const bodyFunction *) context)(begin, end);
+    }, &body);
+}
+
+template <class value, class mapFunction, class combineFunction>
+value threadPool::parallelReduce(const long first, const long last, const long grain, const value identity, const mapFunction &map, const combineFunction &combine)
+{
+    if (last <= first)
+        return identity;
+    long grainSize = max(1L, grain);
+    long nbChunk = (last - first + grainSize - 1) / grainSize;
+    vector<value> tabPartial(nbChunk, identity);
+    parallelFor(0, nbChunk, 1, [&](long firstChunk, long lastChunk) {
+        for (long c=firstChunk; c < lastChunk; c++)
+            tabPartial[c] = map(first + c * grainSize, min(last, first + (c + 1) * grainSize));
+    });
+
+    value result = identity;
+    for (long c=0; c < nbChunk; c++)
+        result = combine(result, tabPartial[c]);
+    return result;
+}
+
+#endif // THREADPOOL_H
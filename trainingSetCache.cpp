@@ -0,0 +1,203 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#include "trainingSetCache.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+
+static const long DEFAULT_MEMORY_LIMIT = 512L << 20;   // bytes
+
+// size and modification time (nanoseconds when available: a file rewritten in the same second is detected)
+static bool fileInfo(const string &fileUrl, long &size, long long &mtime)
+{
+    struct stat info;
+    if (stat(fileUrl.c_str(), &info) != 0)
+        return false;
+    size = info.st_size;
+#ifdef __linux__
+    mtime = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#else
+    mtime = info.st_mtime * 1000000000LL;
+#endif
+    return true;
+}
+
+trainingSetCache::trainingSetCache()
+{
+    m_memoryLimit = DEFAULT_MEMORY_LIMIT;
+    m_sidecar = false;
+    m_stats.nbEntry = 0;
+    m_stats.bytes = 0;
+    m_stats.nbHit = 0;
+    m_stats.nbMiss = 0;
+    m_stats.nbEviction = 0;
+}
+
+trainingSetCache &trainingSetCache::instance()
+{
+    static trainingSetCache cache;
+    return cache;
+}
+
+shared_ptr< const vector<traningSetMlp> > trainingSetCache::find(const string &fileUrl)
+{
+    long size = 0;
+    long long mtime = 0;
+    bool found = fileInfo(fileUrl, size, mtime);
+
+    lock_guard<mutex> lock(m_mutex);
+    map<string, cacheEntry>::iterator it = m_tabEntries.find(fileUrl);
+    if (it == m_tabEntries.end() || !found || it->second.size != size || it->second.mtime != mtime)
+    {
+        if (it != m_tabEntries.end())
+            erase(it);                                  // the file changed
+        if (m_memoryLimit > 0)
+            m_stats.nbMiss++;
+        return shared_ptr< const vector<traningSetMlp> >();
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    m_stats.nbHit++;
+    return it->second.trainingSet;
+}
+
+void trainingSetCache::insert(const string &fileUrl, const shared_ptr< const vector<traningSetMlp> > &trainingSet)
+{
+    cacheEntry entry;
+    if (!trainingSet || !fileInfo(fileUrl, entry.size, entry.mtime))
+        return;
+    entry.trainingSet = trainingSet;
+    entry.bytes = trainingSetBytes(*trainingSet);
+
+    lock_guard<mutex> lock(m_mutex);
+    map<string, cacheEntry>::iterator it = m_tabEntries.find(fileUrl);
+    if (it != m_tabEntries.end())
+        erase(it);
+    if (entry.bytes > m_memoryLimit)
+        return;
+
+    // least recently used entries first
+    while (!m_lru.empty() && m_stats.bytes + entry.bytes > m_memoryLimit)
+    {
+        erase(m_tabEntries.find(m_lru.back()));
+        m_stats.nbEviction++;
+    }
+
+    m_lru.push_front(fileUrl);
+    entry.lru = m_lru.begin();
+    m_tabEntries[fileUrl] = entry;
+    m_stats.nbEntry++;
+    m_stats.bytes += entry.bytes;
+}
+
+void trainingSetCache::clear()
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_tabEntries.clear();
+    m_lru.clear();
+    m_stats.nbEntry = 0;
+    m_stats.bytes = 0;
+}
+
+void trainingSetCache::setMemoryLimit(const long bytes)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_memoryLimit = max(0L, bytes);
+    while (!m_lru.empty() && m_stats.bytes > m_memoryLimit)
+    {
+        erase(m_tabEntries.find(m_lru.back()));
+        m_stats.nbEviction++;
+    }
+}
+
+long trainingSetCache::getMemoryLimit() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_memoryLimit;
+}
+
+void trainingSetCache::setSidecar(const bool enable)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_sidecar = enable;
+}
+
+bool trainingSetCache::getSidecar() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_sidecar;
+}
+
+bool trainingSetCache::isSidecarValid(const string &fileUrl) const
+{
+    // a file replaced by an older one (cp -p, tar, checkout) has another stamp, even if the sidecar is more recent
+    string stamp = sidecarStamp(fileUrl);
+    ifstream file(sidecarFile(fileUrl).c_str(), ios::in | ios::binary);
+    string header(stamp.size(), '\0');
+    return !stamp.empty() && file.read(&header[0], header.size()) && header == stamp;
+}
+
+trainingSetCacheStats trainingSetCache::getStats() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_stats;
+}
+
+string trainingSetCache::sidecarFile(const string &fileUrl)
+{
+    return fileUrl + ".mlpbin";
+}
+
+string trainingSetCache::sidecarStamp(const string &fileUrl)
+{
+    long size = 0;
+    long long mtime = 0;
+    if (!fileInfo(fileUrl, size, mtime))
+        return string();
+    long long fileSize = size;
+    return string("[mlpsrc]") + string((const char *) &fileSize, sizeof fileSize) + string((const char *) &mtime, sizeof mtime);
+}
+
+long trainingSetCache::trainingSetBytes(const vector<traningSetMlp> &trainingSet)
+{
+    long bytes = trainingSet.capacity() * sizeof(traningSetMlp);
+    for (int i=0; i < trainingSet.size(); i++)
+    {
+        const traningSetMlp &sample = trainingSet[i];
+        bytes += (sample.tabExamples.capacity() + sample.tabOutputTargets.capacity() + sample.tabNonZeroValues.capacity()) * sizeof(double)
+                + sample.tabNonZeroIndexes.capacity() * sizeof(int);
+    }
+    return bytes;
+}
+
+void trainingSetCache::erase(map<string, cacheEntry>::iterator it)
+{
+    m_stats.nbEntry--;
+    m_stats.bytes -= it->second.bytes;
+    m_lru.erase(it->second.lru);
+    m_tabEntries.erase(it);
+}
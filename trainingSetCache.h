@@ -0,0 +1,90 @@
+/*
+* MIT License
+*
+* Mimetik - machine learning software
+* Copyright (c) 2018 Lounis Bellabes
+* nolius@users.sourceforge.net
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+#ifndef TRAININGSETCACHE_H
+#define TRAININGSETCACHE_H
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include "multilayerPerceptron.h"
+using namespace std;
+
+struct trainingSetCacheStats
+{
+    long nbEntry;
+    long bytes;                                         // memory held by the cached training sets
+    long nbHit;
+    long nbMiss;
+    long nbEviction;                                    // removed to stay under the memory limit
+};
+
+// training sets parsed by loadTrainingSetFile, shared read-only by all the networks of the process.
+// An entry is valid while its file keeps the same size and modification time; the least recently used
+// entries are removed above the memory limit (a network keeps its training set until it loads another one).
+// With the sidecar option, a text training set is also saved next to it in binary (file.mlpbin), after a stamp
+// of the text file (size and modification time), read instead of the text file while the stamp matches the file.
+class trainingSetCache
+{
+public:
+    static trainingSetCache &instance();                // process-wide cache
+    shared_ptr< const vector<traningSetMlp> > find(const string &fileUrl);  // NULL if not cached or the file changed
+    void insert(const string &fileUrl, const shared_ptr< const vector<traningSetMlp> > &trainingSet);
+    void clear();
+    void setMemoryLimit(const long bytes);              // 0: no cache
+    long getMemoryLimit() const;
+    void setSidecar(const bool enable);
+    bool getSidecar() const;
+    bool isSidecarValid(const string &fileUrl) const;   // the sidecar exists and was saved from the file with its current size and modification time
+    trainingSetCacheStats getStats() const;
+
+    static string sidecarFile(const string &fileUrl);
+    static string sidecarStamp(const string &fileUrl); // header of the sidecar: [mlpsrc], size and modification time ("" if no file)
+    static long trainingSetBytes(const vector<traningSetMlp> &trainingSet);
+
+private:
+    struct cacheEntry
+    {
+        shared_ptr< const vector<traningSetMlp> > trainingSet;
+        long size;                                      // file size and modification time when parsed
+        long long mtime;
+        long bytes;
+        list<string>::iterator lru;
+    };
+
+    trainingSetCache();
+    map<string, cacheEntry> m_tabEntries;
+    list<string> m_lru;                                 // most recently used first
+    long m_memoryLimit;
+    bool m_sidecar;
+    trainingSetCacheStats m_stats;
+    mutable mutex m_mutex;
+    void erase(map<string, cacheEntry>::iterator it);
+};
+
+#endif // TRAININGSETCACHE_H